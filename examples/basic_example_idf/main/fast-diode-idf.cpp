@@ -10,6 +10,14 @@ static const char *const TAG = "FastDiode";
 
 FastDiode led(LED_D4, EPinPolarity::ACTIVE_LOW, "led");
 
+// 开机灯效：300ms 渐变到 40%，保持 2 秒，闪 3 次，然后一直呼吸
+// 在编译期生成字节程序，放在flash中，播放时不需要应用层参与
+static constexpr auto startup = makeProgram(
+    keyframe::Ramp(toLevel(102), 300),
+    keyframe::Hold(2000),
+    keyframe::Loop(3), keyframe::Set(LEVEL_MAX), keyframe::Hold(250), keyframe::Set(0), keyframe::Hold(250), keyframe::Next(),
+    keyframe::Loop(), keyframe::Ramp(LEVEL_MAX, 1000, EEasing::IN_OUT), keyframe::Ramp(0, 1000, EEasing::IN_OUT), keyframe::Next());
+
 extern "C" void app_main(void) {
     ESP_LOGI(TAG, "Starting FastDiode");
     led.init(LEDC_CHANNEL_0);
@@ -33,22 +41,31 @@ extern "C" void app_main(void) {
         // 3. 渐亮效果
         ESP_LOGI(TAG, "3. 渐亮效果");
         led.fodeOn(2000); // 2秒内渐亮
-        vTaskDelay(pdMS_TO_TICKS(2000));
+        led.waitDone();   // 渐亮结束后立即继续，不需要估计时间
+        ESP_LOGI(TAG, "渐亮结束，亮度 %d", led.getBrightness());
 
         // 4. 渐暗效果
         ESP_LOGI(TAG, "4. 渐暗效果");
-        led.fodeOff(2000); // 2秒内渐暗
-        vTaskDelay(pdMS_TO_TICKS(2000));
+        led.fodeOff(2000, 255, EEasing::EXPO_OUT); // 2秒内渐暗，先快后慢
+        led.waitDone();
+        ESP_LOGI(TAG, "渐暗结束，亮度 %d", led.getBrightness());
 
         // 6. 呼吸灯效果
         ESP_LOGI(TAG, "6. 呼吸灯效果");
-        led.breathing(500); // 呼吸周期1秒
-        vTaskDelay(pdMS_TO_TICKS(5000));
+        led.breathing(500, 255, EEasing::SINE_IN_OUT); // 呼吸周期1秒，正弦变化
+        vTaskDelay(pdMS_TO_TICKS(5000));                // 呼吸灯一直进行，没有结束事件
 
         // 5. 闪烁效果
         ESP_LOGI(TAG, "5. 闪烁效果 闪烁3次后重新回到呼吸灯效果");
         led.flickering(200, 3); // 闪烁3次后重新回到呼吸灯效果
-        vTaskDelay(pdMS_TO_TICKS(3000));
+        led.waitDone();         // 闪烁结束即返回，下面的呼吸灯不影响
+        ESP_LOGI(TAG, "闪烁结束，当前灯效 %d", static_cast<int>(led.getEffect()));
+        vTaskDelay(pdMS_TO_TICKS(2000));
+
+        // 7. 关键帧时间线
+        ESP_LOGI(TAG, "7. 关键帧时间线");
+        led.play(startup);
+        vTaskDelay(pdMS_TO_TICKS(10000));
 
         // 暂停一下，准备开始下一轮演示
         led.close();
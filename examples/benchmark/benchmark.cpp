@@ -0,0 +1,533 @@
+/**
+ * @file benchmark.cpp
+ * @brief FastDiode库性能测试
+ * @details 同一份代码既可以作为 idf 应用（examples/benchmark_idf）运行，也可以在主机上运行（CMake 目标 fast_diode_benchmark）。
+ *          测试项：
+ *          - latency:  从调用控制函数到第一次写入占空比的延迟
+ *          - jitter:   闪烁时每次写入与理想时间表之差
+ *          - load:     1/8/32 个LED运行呼吸灯时，两种调度模式的每秒唤醒次数和每个LED的CPU时间
+ *          - ram:      每个实例占用的内存
+ *          - effect:   渐亮、渐暗、呼吸灯在软件步进和LEDC硬件渐变下各自唤醒CPU的次数（仅 idf）
+ *          - awake:    同上各灯效占用CPU的时间，以及持有电源管理锁的时间（仅 idf，需要 FAST_DIODE_DEBUG）
+ *          - timer:    当前计时后端按固定周期唤醒时的周期误差（仅 idf）
+ *          - batch:    64/256/1024 个LED时批量引擎每帧每个LED的耗时，主机上同时给出 FastDiode 实例逐个执行的耗时
+ *
+ *          每个结果输出为一行 JSON，以 "BENCH " 开头，便于从串口日志中过滤后在版本之间对比：
+ *          BENCH {"test":"latency","method":"open","mode":"task","avg_ns":12000,"max_ns":30000}
+ *
+ * @note idf 下所有LED都输出到同一个引脚，只用于统计开销；每个LED独占一个LEDC通道，用完后用软件PWM。
+ *       两个构建目标都为此增大了输出数（见 CMakeLists.txt 和 examples/benchmark_idf）：load 的 32 个LED、
+ *       主机上 batch 对比的 1024 个实例都有自己的输出，输出中的 leds/instances 就是要求的数量，输出不够时报错退出。
+ *       需要 CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS 才能统计CPU时间，双核芯片只统计当前核。对比两种计时后端时需要分别编译，见 examples/benchmark_idf。
+ *       主机默认使用虚拟时钟，延迟和CPU时间为主机执行这些代码的真实耗时；
+ *       打开 FAST_DIODE_HOST_REALTIME 后按真实时间运行，延迟包含线程唤醒的时间。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "FastDiode.h"
+#include "FastDiodeBatch.h"
+
+#ifdef FAST_DIODE_HOST
+#include <chrono>
+#include <ctime>
+#else
+#include "esp_system.h"
+#include "esp_timer.h"
+#endif
+
+#define LED_PIN 12
+#define MEASURE_MS 5000   // 负载测试的时长
+#define LATENCY_REPEAT 20 // 每个函数测量的次数
+#define JITTER_HALF 20    // 闪烁测试的半周期(ms)
+#define JITTER_COUNT 50   // 闪烁测试统计的写入次数
+#define WRITE_LOG 64      // 记录的写入次数上限
+#define TIMER_PERIODS 200
+#define BATCH_FRAMES 1000 // 批量测试的帧数，每帧 1ms
+
+/************************************************
+                    平台相关部分
+*************************************************/
+#ifdef FAST_DIODE_HOST
+
+static const char *const PLATFORM = "host";
+
+// 真实时间(ns)
+static int64_t wallNs()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// 灯效时间前进 ms 毫秒
+static void sleepMs(uint32_t ms)
+{
+#if FAST_DIODE_TIMER == FAST_DIODE_TIMER_VIRTUAL
+    FastDiodeHost::advance((FastDiodeTime)ms * 1000);
+#else
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+#endif
+}
+
+// 灯效任务消耗的CPU时间(ns)：虚拟时钟下所有任务都在当前线程中执行
+static int64_t cpuNs()
+{
+    return (int64_t)clock() * 1000000000 / CLOCKS_PER_SEC;
+}
+
+static void clearWrites() { FastDiodeHost::clear(); }
+
+// 取出写入时间（灯效时钟，us）
+static size_t collectWrites(FastDiodeTime *times, size_t max)
+{
+    const auto &writes = FastDiodeHost::writes();
+    size_t count = writes.size() < max ? writes.size() : max;
+    for (size_t i = 0; i < count; i++)
+        times[i] = writes[i].time;
+    return count;
+}
+
+static long freeHeap() { return -1; }
+
+#else
+
+static const char *const PLATFORM = CONFIG_IDF_TARGET;
+
+static int64_t wallNs() { return esp_timer_get_time() * 1000; }
+
+static void sleepMs(uint32_t ms) { vTaskDelay(pdMS_TO_TICKS(ms) ? pdMS_TO_TICKS(ms) : 1); }
+
+// 除空闲任务外的CPU时间(ns)
+static int64_t cpuNs()
+{
+#if configGENERATE_RUN_TIME_STATS
+    return esp_timer_get_time() * 1000 - (int64_t)ulTaskGetIdleRunTimeCounter() * 1000;
+#else
+    return -1;
+#endif
+}
+
+// 占空比写入钩子（FAST_DIODE_WRITE_HOOK），记录写入时间
+static volatile int64_t writeTimes[WRITE_LOG];
+static volatile size_t writeCount = 0;
+
+void fastDiodeWriteHook(uint8_t pin, uint32_t duty)
+{
+    size_t index = writeCount;
+    if (index < WRITE_LOG)
+    {
+        writeTimes[index] = esp_timer_get_time();
+        writeCount = index + 1;
+    }
+}
+
+static void clearWrites() { writeCount = 0; }
+
+static size_t collectWrites(FastDiodeTime *times, size_t max)
+{
+    size_t count = writeCount < max ? writeCount : max;
+    for (size_t i = 0; i < count; i++)
+        times[i] = writeTimes[i];
+    return count;
+}
+
+static long freeHeap() { return (long)esp_get_free_heap_size(); }
+
+#endif
+
+#if !defined(FAST_DIODE_HOST) || FAST_DIODE_TIMER != FAST_DIODE_TIMER_VIRTUAL
+// 命令开始的时间，与写入时间使用同一个时钟(us)
+static FastDiodeTime callTime()
+{
+#ifdef FAST_DIODE_HOST
+    return FastDiode::now();
+#else
+    return esp_timer_get_time();
+#endif
+}
+#endif
+
+static const char *timerName()
+{
+    switch (FAST_DIODE_TIMER)
+    {
+    case FAST_DIODE_TIMER_ESP_TIMER:
+        return "esp_timer";
+    case FAST_DIODE_TIMER_STEADY_CLOCK:
+        return "steady_clock";
+    case FAST_DIODE_TIMER_VIRTUAL:
+        return "virtual";
+    default:
+        return "tick";
+    }
+}
+
+static const char *modeName(bool shared) { return shared ? "shared" : "task"; }
+
+/************************************************
+                    测试项
+*************************************************/
+
+static constexpr auto program = makeProgram(keyframe::Ramp(LEVEL_MAX, 500), keyframe::Ramp(0, 500));
+
+struct Method
+{
+    const char *name;
+    void (*call)(FastDiode &led);
+    void (*prepare)(FastDiode &led); // 每次测量前先把LED设成另一个亮度（不计时），保证每次调用都会写入；为空时不需要
+};
+
+static const Method methods[] = {
+    {"open", [](FastDiode &led) { led.open(); }, [](FastDiode &led) { led.close(); }},
+    {"close", [](FastDiode &led) { led.close(); }, [](FastDiode &led) { led.open(); }},
+    {"setBrightness", [](FastDiode &led) { led.setBrightness(128); }, [](FastDiode &led) { led.setBrightness(64); }},
+    {"flickering", [](FastDiode &led) { led.flickering(100); }, nullptr},
+    {"fodeOn", [](FastDiode &led) { led.fodeOn(1000); }, nullptr},
+    {"fodeOff", [](FastDiode &led) { led.fodeOff(1000); }, nullptr},
+    {"breathing", [](FastDiode &led) { led.breathing(1000); }, nullptr},
+    {"play", [](FastDiode &led) { led.play(program); }, nullptr},
+};
+
+// 给LED分配PWM输出：先用LEDC通道（自动分配），用完后用软件PWM
+// 只能输出高低电平的LED只在亮灭变化时唤醒，不能代表灯效任务的开销：两者都用完说明构建配置的输出数不够，直接退出
+static void attachOutput(FastDiode &led, uint8_t resolution)
+{
+    if (led.init(5000, resolution) || led.initSoftPwm(resolution))
+        return;
+    printf("BENCH {\"test\":\"error\",\"reason\":\"out of PWM outputs, raise FAST_DIODE_SOFT_PWM_CHANNELS\"}\n");
+    abort();
+}
+
+// 调用控制函数到第一次写入占空比的延迟
+static void runLatency(bool shared)
+{
+    FastDiode::useSharedEngine(shared);
+    FastDiode led(LED_PIN, EPinPolarity::ACTIVE_HIGH, "bench");
+    led.init();
+    sleepMs(10);
+
+    for (const Method &method : methods)
+    {
+        int64_t sum = 0, max = 0;
+        int samples = 0;
+        for (int i = 0; i < LATENCY_REPEAT; i++)
+        {
+            FastDiodeTime first;
+            if (method.prepare)
+            {
+                method.prepare(led);
+                sleepMs(30);
+            }
+            clearWrites();
+#if defined(FAST_DIODE_HOST) && FAST_DIODE_TIMER == FAST_DIODE_TIMER_VIRTUAL
+            // 虚拟时钟下命令在当前时刻执行，延迟即为主机执行命令的耗时
+            int64_t start = wallNs();
+            method.call(led);
+            FastDiodeHost::flush();
+            int64_t latency = wallNs() - start;
+            if (collectWrites(&first, 1) == 0)
+                continue;
+#else
+            FastDiodeTime start = callTime();
+            method.call(led);
+            sleepMs(20);
+            if (collectWrites(&first, 1) == 0)
+                continue;
+            int64_t latency = (first - start) * 1000;
+#endif
+            sum += latency;
+            if (latency > max)
+                max = latency;
+            samples++;
+            sleepMs(30);
+        }
+        printf("BENCH {\"test\":\"latency\",\"platform\":\"%s\",\"timer\":\"%s\",\"mode\":\"%s\",\"method\":\"%s\","
+               "\"samples\":%d,\"avg_ns\":%lld,\"max_ns\":%lld}\n",
+               PLATFORM, timerName(), modeName(shared), method.name, samples,
+               (long long)(samples ? sum / samples : -1), (long long)max);
+    }
+}
+
+// 闪烁时每次写入与理想时间表（第一次写入 + k 个半周期）之差
+static void runJitter(bool shared)
+{
+    FastDiode::useSharedEngine(shared);
+    FastDiode led(LED_PIN, EPinPolarity::ACTIVE_HIGH, "bench");
+    led.init();
+    sleepMs(10);
+
+    clearWrites();
+    led.flickering(JITTER_HALF);
+    sleepMs(JITTER_HALF * (JITTER_COUNT + 1));
+
+    FastDiodeTime times[WRITE_LOG];
+    size_t count = collectWrites(times, JITTER_COUNT);
+    int64_t sum = 0, max = 0;
+    for (size_t k = 1; k < count; k++)
+    {
+        int64_t error = times[k] - (times[0] + (FastDiodeTime)k * JITTER_HALF * 1000);
+        if (error < 0)
+            error = -error;
+        sum += error;
+        if (error > max)
+            max = error;
+    }
+    printf("BENCH {\"test\":\"jitter\",\"platform\":\"%s\",\"timer\":\"%s\",\"mode\":\"%s\",\"period_us\":%d,"
+           "\"samples\":%u,\"avg_us\":%lld,\"max_us\":%lld}\n",
+           PLATFORM, timerName(), modeName(shared), JITTER_HALF * 1000, (unsigned)count,
+           (long long)(count > 1 ? sum / (int64_t)(count - 1) : -1), (long long)max);
+}
+
+// count 个LED同时运行呼吸灯的唤醒次数、CPU时间和内存，每个LED独占一个PWM输出
+static void runLoad(bool shared, int count)
+{
+    FastDiode::useSharedEngine(shared);
+
+    long heapBefore = freeHeap();
+    FastDiode *leds[32];
+    for (int i = 0; i < count; i++)
+        leds[i] = new FastDiode(LED_PIN, EPinPolarity::ACTIVE_HIGH, "bench");
+    long heapAfter = freeHeap();
+
+    // 使用软件步进，测量的是灯效任务本身的开销
+    for (int i = 0; i < count; i++)
+    {
+        attachOutput(*leds[i], 10);
+        leds[i]->useHardwareFade(false);
+        leds[i]->breathing(1000);
+    }
+    sleepMs(500);
+
+#ifdef FAST_DIODE_HOST
+    FastDiodeHost::record(false);
+#endif
+    uint32_t wakeups = FastDiode::getWakeupCount();
+    int64_t cpu = cpuNs();
+    sleepMs(MEASURE_MS);
+    cpu = cpuNs() - cpu;
+    wakeups = FastDiode::getWakeupCount() - wakeups;
+#ifdef FAST_DIODE_HOST
+    FastDiodeHost::record(true);
+#endif
+
+    // 主机上没有堆统计，用对象大小代替（不含线程栈）
+    long ram = heapBefore >= 0 ? (heapBefore - heapAfter) / count : (long)sizeof(FastDiode);
+    printf("BENCH {\"test\":\"load\",\"platform\":\"%s\",\"timer\":\"%s\",\"mode\":\"%s\",\"leds\":%d,"
+           "\"wakeups_per_s\":%lu,\"cpu_us_per_led_s\":%lld,\"ram_per_led\":%ld}\n",
+           PLATFORM, timerName(), modeName(shared), count,
+           (unsigned long)((uint64_t)wakeups * 1000 / MEASURE_MS),
+           (long long)(cpu >= 0 ? cpu / 1000 * 1000 / MEASURE_MS / count : -1), ram);
+
+    for (int i = 0; i < count; i++)
+        delete leds[i];
+    sleepMs(100);
+}
+
+// 第 i 个LED的灯效：呼吸灯、渐亮（测试期间不会结束）、闪烁轮流
+template <typename Led>
+static void startMixed(Led &&led, int i)
+{
+    if (i % 3 == 0)
+        led.breathing(1000);
+    else if (i % 3 == 1)
+        led.fodeOn(60000);
+    else
+        led.flickering(50);
+}
+
+// N 个LED运行混合灯效，每帧 1ms，批量引擎与逐个实例执行每帧每个LED的耗时(ns)
+template <size_t N>
+static void runBatch()
+{
+    FastDiodeBatch<N> *batch = new FastDiodeBatch<N>();
+    for (size_t i = 0; i < N; i++)
+        startMixed(batch->led(i), i);
+
+    // 每帧计算所有LED的亮度，再逐个取出（相当于写入扩展芯片）
+    volatile uint32_t sink = 0;
+    FastDiodeTime now = FastDiode::now();
+    int64_t start = wallNs();
+    for (int frame = 0; frame < BATCH_FRAMES; frame++)
+    {
+        now += 1000;
+        batch->frame(now);
+        uint32_t sum = 0;
+        batch->forEach([&](uint16_t, uint16_t level) { sum += level; });
+        sink = sink + sum;
+    }
+    int64_t batchNs = wallNs() - start;
+    delete batch;
+
+    // 同样的灯效由 N 个 FastDiode 实例在共享调度任务中逐个执行，只有虚拟时钟下能按帧推进
+    // 每个实例独占一个PWM输出，主机构建目标模拟了足够的 LEDC 通道
+    int64_t instanceNs = -1;
+    size_t instances = 0;
+#if defined(FAST_DIODE_HOST) && FAST_DIODE_TIMER == FAST_DIODE_TIMER_VIRTUAL
+    FastDiode::useSharedEngine(true);
+    FastDiode **leds = new FastDiode *[N];
+    for (; instances < N; instances++)
+    {
+        leds[instances] = new FastDiode(LED_PIN, EPinPolarity::ACTIVE_HIGH, "batch");
+        attachOutput(*leds[instances], 16);
+        leds[instances]->useHardwareFade(false);
+        startMixed(*leds[instances], instances);
+    }
+    FastDiodeHost::flush();
+    FastDiodeHost::record(false);
+    start = wallNs();
+    for (int frame = 0; frame < BATCH_FRAMES; frame++)
+        FastDiodeHost::advance(1000);
+    instanceNs = wallNs() - start;
+    FastDiodeHost::record(true);
+    for (size_t i = 0; i < instances; i++)
+        delete leds[i];
+    delete[] leds;
+#endif
+
+    printf("BENCH {\"test\":\"batch\",\"platform\":\"%s\",\"leds\":%u,\"frames\":%d,"
+           "\"batch_ns_per_led_frame\":%.2f,\"instances\":%u,\"instance_ns_per_led_frame\":%.2f}\n",
+           PLATFORM, (unsigned)N, BATCH_FRAMES, (double)batchNs / N / BATCH_FRAMES, (unsigned)instances,
+           instanceNs >= 0 && instances ? (double)instanceNs / instances / BATCH_FRAMES : -1.0);
+}
+
+#ifndef FAST_DIODE_HOST
+// 渐亮、渐暗、呼吸灯各自唤醒CPU的次数
+static void runEffect(bool hardware)
+{
+    FastDiode::useSharedEngine(false);
+    FastDiode led(LED_PIN, EPinPolarity::ACTIVE_LOW, "fade");
+    led.init();
+    led.useHardwareFade(hardware);
+
+    led.fodeOn(1000);
+    sleepMs(1500);
+    led.fodeOff(1000);
+    sleepMs(1500);
+    led.breathing(1000); // 运行两个完整周期
+    sleepMs(4000);
+    led.close();
+    sleepMs(100);
+
+    printf("BENCH {\"test\":\"effect\",\"platform\":\"%s\",\"timer\":\"%s\",\"fade\":\"%s\","
+           "\"fade_in\":%lu,\"fade_out\":%lu,\"breathing\":%lu}\n",
+           PLATFORM, timerName(), hardware ? "hardware" : "software",
+           (unsigned long)led.getEffectWakeups(EEffectType::FADE_IN),
+           (unsigned long)led.getEffectWakeups(EEffectType::FADE_OUT),
+           (unsigned long)led.getEffectWakeups(EEffectType::BREATHING));
+#if FAST_DIODE_DEBUG
+    // 测量模式：每种灯效实际占用CPU的时间；打开电源管理时还有禁止浅睡眠的时间（总时长约 7.1 秒）
+    printf("BENCH {\"test\":\"awake\",\"platform\":\"%s\",\"timer\":\"%s\",\"fade\":\"%s\","
+           "\"fade_in_us\":%lld,\"fade_out_us\":%lld,\"breathing_us\":%lld,\"pm_lock_us\":%lld}\n",
+           PLATFORM, timerName(), hardware ? "hardware" : "software",
+           (long long)led.getEffectAwakeTime(EEffectType::FADE_IN),
+           (long long)led.getEffectAwakeTime(EEffectType::FADE_OUT),
+           (long long)led.getEffectAwakeTime(EEffectType::BREATHING),
+#if FAST_DIODE_PM
+           (long long)led.getPowerLockTime());
+#else
+           -1LL);
+#endif
+#endif
+}
+
+#if FAST_DIODE_DITHER
+// 8 位分辨率下从占空比 8 渐暗到 0，打开时间抖动后为抖动唤醒的次数和渐暗本身执行的步数
+static void runDither()
+{
+    FastDiode::useSharedEngine(false);
+    FastDiode led(LED_PIN, EPinPolarity::ACTIVE_LOW, "dither");
+    led.init(5000, 8);
+    led.useDithering(true);
+
+    led.setBrightness(8);
+    sleepMs(100);
+    uint32_t before = led.getDitherWakeups();
+    led.fodeOff(2000, 8);
+    sleepMs(2500);
+    led.close();
+    sleepMs(100);
+
+    printf("BENCH {\"test\":\"dither\",\"platform\":\"%s\",\"timer\":\"%s\",\"interval_ms\":%d,"
+           "\"fade_out\":%lu,\"dither_wakeups\":%lu}\n",
+           PLATFORM, timerName(), FAST_DIODE_DITHER_INTERVAL,
+           (unsigned long)led.getEffectWakeups(EEffectType::FADE_OUT),
+           (unsigned long)(led.getDitherWakeups() - before));
+}
+#endif
+
+// 按绝对截止时间周期性等待，和灯效任务的等待方式相同
+// 周期误差为实际间隔与设定周期之差，延迟为醒来时间与截止时间之差
+static void runTimer(FastDiodeTime period)
+{
+    FastDiodeTimer timer;
+    timer.begin(xTaskGetCurrentTaskHandle());
+
+    FastDiodeTime deadline = FastDiode::now() + period;
+    FastDiodeTime last = 0;
+    int64_t errorSum = 0, errorMax = 0, lateMax = 0;
+    for (int i = 0; i <= TIMER_PERIODS; i++)
+    {
+        timer.wait(deadline);
+        FastDiodeTime woke = FastDiode::now();
+        if (i > 0)
+        {
+            int64_t error = woke - last - period;
+            if (error < 0)
+                error = -error;
+            errorSum += error;
+            if (error > errorMax)
+                errorMax = error;
+            if (woke - deadline > lateMax)
+                lateMax = woke - deadline;
+        }
+        last = woke;
+        deadline += period;
+    }
+
+    printf("BENCH {\"test\":\"timer\",\"platform\":\"%s\",\"timer\":\"%s\",\"period_us\":%lld,"
+           "\"error_avg_us\":%lld,\"error_max_us\":%lld,\"late_max_us\":%lld}\n",
+           PLATFORM, timerName(), (long long)period, (long long)(errorSum / TIMER_PERIODS),
+           (long long)errorMax, (long long)lateMax);
+}
+#endif
+
+static void runAll()
+{
+    printf("BENCH {\"test\":\"info\",\"platform\":\"%s\",\"timer\":\"%s\",\"sizeof_fastdiode\":%u}\n",
+           PLATFORM, timerName(), (unsigned)sizeof(FastDiode));
+    for (bool shared : {false, true})
+    {
+        runLatency(shared);
+        runJitter(shared);
+    }
+    const int counts[] = {1, 8, 32};
+    for (bool shared : {false, true})
+        for (int count : counts)
+            runLoad(shared, count);
+    runBatch<64>();
+    runBatch<256>();
+    runBatch<1024>();
+#ifndef FAST_DIODE_HOST
+    for (bool hardware : {false, true})
+        runEffect(hardware);
+#if FAST_DIODE_DITHER
+    runDither();
+#endif
+    for (FastDiodeTime period : {1000, 2500, 7300, 20000})
+        runTimer(period);
+#endif
+    printf("BENCH {\"test\":\"done\"}\n");
+}
+
+#ifdef FAST_DIODE_HOST
+int main()
+{
+    runAll();
+    return 0;
+}
+#else
+extern "C" void app_main(void)
+{
+    runAll();
+}
+#endif
@@ -12,6 +12,8 @@
  *          - 呼吸灯效果
  *          - 其他独立控制
  *
+ *          LED1 的渐变和闪烁结束后，在串口打印结束时的亮度（onDone 回调 + 状态查询，不需要估计延时）
+ *
  * @author Mushroom
  * @date 2024-01-15
  * @version 1.0
@@ -32,12 +34,17 @@ FastDiode D5(13, EPinPolarity::ACTIVE_LOW); // LED 使用引脚 13
 bool lastButtonState = HIGH;
 int effectMode = 0; // 灯效模式
 
+// LED1 的有限灯效结束时由灯效任务置位，在 loop() 中打印
+volatile bool d4Done = false;
+
 void setup()
 {
     Serial.begin(115200);
     Serial.println("Hello, FastDiode!");
     D4.init(CHANNEL_0);
     D5.breathing(1000, 125);
+    // 回调在灯效任务中执行，只记录一下，打印留给 loop()
+    D4.onDone([](FastDiode &, void *) { d4Done = true; });
     pinMode(BUTTON_PIN, INPUT_PULLUP);
 }
 
@@ -80,6 +87,13 @@ void loop()
         }
     }
 
+    // 状态查询只读一个原子变量，任何任务都可以随时调用
+    if (d4Done)
+    {
+        d4Done = false;
+        Serial.printf("LED1 灯效结束，亮度 %d，LED2 亮度 %d\n", D4.getBrightness(), D5.getBrightness());
+    }
+
     lastButtonState = buttonState;
     delay(50); // 消抖延时
 }
@@ -0,0 +1,44 @@
+/**
+ * @file host_example.cpp
+ * @brief FastDiode库主机示例
+ * @details 在电脑上运行灯效，不需要开发板：
+ *          - 占空比写入由主机硬件抽象层记录下来
+ *          - 时间由虚拟时钟给出，10 分钟的呼吸灯几毫秒就能执行完
+ *
+ * @note 构建：
+ *       cmake -S . -B build && cmake --build build && ./build/host_example
+ */
+
+#include <cstdio>
+#include "FastDiode.h"
+
+int main()
+{
+    FastDiode led(12, EPinPolarity::ACTIVE_HIGH, "led");
+    led.init(LEDC_CHANNEL_0, 5000, 10);
+
+    // 1. 渐亮，打印前几次写入
+    led.fodeOn(1000);
+    FastDiodeHost::advance(1000 * 1000);
+    printf("fade in: %zu writes\n", FastDiodeHost::writes().size());
+    for (size_t i = 0; i < 5 && i < FastDiodeHost::writes().size(); i++)
+        printf("  t=%6lld us  duty=%u\n", (long long)FastDiodeHost::writes()[i].time, FastDiodeHost::writes()[i].duty);
+
+    // 2. 10 分钟呼吸灯，只统计写入次数
+    FastDiodeHost::clear();
+    FastDiodeHost::record(false);
+    led.breathing(1000);
+    FastDiodeHost::advance(600LL * 1000 * 1000);
+    printf("breathing 10 min: %llu writes, %lu wakeups\n",
+           (unsigned long long)FastDiodeHost::writeCount(),
+           (unsigned long)FastDiode::getWakeupCount());
+
+    // 3. 闪烁 3 次后回到呼吸灯
+    FastDiodeHost::clear();
+    FastDiodeHost::record(true);
+    led.flickering(200, 3);
+    FastDiodeHost::advance(1200 * 1000);
+    printf("blink: %zu writes, back to breathing: %s\n", FastDiodeHost::writes().size(),
+           FastDiodeHost::writes().size() > 6 ? "yes" : "no");
+    return 0;
+}
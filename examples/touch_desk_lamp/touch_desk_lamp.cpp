@@ -4,7 +4,7 @@
  * @details 使用FastDiode和OneButton库实现触摸台灯功能：
  *          - 单击：开关灯
  *          - 长按：无极调光（0-100%渐变，约5秒完成一次循环）
- *          - 断电记忆（使用EEPROM保存亮度）
+ *          - 断电记忆（FastDiode 把最近的稳定状态合并后写入 NVS，上电时恢复开关状态和亮度）
  *
  * @author Mushroom
  * @date 2024-01-15
@@ -15,20 +15,22 @@
  * @note 硬件连接：
  *       - LED: GPIO12 (低电平点亮)
  *       - 触摸按键: GPIO9 (低电平触发)
+ * @note 需要在编译选项中定义 FAST_DIODE_PERSIST=1，例如 PlatformIO 的 build_flags = -DFAST_DIODE_PERSIST=1
  */
 
 #include <Arduino.h>
 #include "FastDiode.h"
 #include <OneButton.h>
-#include <EEPROM.h>
+
+#if !FAST_DIODE_PERSIST
+#error "touch_desk_lamp 需要在编译选项中定义 FAST_DIODE_PERSIST=1"
+#endif
 
 // 引脚定义
 #define LED_PIN 12
 #define TOUCH_PIN 9
-#define EEPROM_SIZE 4
-#define BRIGHTNESS_ADDR 0
 
-// 创建LED对象
+// 创建LED对象，名字 "desk_lamp" 就是 NVS 中保存状态的键，构造时恢复上次的状态
 FastDiode led(LED_PIN, EPinPolarity::ACTIVE_LOW, "desk_lamp");
 
 // 创建按键对象（低电平触发）
@@ -48,24 +50,20 @@ const uint16_t FULL_CYCLE_TIME = 5000; // 完整调光周期时间（ms）
 const uint8_t MIN_PERCENT = 2;         // 最小亮度百分比
 const uint8_t MAX_PERCENT = 100;       // 最大亮度百分比
 
-// 保存亮度到EEPROM
-void saveBrightness()
-{
-    EEPROM.write(BRIGHTNESS_ADDR, currentPercent);
-    EEPROM.commit();
-    Serial.printf("亮度已保存: %d%%\n", currentPercent);
-}
-
-// 加载保存的亮度
+// 加载恢复的状态：关灯前最后的亮度和开关状态
+// 不需要手动保存，亮度稳定 FAST_DIODE_PERSIST_DELAY 毫秒后由库在后台写入一次
 void loadBrightness()
 {
-    currentPercent = EEPROM.read(BRIGHTNESS_ADDR);
+    // 等灯效任务执行完构造时恢复的灯效
+    led.waitDone(100);
+    isLampOn = led.getBrightness() > 0;
+    currentPercent = (led.getLastBrightness() * 100 + 127) / 255;
     // 确保读取的值有效
     if (currentPercent > MAX_PERCENT || currentPercent < MIN_PERCENT)
     {
         currentPercent = 50; // 默认50%
     }
-    Serial.printf("加载保存的亮度: %d%%\n", currentPercent);
+    Serial.printf("恢复的状态: %s，亮度: %d%%\n", isLampOn ? "开" : "关", currentPercent);
 }
 
 // 设置LED亮度
@@ -107,7 +105,6 @@ void stopDimming()
     if (!isLampOn)
         return;
     isDimming = false;
-    saveBrightness(); // 保存当前亮度
     Serial.printf("调光结束，当前亮度: %d%%\n", currentPercent);
 }
 
@@ -161,8 +158,7 @@ void setup()
     Serial.begin(115200);
     Serial.println("触摸台灯初始化...");
 
-    // 初始化EEPROM
-    EEPROM.begin(EEPROM_SIZE);
+    // 恢复断电前的状态
     loadBrightness();
 
     // 配置按键回调函数
@@ -175,8 +171,6 @@ void setup()
     button.setClickMs(250);   // 单击判定时间250ms
     button.setPressMs(400);   // 长按判定时间400ms
 
-    // 初始状态：关闭
-    led.close();
     Serial.println("初始化完成，单击开关，长按调节亮度");
 }
 
@@ -1,209 +1,1044 @@
 #include "FastDiode.h"
+#include "FastDiodeEngine.h"
+#include <cstring>
 
-// 等待任务通知函数，用于接收新的 LED 控制命令,
-// 参数：led - 用于存储接收到的 LED 控制参数
-// 返回：true - 接收到通知，false - 超时未接收到通知
-bool FastDiode::waitForNotify(LEDState &led)
-{
-    uint32_t value;
-    // 等待通知，等待时间由 led.stepInterval 决定
-    if (pdTRUE == xTaskGenericNotifyWait(0,                 // 进入时要清除的位（此处不清除）
-                                         0,                 // 退出时要清除的位（此处不清除）
-                                         0,                 // 用于接收通知值的指针
-                                         &value,            // 存储接收到的通知值
-                                         led.stepInterval)) // 最大等待时间
-    {
-        // 将接收到的数据转换为 LEDState 结构体并存储
-        led = *(LEDState *)value;
-        return 1;
+bool FastDiode::sharedEngine = FAST_DIODE_SHARED_ENGINE;
+#if FAST_DIODE_PERSIST
+bool FastDiode::persistence = true;
+#endif
+volatile uint32_t FastDiode::wakeupCount = 0;
+
+FastDiode::FastDiode(uint8_t _pin, EPinPolarity _edge, const char *_name)
+{
+    pin = _pin;
+    edge = _edge;
+    strncpy(name, _name, sizeof(name) - 1);
+    name[sizeof(name) - 1] = 0;
+    for (int i = 0; i < EFFECT_PRIORITY_COUNT; i++)
+        blendRequest[i].store(LEVEL_MAX, std::memory_order_relaxed);
+#ifdef ARDUINO
+    pinMode(pin, OUTPUT);
+#elif !defined(FAST_DIODE_HOST)
+    const gpio_config_t config = {
+        .pin_bit_mask = 1ULL << pin,
+        .mode = GPIO_MODE_OUTPUT,
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_DISABLE
+    };
+    ESP_ERROR_CHECK(gpio_config(&config));
+#endif
+    // 共享调度模式下只注册到调度任务，不再单独创建任务；静态模式下槽位用完或内存不足、任务创建失败时也注册到调度任务
+    if (sharedEngine || !timer.start(name, service, this))
+        FastDiodeEngine::attach(this);
+#if FAST_DIODE_PERSIST
+    restore();
+#else
+    sendNotify(EEffectType::STATIC, 0, 0, 0, 0, nullptr, EEasing::LINEAR);
+#endif
+}
+
+FastDiode::~FastDiode()
+{
+    if (timer.started())
+        timer.stop();
+    else
+        FastDiodeEngine::detach(this);
+#ifndef ARDUINO
+    detachLedc();
+    if (softChannel >= 0)
+        FastDiodeSoftPwm::detach(softChannel);
+#endif
+}
+
+#ifndef ARDUINO
+bool FastDiode::attachLedc(bool fixed, ELEDChannel _channel, uint32_t freq, uint8_t _resolution)
+{
+    detachLedc();
+    if (softChannel >= 0)
+    {
+        FastDiodeSoftPwm::detach(softChannel);
+        softChannel = -1;
+    }
+    FastDiodeLedcSlot slot;
+    ledcError = fixed ? FastDiodeLedc::claim(_channel, freq, _resolution, slot)
+                      : FastDiodeLedc::allocate(freq, _resolution, slot);
+    if (ledcError != ELedcError::NONE)
+        return false;
+
+    ledc = slot;
+    channel = slot.channel;
+    resolution = _resolution;
+    if (curve && curve->resolution != resolution)
+        curve = nullptr;
+#if !defined(FAST_DIODE_HOST)
+    // 定时器已由 FastDiodeLedc 配置好，这里只配置通道
+    ledc_channel_config_t ledc_channel = {
+        .gpio_num       = pin,
+        .speed_mode     = ledc.mode,
+        .channel        = channel,
+        .intr_type      = LEDC_INTR_DISABLE,
+        .timer_sel      = ledc.timer,
+        .duty           = toDuty(outputLevel), // 接着输出当前亮度，不从 0 开始
+        .hpoint         = 0,
+#if FAST_DIODE_PM_SLEEP_CLOCK
+        .sleep_mode     = LEDC_SLEEP_MODE_KEEP_ALIVE,
+#else
+        .sleep_mode     = LEDC_SLEEP_MODE_NO_ALIVE_NO_PD,
+#endif
+        .flags = {
+            .output_invert = 0
+        }
+    };
+    ESP_ERROR_CHECK(ledc_channel_config(&ledc_channel));
+
+    // 安装硬件渐变服务，渐变结束时通过中断回调唤醒灯效任务
+    static bool fadeInstalled = false;
+    if (!fadeInstalled) {
+        ESP_ERROR_CHECK(ledc_fade_func_install(0));
+        fadeInstalled = true;
+    }
+    ledc_cbs_t callbacks = {
+        .fade_cb = fadeEndISR
+    };
+    ESP_ERROR_CHECK(ledc_cb_register(ledc.mode, channel, &callbacks, this));
+#endif
+    initialized = true;
+    return true;
+}
+
+void FastDiode::detachLedc()
+{
+    if (!initialized)
+        return;
+    initialized = false;
+#if !defined(FAST_DIODE_HOST)
+    stopHwFade();
+    // 通道只属于这个实例，注销回调后不会再有中断访问它
+    ledc_cbs_t callbacks = {
+        .fade_cb = nullptr
+    };
+    ledc_cb_register(ledc.mode, channel, &callbacks, nullptr);
+    ledc_stop(ledc.mode, channel, 0);
+#endif
+    FastDiodeLedc::release(ledc);
+}
+#endif
+
+// 从命令通道取出所有新命令，只在灯效任务中调用
+// 每个命令放到自己优先级的那一层，同一层的多个命令只保留最后一个，其他层不受影响
+// 返回：true - 取到了新命令
+bool FastDiode::takeCommands()
+{
+    uint32_t taken = 0;
+    FastDiodeTime start = now();
+    commands.drain([&](const FastDiodeCommand &cmd) { setLayer(cmd.priority, decode(cmd, start)); taken++; },
+                   [&](uint16_t brightness) {
+                       setLayer(EEffectPriority::BACKGROUND,
+                                decode({EEffectType::STATIC, brightness, 0, 0, nullptr, EEffectPriority::BACKGROUND, EEasing::LINEAR, false}, start));
+                       taken++;
+                   });
+    if (!taken)
+        return 0;
+    // 先发布新的灯效，再减去未取走的命令：其他任务看到命令已取走时，一定也看到了它的灯效
+    published.store(stateWord(true));
+    access.fetch_sub(taken * ACCESS_PENDING, std::memory_order_release);
+    stopHwFade();
+    return 1;
+}
+
+// 直接写入：实例空闲时，固定亮度在调用者的任务中立即输出，省去唤醒灯效任务的延迟和两次任务切换
+// 状态字为 0 时才能占用，此时灯效任务没有任何事要做，不会与它同时访问灯效层和输出
+bool FastDiode::writeDirect(uint16_t level)
+{
+    if (batched)
+        return false;
+#if FAST_DIODE_DITHER
+    // 抖动需要灯效任务每帧写入
+    if (dither)
+        return false;
+#endif
+    uint32_t idle = 0;
+    if (!access.compare_exchange_strong(idle, ACCESS_DIRECT, std::memory_order_acquire))
+        return false;
+
+    LEDState &LED = layers[0];
+    LED.status = EEffectType::STATIC;
+    LED.targetBrightness = level;
+    LED.currentBrightness = level;
+    LED.startTime = now();
+    LED.next = TIME_NEVER;
+    if (level != outputLevel)
+        setBrightnessImpl(level);
+    outputLevel = level;
+    published.store(stateWord(false));
+#if FAST_DIODE_PERSIST
+    persist();
+#endif
+
+    // 写入期间又有命令投递进来：灯效任务看到实例被占用时没有取走它们，释放后重新唤醒
+    if (access.fetch_and(~ACCESS_DIRECT, std::memory_order_release) & ~ACCESS_DIRECT)
+        wake();
+    return true;
+}
+
+// 灯效任务执行一次，两种调度模式共用
+// 调用者正在直接写入时跳过这个实例，不等待：调用者写完后看到有新命令会重新唤醒，共享调度任务不会因此耽误其他LED
+// 执行完后如果只剩背景层的固定亮度，释放实例，允许直接写入
+bool FastDiode::process(FastDiodeTime now, bool take)
+{
+    uint32_t word = access.load(std::memory_order_relaxed);
+    do
+    {
+        if (word & ACCESS_DIRECT)
+            return false;
+    } while (!access.compare_exchange_weak(word, word | ACCESS_RUNNING, std::memory_order_acquire));
+
+    if (take)
+        takeCommands();
+#if FAST_DIODE_DEBUG
+    // 测量模式：这一步占用的CPU时间记在最高一层的灯效上
+    FastDiodeTime begin = fastDiodeWallTime();
+    EEffectType effect = layers[topLayer()].status;
+    bool running = run(now);
+    effectAwake[static_cast<int>(effect)] += fastDiodeWallTime() - begin;
+#else
+    bool running = run(now);
+#endif
+    publishState(running);
+    if (!running && layerMask == 1 && blendMode[0] == EBlendMode::OVERRIDE && opacity[0] == LEVEL_MAX)
+        access.fetch_and(~ACCESS_RUNNING, std::memory_order_release);
+    return running;
+}
+
+uint32_t FastDiode::stateWord(bool busy) const
+{
+    uint8_t top = topLayer();
+    uint32_t word = outputLevel | (uint32_t)layers[top].status << STATE_EFFECT_SHIFT;
+    if (busy)
+        word |= STATE_BUSY;
+    for (int level = 0; level <= top; level++)
+    {
+        if (!(layerMask >> level & 1))
+            continue;
+        const LEDState &LED = layers[level];
+        if (LED.status == EEffectType::FADE_IN || LED.status == EEffectType::FADE_OUT ||
+            LED.status == EEffectType::PROGRAM ||
+            (LED.status == EEffectType::BLINK && LED.repeatCount < MAX_COUNT))
+        {
+            word |= STATE_FINITE;
+            break;
+        }
+    }
+    return word;
+}
+
+// 每执行一步发布一次，状态字不变时只读不写
+// 通知只在完成状态变化时发出：没有注册回调、事件组，也没有人等待时，只多一次比较
+void FastDiode::publishState(bool busy)
+{
+    uint32_t word = stateWord(busy);
+    if (word != published.load(std::memory_order_relaxed))
+        published.store(word);
+
+    bool finite = word & STATE_FINITE;
+    if (finiteShown && !finite)
+    {
+        FastDiodeDoneCallback callback = doneCallback.load(std::memory_order_acquire);
+        if (callback)
+            callback(*this, doneArg);
+#if !defined(FAST_DIODE_HOST)
+        EventGroupHandle_t group = doneGroup.load(std::memory_order_acquire);
+        if (group)
+            xEventGroupSetBits(group, doneBits);
+#endif
+    }
+    finiteShown = finite;
+
+#if !defined(FAST_DIODE_HOST)
+    // waitDone() 的事件组：完成位跟随完成状态，等待者只等不清，不会错过唤醒
+    EventGroupHandle_t group = waitGroup.load();
+    if (group)
+    {
+        bool done = !finite && access.load(std::memory_order_relaxed) < ACCESS_PENDING;
+        if (done != waitGroupDone)
+        {
+            if (done)
+                xEventGroupSetBits(group, 1);
+            else
+                xEventGroupClearBits(group, 1);
+            waitGroupDone = done;
+        }
     }
+#endif
+}
+
+#if defined(FAST_DIODE_HOST)
+// 主机上轮询：虚拟时钟每次推进 1ms（期间执行到期的灯效），实时时钟每次睡眠 1ms
+bool FastDiode::waitDone(uint32_t timeout)
+{
+    FastDiodeTime deadline = timeout == UINT32_MAX ? TIME_NEVER : now() + (FastDiodeTime)timeout * 1000;
+    while (!isDone())
+    {
+        if (now() >= deadline)
+            return false;
+#if FAST_DIODE_TIMER == FAST_DIODE_TIMER_VIRTUAL
+        FastDiodeHost::advance(1000);
+#else
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+    }
+    return true;
+}
+#else
+bool FastDiode::waitDone(uint32_t timeout)
+{
+    if (isDone())
+        return true;
+
+    // 第一次等待时创建事件组，同时等待的其他任务等它创建完
+    uint8_t created = 0;
+    if (waitGroupState.compare_exchange_strong(created, 1))
+    {
+#if FAST_DIODE_STATIC
+        waitGroup.store(xEventGroupCreateStatic(&waitGroupBuffer));
+#else
+        waitGroup.store(xEventGroupCreate());
+#endif
+        waitGroupState.store(2);
+    }
+    while (waitGroupState.load() != 2)
+        vTaskDelay(1);
+    EventGroupHandle_t group = waitGroup.load();
+    if (!group)
+        return false;
+
+    // 先发布事件组再检查状态，灯效任务先发布状态再检查事件组，两边至少有一边看到对方
+    TickType_t start = xTaskGetTickCount();
+    TickType_t limit = timeout == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(timeout);
+    while (!isDone())
+    {
+        TickType_t waited = xTaskGetTickCount() - start;
+        if (limit != portMAX_DELAY && waited >= limit)
+            return false;
+        EventBits_t bits = xEventGroupWaitBits(group, 1, pdFALSE, pdTRUE, limit == portMAX_DELAY ? portMAX_DELAY : limit - waited);
+        // 完成位还是上一个灯效留下的：新命令刚发出，灯效任务还没有取走，让它先执行
+        if ((bits & 1) && !isDone())
+            vTaskDelay(1);
+    }
+    return true;
+}
+#endif
+
+// 把灯效放到 priority 层，入栈/出栈只改一位掩码
+// 结束命令（NONE）让这一层出栈；背景层一直存在，NONE 表示保持当前亮度
+void FastDiode::setLayer(EEffectPriority priority, const LEDState &state)
+{
+    uint8_t level = static_cast<uint8_t>(priority);
+    layers[level] = state;
+    if (state.status == EEffectType::NONE && level > 0)
+        layerMask &= ~(1u << level);
+    else
+        layerMask |= 1u << level;
+    layersChanged = true;
+#if FAST_DIODE_PERSIST
+    if (level == 0)
+        persist();
+#endif
+}
+
+#if FAST_DIODE_PERSIST
+// 恢复保存的灯效：和普通的命令一样交给灯效任务，第一次写入的占空比就是恢复的亮度
+void FastDiode::restore()
+{
+    FastDiodeStoreRecord record;
+    bool found = false;
+    // 名字就是 NVS 中的键，默认名字的实例不保存
+    if (persistence && name[0] && strcmp(name, " ") != 0)
+        persistSlot = FastDiodeStore::attach(name, record, found);
+    switch (found ? static_cast<EEffectType>(record.effect) : EEffectType::NONE)
+    {
+    case EEffectType::STATIC:
+        setBrightness16(record.level);
+        break;
+    case EEffectType::BREATHING:
+        breathing16(record.time, record.level, static_cast<EEasing>(record.easing));
+        break;
+    case EEffectType::BLINK:
+        flickering16(record.time, MAX_COUNT, record.level);
+        break;
+    default:
+        sendNotify(EEffectType::STATIC, 0, 0, 0, 0, nullptr, EEasing::LINEAR);
+        break;
+    }
+}
+
+// 渐变按终点保存：渐亮为目标亮度，渐暗为熄灭；有限次闪烁和关键帧程序不改变保存的记录
+// 只更新内存中的记录，由保存任务在记录稳定后写入flash
+void FastDiode::persist()
+{
+    if (persistSlot < 0)
+        return;
+    const LEDState &LED = layers[0];
+    FastDiodeStoreRecord record;
+    record.effect = static_cast<uint8_t>(EEffectType::STATIC);
+    switch (LED.status)
+    {
+    case EEffectType::STATIC:
+    case EEffectType::FADE_IN:
+        record.level = LED.targetBrightness;
+        break;
+    case EEffectType::FADE_OUT:
+        record.level = 0;
+        break;
+    case EEffectType::BREATHING:
+        record.effect = static_cast<uint8_t>(EEffectType::BREATHING);
+        record.level = LED.targetBrightness;
+        record.easing = static_cast<uint8_t>(LED.easing);
+        record.time = LED.totalDuration;
+        break;
+    case EEffectType::BLINK:
+        if (LED.repeatCount < MAX_COUNT)
+            return;
+        record.effect = static_cast<uint8_t>(EEffectType::BLINK);
+        record.level = LED.targetBrightness;
+        record.time = LED.stepInterval;
+        break;
+    default:
+        return;
+    }
+    FastDiodeStore::save(persistSlot, record);
+}
+#endif
+
+// 设置混合方式：API 只写入原子变量，由灯效任务在下一步取走，不与正在执行的合成冲突
+void FastDiode::setBlend(EEffectPriority priority, EBlendMode mode, uint16_t level)
+{
+    blendRequest[static_cast<int>(priority)].store((uint32_t)mode << 16 | level, std::memory_order_relaxed);
+    blendChanged.store(true, std::memory_order_release);
+    wake();
+}
+
+uint8_t FastDiode::baseLayer() const
+{
+    for (uint8_t level = topLayer(); level > 0; level--)
+        if ((layerMask >> level & 1) && blendMode[level] == EBlendMode::OVERRIDE && opacity[level] == LEVEL_MAX)
+            return level;
     return 0;
 }
 
-// 发送任务通知函数，用于更新 LED 的控制参数
+// 发送命令，任何任务都可以同时调用，不会阻塞
 // 参数：
 //   _status: LED 状态（开关、渐变等）
-//   _currentBrightness: 目标亮度值
+//   _targetBrightness: 目标亮度值（16位）
 //   _stepInterval: 延时时间
 //   _totalDuration: 动作持续时间
 //   repeatCount: 重复次数
-bool FastDiode::sendNotify(EEffectType _status, uint8_t _targetBrightness, uint32_t _stepInterval, uint32_t _totalDuration, uint32_t _repeatCount)
+//   _program: 关键帧程序
+//   _easing: 渐变/呼吸灯的缓动曲线，其他灯效忽略
+//   _priority: 放在哪一层
+//   _woken: 非空时在中断中调用，只使用无锁的命令通道和 ...FromISR 通知
+// 返回：false - 命令队列已满，命令被丢弃
+bool FastDiode::sendNotify(EEffectType _status, uint16_t _targetBrightness, uint32_t _stepInterval, uint32_t _totalDuration, uint32_t _repeatCount, const uint8_t *_program, EEasing _easing, EEffectPriority _priority, BaseType_t *_woken)
 {
-    vTaskResume(taskHandle); // 恢复任务运行
+#if FAST_DIODE_DEBUG
+    stats.commands.fetch_add(1, std::memory_order_relaxed);
+#endif
+    bool background = _status == EEffectType::STATIC && _priority == EEffectPriority::BACKGROUND;
+    // 空闲时背景层的固定亮度直接写入，不经过灯效任务；中断中不能直接写入
+    if (background && !_woken && writeDirect(_targetBrightness))
+    {
+#if FAST_DIODE_DEBUG
+        stats.direct.fetch_add(1, std::memory_order_relaxed);
+#endif
+        return 1;
+    }
+
+    // 先计入未取走的命令，灯效任务取走时再减去，在此之前不会有直接写入插到这条命令前面
+    access.fetch_add(ACCESS_PENDING, std::memory_order_relaxed);
+    // 背景层的固定亮度只保留最新值，其他灯效按顺序排队
+    if (background)
+    {
+        // 覆盖了还没取走的固定亮度，被覆盖的那条不会再被取走
+        if (commands.postStatic(_targetBrightness))
+        {
+            access.fetch_sub(ACCESS_PENDING, std::memory_order_relaxed);
+#if FAST_DIODE_DEBUG
+            stats.overwritten.fetch_add(1, std::memory_order_relaxed);
+#endif
+        }
+    }
+    else if (!commands.post({_status,
+                             _targetBrightness,
+                             _status == EEffectType::BLINK ? _stepInterval : _totalDuration,
+                             _repeatCount,
+                             _program,
+                             _priority,
+                             _easing,
+                             false}))
+    {
+        access.fetch_sub(ACCESS_PENDING, std::memory_order_relaxed);
+#if FAST_DIODE_DEBUG
+        stats.dropped.fetch_add(1, std::memory_order_relaxed);
+#endif
+        return 0;
+    }
+
+    /************************************************
+                    通知 LED 控制任务
+    *************************************************/
+    return wake(_woken);
+}
+
+bool FastDiode::wake(BaseType_t *woken)
+{
+    // 共享调度模式：标记有新命令，由调度任务取走
+    if (!timer.started())
+        return woken ? FastDiodeEngine::wakeFromISR(this, woken) : FastDiodeEngine::wake(this);
+
+    if (woken)
+        timer.notifyFromISR(woken);
+    else
+        timer.notify();
+    return 1;
+}
+
+// 把命令解析成灯效状态，在灯效任务中执行
+LEDState FastDiode::decode(const FastDiodeCommand &cmd, FastDiodeTime start)
+{
+    LEDState state{};
 
     // 开始针对每个参数进行处理
     /************************************************
                     设置 LED 状态
      *************************************************/
-    notifyLED.status = _status;
+    state.status = cmd.status;
 
     /************************************************
                     设置 LED 最大亮度
     *************************************************/
-    notifyLED.targetBrightness = _targetBrightness;
+    state.targetBrightness = cmd.brightness;
 
     /************************************************
                     设置 LED 步进时间
     *************************************************/
-    // 1.对于渐变效果（渐亮、渐暗、呼吸灯）的情况，步进时间要根据总时间和亮度范围计算
-    if (notifyLED.status == EEffectType::FADE_IN       // 渐亮
-        || notifyLED.status == EEffectType::FADE_OUT   // 渐暗
-        || notifyLED.status == EEffectType::BREATHING) // 呼吸灯
+    uint32_t totalDuration = 0;
+    // 1.对于渐变效果（渐亮、渐暗、呼吸灯）的情况，亮度由时间直接算出，不需要步进时间
+    if (state.status == EEffectType::FADE_IN       // 渐亮
+        || state.status == EEffectType::FADE_OUT   // 渐暗
+        || state.status == EEffectType::BREATHING) // 呼吸灯
     {
         // 如果总时间小于255ms，则设置为255ms
         // 确保最小动作时间不小于 255ms，如果时间太短，则每次的变化值会很小，导致灯效不明显
-        _totalDuration = _totalDuration < 255 ? 255 : _totalDuration;
-
-        notifyLED.stepInterval = _totalDuration / _targetBrightness; // 根据总时间和亮度范围计算来计算每次延时多久
-        notifyLED.stepping = notifyLED.stepInterval;                 // 每步的步进值,即每次变化的值
+        totalDuration = cmd.time < 255 ? 255 : cmd.time;
+        state.stepInterval = 0;
+        state.easing = cmd.easing;
     }
-    // 2.对于闪烁效果，直接使用步进时间，其他灯效此参数一般为0
+    // 2.对于闪烁效果，步进时间就是亮灭切换的间隔，其他灯效此参数为0
+    else if (state.status == EEffectType::BLINK)
+        state.stepInterval = cmd.time;
     else
-        notifyLED.stepInterval = _stepInterval;
+        state.stepInterval = 0;
 
     /************************************************
                     设置 LED 总时间
     *************************************************/
     // 设定亮度的totalDuration 为 0 表示一直保持
     // 闪动灯的 totalDuration 为0，因为持续时间由闪动次数来决定
-    notifyLED.totalDuration = _totalDuration;
+    state.totalDuration = totalDuration;
 
     /************************************************
                     设置 LED 当前亮度
     *************************************************/
-    // 渐暗效果，当前亮度为最大亮度
-    if (notifyLED.status == EEffectType::FADE_OUT)
-        notifyLED.currentBrightness = _targetBrightness;
+    // 渐暗效果，当前亮度为最大亮度，其他效果从0开始
+    state.currentBrightness = state.status == EEffectType::FADE_OUT ? cmd.brightness : 0;
 
-    // 渐亮效果，当前亮度为0
-    if (notifyLED.status == EEffectType::FADE_IN)
-        notifyLED.currentBrightness = 0;
+    /************************************************
+                    设置 LED 开始时间
+    *************************************************/
+    // 灯效的输出完全由开始时间和当前时间算出
+    state.startTime = start;
 
     /************************************************
                     设置 LED 重复次数
     *************************************************/
     // 闪烁次数处理，乘 2 是因为开和关各算一次
-    notifyLED.repeatCount = _repeatCount * 2;
-    // if (_repeatCount != 1)
-    //     notifyLED.repeatCount = _repeatCount * 2;
-    // else
-    //     notifyLED.repeatCount = _repeatCount;
+    state.repeatCount = cmd.repeatCount * 2;
 
     /************************************************
-                    发送通知给 LED 控制任务
+                    设置 关键帧程序
     *************************************************/
-    if (xTaskGenericNotify(taskHandle, 0, (uint32_t)&notifyLED, eSetValueWithOverwrite, NULL) == pdPASS)
-        return 1;
-    else
-        return 0;
+    // 程序从正在输出的亮度开始
+    if (state.status == EEffectType::PROGRAM)
+    {
+        state.currentBrightness = outputLevel;
+        state.program.begin(cmd.program, state.currentBrightness, state.startTime);
+    }
+
+    return state;
 }
 
-// LED 控制任务的主函数
-void FastDiode::task()
+// LED 控制任务执行一次（每个实例独立任务模式）
+// 在等到下一步的时间或者收到新命令时执行：取出新命令，再按当前时间执行一步
+FastDiodeTime FastDiode::service(void *_this)
 {
-    LEDState LED;
-    bool toggle = false; // 用于闪烁效果的开关切换
+    FastDiode *led = static_cast<FastDiode *>(_this);
+    wakeupCount++;
+    led->process(now(), true);
+    return led->nextTime;
+}
 
-    while (1)
+// 从 level 开始沿 rising 方向，输出占空比发生变化的第一个亮度值
+// 没有变化时返回 LEVEL_MAX 或 0
+uint16_t FastDiode::nextDutyLevel(uint16_t level, bool rising) const
+{
+    if (curve)
     {
-        vTaskDelay(1);
-        // 等待新的控制命令
-        this->waitForNotify(LED);
-
-    START: // 如果在等待期间收到新通知，跳转到这里重新开始处理
-        switch (LED.status)
+        // 逐段反解 toDuty() 的插值：段内占空比为 low + ((high - low) * rest + half) >> shift
+        uint8_t shift = 16 - curve->indexBits;
+        int32_t size = 1 << curve->indexBits;
+        int64_t segment = 1 << shift, half = segment / 2;
+        int64_t duty = toDuty(level);
+        for (int32_t index = level >> shift; index >= 0 && index < size; index += rising ? 1 : -1)
         {
-        case EEffectType::STATIC: // 设置固定亮度
+            int64_t low = curve->data[index];
+            int64_t slope = index + 1 < size ? curve->data[index + 1] - low : 0;
+            int64_t base = (int64_t)index << shift;
+            if (rising)
+            {
+                // 段内第一个占空比大于 duty 的位置：slope * rest + half >= (duty + 1 - low) << shift
+                int64_t need = ((duty + 1 - low) << shift) - half;
+                int64_t rest = need <= 0 ? 0 : (slope > 0 ? (need + slope - 1) / slope : segment);
+                if (rest < segment && base + rest > level)
+                    return base + rest;
+            }
+            else
+            {
+                // 段内最后一个占空比小于 duty 的位置：slope * rest + half < (duty - low) << shift
+                int64_t limit = ((duty - low) << shift) - half;
+                int64_t rest = limit <= 0 ? -1 : (slope > 0 ? (limit + slope - 1) / slope - 1 : segment - 1);
+                rest = rest < segment - 1 ? rest : segment - 1;
+                if (rest >= 0 && base + rest < level)
+                    return base + rest;
+            }
+        }
+        return rising ? LEVEL_MAX : 0;
+    }
+
+    // 线性换算 duty = (level * maxDuty + LEVEL_MAX / 2) / LEVEL_MAX 的反解
+    uint64_t max = maxDuty();
+    uint64_t duty = toDuty(level);
+    if (rising)
+    {
+        if (duty >= max)
+            return LEVEL_MAX;
+        return ((duty + 1) * LEVEL_MAX - LEVEL_MAX / 2 + max - 1) / max;
+    }
+    if (duty == 0)
+        return 0;
+    return (duty * LEVEL_MAX - LEVEL_MAX / 2 - 1) / max;
+}
+
+// 渐变：在 start 开始、持续 duration，从 from 变到 to，时间进度按 easing 缓动
+// 返回 now 时刻的亮度，并把 nextTime 设为输出占空比下一次变化的时间（不早于一个帧间隔，不晚于渐变结束）
+uint16_t FastDiode::ramp(uint16_t from, uint16_t to, FastDiodeTime start, FastDiodeTime duration, FastDiodeTime now, EEasing easing)
+{
+    FastDiodeTime elapsed = now - start;
+    if (elapsed < 0)
+        elapsed = 0;
+    if (elapsed > duration)
+        elapsed = duration;
+
+    int64_t span = (int64_t)to - from;
+    // 经过 t 微秒后离起点的距离
+    auto distanceAt = [&](FastDiodeTime t) -> int64_t {
+        int64_t width = span > 0 ? span : -span;
+        if (easing == EEasing::LINEAR)
+            return width * t / duration;
+        return width * easeQ16(easing, (uint32_t)(t * 65536 / duration), customEasing) >> 16;
+    };
+    uint16_t level = span >= 0 ? from + distanceAt(elapsed) : from - distanceAt(elapsed);
+
+    // 下一个会改变输出的亮度，以及渐变到这个亮度的时间
+    int64_t target = span ? nextDutyLevel(level, span > 0) : to;
+    if ((span > 0 && target > to) || (span < 0 && target < to) || span == 0)
+        target = to;
+    int64_t distance = target > from ? target - from : from - target;
+    int64_t width = span > 0 ? span : -span;
+    if (width == 0)
+        nextTime = start + duration;
+    else if (easing == EEasing::LINEAR)
+        nextTime = start + (distance * duration + width - 1) / width;
+    else
+    {
+        // 缓动曲线单调，二分查找到达 target 的最早时间
+        FastDiodeTime lo = elapsed, hi = duration;
+        while (lo < hi)
         {
-            setBrightnessImpl(LED.targetBrightness);
-            push(LED); // 保存当前状态
-            goto END;
+            FastDiodeTime mid = lo + (hi - lo) / 2;
+            if (distanceAt(mid) >= distance)
+                hi = mid;
+            else
+                lo = mid + 1;
         }
-        break;
+        nextTime = start + lo;
+    }
+
+    FastDiodeTime earliest = now + (FastDiodeTime)FAST_DIODE_FRAME_INTERVAL * 1000;
+    if (nextTime < earliest)
+        nextTime = earliest < start + duration ? earliest : start + duration;
+    return level;
+}
 
-        case EEffectType::BLINK: // 闪烁效果
+// 执行一步所有可见的层并合成输出，所有调度模式共用
+// 最下面一个不透明覆盖层以下的层被盖住，不执行也不复制：灯效由自己的开始时间算出，重新露出来时相位自然是对的
+// 可见的层中只执行到期的，只有某一层的亮度真的变了才重新合成和写入，不变的层没有开销
+// 返回：true - 灯效仍在进行，需要在 nextTime 再次执行
+bool FastDiode::run(FastDiodeTime now)
+{
+#if FAST_DIODE_DEBUG
+    // 上一步计划的时间，被新命令提前唤醒时不算迟到
+    stats.steps++;
+    if (nextTime != TIME_NEVER && now - nextTime > FAST_DIODE_LATE_US)
+        stats.late++;
+    if (nextTime != TIME_NEVER && now - nextTime > stats.maxLateness)
+        stats.maxLateness = now - nextTime;
+#endif
+    if (blendChanged.exchange(false, std::memory_order_acquire))
+    {
+        for (int i = 0; i < EFFECT_PRIORITY_COUNT; i++)
         {
-            // 闪烁次数用完后退出
-            if (LED.repeatCount == 0)
-                pull(LED); // 恢复到上一个状态
+            uint32_t request = blendRequest[i].load(std::memory_order_relaxed);
+            blendMode[i] = static_cast<EBlendMode>(request >> 16);
+            opacity[i] = static_cast<uint16_t>(request);
+        }
+        layersChanged = true;
+    }
 
-            if (LED.repeatCount > 0)
+    bool changed = false, forced = false;
+    uint8_t base, top;
+    FastDiodeTime next;
+    do
+    {
+        // 有层变化时重新执行所有可见的层，某一层结束出栈后在同一时刻从头再来
+        bool refresh = layersChanged;
+        layersChanged = false;
+        forced |= refresh;
+        base = baseLayer();
+        top = topLayer();
+        composited = base != top || blendMode[base] != EBlendMode::OVERRIDE || opacity[base] != LEVEL_MAX;
+        next = TIME_NEVER;
+        for (int level = top; level >= base; level--)
+        {
+            if (!(layerMask >> level & 1))
+                continue;
+            LEDState &LED = layers[level];
+            if (refresh || LED.next <= now || fadeDone)
             {
-                // 如果不是最大计数值，则递减计数
-                if (LED.repeatCount < MAX_COUNT)
-                    LED.repeatCount--;
-                toggle = !toggle;
-                if (toggle)
-                    setBrightnessImpl(0); // 关闭
-                if (!toggle)
-                    setBrightnessImpl(LED.targetBrightness); // 最大亮度
+                uint16_t before = LED.currentBrightness;
+                bool running = step(LED, now);
+                LED.next = running ? nextTime : TIME_NEVER;
+#if FAST_DIODE_DITHER
+                // 抖动时渐变每帧计算一次，占空比不变的区间里平均亮度也在连续变化
+                if (dither && running && LED.status != EEffectType::BLINK &&
+                    LED.next > now + FAST_DIODE_DITHER_INTERVAL * 1000)
+                    LED.next = now + FAST_DIODE_DITHER_INTERVAL * 1000;
+#endif
+                changed |= LED.currentBrightness != before;
+                // 上面的层结束后出栈，背景层保持最后的亮度
+                if (!running && LED.status == EEffectType::NONE && level > 0)
+                {
+                    layerMask &= ~(1u << level);
+                    layersChanged = true;
+                    break;
+                }
             }
+            if (LED.next < next)
+                next = LED.next;
         }
-        break;
+    } while (layersChanged);
 
-        case EEffectType::FADE_IN: // 渐亮效果
+    // 硬件渐变时输出由LEDC负责，只有一层可见，不需要合成
+    bool written = false;
+    if ((changed || forced) && !hwFading)
+    {
+        uint16_t level = 0;
+        for (int i = base; i <= top; i++)
+            if (layerMask >> i & 1)
+                level = blendLevel(blendMode[i], level, layers[i].currentBrightness, opacity[i]);
+        written = forced || level != outputLevel;
+        if (written)
+            setBrightnessImpl(level);
+        outputLevel = level;
+    }
+#if FAST_DIODE_DITHER
+    // 时间抖动：输出落在两个占空比之间时，即使亮度不变也每帧写入一次，由误差累加器交替输出相邻的占空比
+    if (!hwFading && dithering(outputLevel))
+    {
+        if (!written)
         {
-            // 达到目标亮度后结束
-            if (LED.currentBrightness >= LED.targetBrightness)
-            {
-                setBrightnessImpl(LED.targetBrightness);
-                LED.currentBrightness = 0;
-                LED.status = EEffectType::NONE;
-                goto END;
-            }
-            setBrightnessImpl(LED.currentBrightness);
-            LED.currentBrightness++;
+            ditherWakeups++;
+            setBrightnessImpl(outputLevel);
         }
-        break;
+        if (now + FAST_DIODE_DITHER_INTERVAL * 1000 < next)
+            next = now + FAST_DIODE_DITHER_INTERVAL * 1000;
+    }
+#endif
+    nextTime = next;
+    return next != TIME_NEVER || hwFading;
+}
+
+// 执行一层灯效的一步，只算出这一层的亮度（LED.currentBrightness），由 run() 合成后输出
+// 灯效是 (开始时间, 当前时间) 的纯函数：无论唤醒早晚，输出的都是当前时刻应有的亮度，错过的帧直接跳过，误差不会累积
+// 返回：true - 灯效仍在进行，需要在 nextTime 再次执行；false - 灯效已结束
+bool FastDiode::step(LEDState &LED, FastDiodeTime now)
+{
+    nextTime = TIME_NEVER;
 
-        case EEffectType::FADE_OUT: // 渐暗效果
+    // 有限次闪烁结束，不在背景层时由 run() 出栈，回到下面的灯效
+    if (LED.status == EEffectType::BLINK && LED.repeatCount < MAX_COUNT)
+    {
+        FastDiodeTime half = (FastDiodeTime)(LED.stepInterval ? LED.stepInterval : 1) * 1000;
+        if ((now - LED.startTime) / half >= LED.repeatCount)
         {
-            setBrightnessImpl(LED.currentBrightness);
+            LED.status = EEffectType::NONE;
+            return false;
+        }
+    }
+
+    effectWakeups[static_cast<int>(LED.status)]++;
+    FastDiodeTime elapsed = now - LED.startTime;
+
+    switch (LED.status)
+    {
+    case EEffectType::STATIC: // 设置固定亮度
+    {
+        LED.currentBrightness = LED.targetBrightness;
+        return false;
+    }
+    break;
+
+    case EEffectType::BLINK: // 闪烁效果，先灭后亮，每半个周期切换一次
+    {
+        FastDiodeTime half = (FastDiodeTime)(LED.stepInterval ? LED.stepInterval : 1) * 1000;
+        FastDiodeTime index = elapsed / half;
+        LED.currentBrightness = index % 2 ? LED.targetBrightness : 0;
+        nextTime = LED.startTime + (index + 1) * half;
+    }
+    break;
+
+    case EEffectType::FADE_IN:  // 渐亮效果
+    case EEffectType::FADE_OUT: // 渐暗效果
+    {
+        uint16_t from = LED.status == EEffectType::FADE_IN ? 0 : LED.targetBrightness;
+        uint16_t to = LED.status == EEffectType::FADE_IN ? LED.targetBrightness : 0;
+        FastDiodeTime duration = (FastDiodeTime)LED.totalDuration * 1000;
 
-            // 完全熄灭后结束
-            if (LED.currentBrightness < 1)
+        if (elapsed < duration)
+        {
+            LED.currentBrightness = ramp(from, to, LED.startTime, duration, now, LED.easing);
+            // 硬件渐变：剩余的整段交给LEDC，只在开始和结束时各执行一次；硬件只能匀速渐变
+            if (!hwFadeReady() || LED.easing != EEasing::LINEAR)
             {
-                setBrightnessImpl(0);
-                LED.status = EEffectType::NONE;
-                goto END;
+                // 中途不能再使用硬件渐变（例如关闭了硬件渐变），停下正在执行的一段，改由软件继续
+                endHwFade(LED.currentBrightness);
+                break;
             }
-
-            if (LED.currentBrightness > 0)
-                LED.currentBrightness--;
+            if (runHwSegment(LED.currentBrightness, to, duration - elapsed))
+                break;
         }
-        break;
 
-        case EEffectType::BREATHING: // 呼吸灯效果
+        // 到达终点后结束；硬件渐变的结束中断晚于终点时间时，这一段还没有收尾，在这里结束并写入终点
+        endHwFade(to);
+        LED.currentBrightness = to;
+        LED.status = EEffectType::NONE;
+        return false;
+    }
+    break;
+
+    case EEffectType::BREATHING: // 呼吸灯效果，前半周期渐亮，后半周期渐暗
+    {
+        FastDiodeTime duration = (FastDiodeTime)LED.totalDuration * 1000;
+
+        // 硬件渐变时，一段结束后从下一段的起点继续，最多重试一次
+        for (int retry = 0; retry < 2; retry++)
         {
-            push(LED);                                      // 保存状态
-            if (LED.direction == EBreathDirection::FADE_IN) // 亮度上升阶段
+            FastDiodeTime index = elapsed / duration;
+            FastDiodeTime start = LED.startTime + index * duration;
+            bool rising = index % 2 == 0;
+            uint16_t from = rising ? 0 : LED.targetBrightness;
+            uint16_t to = rising ? LED.targetBrightness : 0;
+
+            LED.direction = rising ? EBreathDirection::FADE_IN : EBreathDirection::FADE_OUT;
+            LED.currentBrightness = ramp(from, to, start, duration, now, LED.easing);
+            if (!hwFadeReady() || LED.easing != EEasing::LINEAR)
             {
-                LED.currentBrightness += 1;
-                if (LED.currentBrightness >= LED.targetBrightness)
-                {
-                    LED.direction = EBreathDirection::FADE_OUT; // 切换到下降阶段
-                }
+                endHwFade(LED.currentBrightness);
+                break;
             }
-            else if (LED.direction == EBreathDirection::FADE_OUT) // 亮度下降阶段
-            {
-                static uint8_t down = 0;
-                if (LED.currentBrightness > 0)
-                    LED.currentBrightness--;
+            if (runHwSegment(LED.currentBrightness, to, start + duration - (LED.startTime + elapsed)))
+                break;
+            elapsed = (index + 1) * duration;
+        }
+    }
+    break;
 
-                if (LED.currentBrightness < 1)
-                {
-                    LED.direction = EBreathDirection::FADE_IN; // 切换到上升阶段
-                }
-            }
-            setBrightnessImpl(LED.currentBrightness);
+    case EEffectType::PROGRAM: // 关键帧程序
+    {
+        FastDiodeSegment segment;
+        if (!LED.program.seek(now, segment))
+        {
+            // 程序结束，保持最后的亮度
+            LED.currentBrightness = segment.to;
+            LED.status = EEffectType::NONE;
+            return false;
         }
-        break;
+        LED.currentBrightness = ramp(segment.from, segment.to, segment.start, segment.duration, now, segment.easing);
+    }
+    break;
 
-        default:
-        END:
-            // 暂停任务，等待新的控制命令
-            vTaskSuspend(taskHandle);
-            break;
+    default:
+        // 无灯效，等待新的控制命令
+        return false;
+    }
+    return true;
+}
+
+#if FAST_DIODE_PM
+// 所有实例共用一对锁，esp_pm 锁本身带引用计数，每个需要PWM的实例各持有一次
+static esp_pm_lock_handle_t powerLocks[2];
+
+// LEDC 使用 APB 等会在浅睡眠中停止的时钟时，输出非 0 的占空比需要一直有时钟：
+// 禁止自动浅睡眠并保持 APB 频率；熄灭（或只用普通 GPIO）时释放，灯全灭时系统可以正常睡眠
+// 灯效任务本身只在下一步的时间唤醒，固定亮度时不唤醒，不会妨碍无节拍空闲
+void FastDiode::updatePowerLock(uint32_t duty)
+{
+    bool need = initialized && duty != 0 && !FAST_DIODE_PM_SLEEP_CLOCK;
+    if (need == powerHeld)
+        return;
+    static bool created = [] {
+        ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "FastDiode", &powerLocks[0]));
+        ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "FastDiode", &powerLocks[1]));
+        return true;
+    }();
+    (void)created;
+
+    powerHeld = need;
+    if (need)
+    {
+        esp_pm_lock_acquire(powerLocks[0]);
+        esp_pm_lock_acquire(powerLocks[1]);
+        powerSince = now();
+    }
+    else
+    {
+        esp_pm_lock_release(powerLocks[1]);
+        esp_pm_lock_release(powerLocks[0]);
+        powerTime += now() - powerSince;
+    }
+}
+#endif
+
+// 硬件渐变：把当前这一段剩余的 remaining 微秒交给LEDC，结束时由中断唤醒
+// 返回：true - 这一段正在进行；false - 这一段已经结束（或剩余不足1ms）
+bool FastDiode::runHwSegment(uint16_t from, uint16_t to, FastDiodeTime remaining)
+{
+    if (hwFading)
+    {
+        if (!fadeDone)
+        {
+            nextTime = TIME_NEVER;
+            return true;
         }
+        hwFading = false;
+        fadeDone = false;
+#if FAST_DIODE_PM
+        // 这一段已经停在终点，终点为 0 时释放电源管理锁（输出没有变化，run() 不会再写入）
+        updatePowerLock(toDuty(outputLevel));
+#endif
+        return false;
+    }
+    if (remaining < 1000)
+        return false;
+    startHwFade(from, to, remaining / 1000);
+    return true;
+}
+
+// 结束正在执行的硬件渐变，输出停在 level：只有一层可见时立即写入，多层合成时由 run() 重新合成写入
+void FastDiode::endHwFade(uint16_t level)
+{
+    if (!hwFading)
+        return;
+    stopHwFade();
+    if (!composited)
+    {
+        setBrightnessImpl(level);
+        outputLevel = level;
     }
 }
+
+#if defined(ARDUINO) || defined(FAST_DIODE_HOST)
+bool FastDiode::hwFadeReady() const { return false; }
+void FastDiode::startHwFade(uint16_t, uint16_t, uint32_t) {}
+void FastDiode::stopHwFade() {}
+#else
+// 没有 ledc_fade_stop 的芯片无法在渐变中途切换灯效，只能使用软件渐变
+// 硬件渐变是占空比线性变化，设置了亮度曲线时也只能使用软件渐变
+// 组模式下各成员的占空比需要统一锁存，多层合成时输出不是单一的线性渐变，同样使用软件渐变
+// 时间抖动需要每帧重新写入占空比，也只能使用软件渐变
+bool FastDiode::hwFadeReady() const
+{
+#if SOC_LEDC_SUPPORT_FADE_STOP
+#if FAST_DIODE_DITHER
+    if (dither)
+        return false;
+#endif
+    return initialized && hwFade && !curve && !batched && !composited;
+#else
+    return false;
+#endif
+}
+
+// 从 from 渐变到 to，耗时 time 毫秒，期间任务不再定时唤醒
+void FastDiode::startHwFade(uint16_t from, uint16_t to, uint32_t time)
+{
+    setBrightnessImpl(from);
+#if FAST_DIODE_PM
+    // 渐变期间一直需要LEDC时钟，起点为 0（渐亮、呼吸灯的上升段）时也要持有，到终点后由 runHwSegment() 按终点更新
+    updatePowerLock(toDuty(from) | toDuty(to));
+#endif
+    outputLevel = to; // 渐变结束时的输出
+    fadeDone = false;
+    hwFading = true;
+    nextTime = TIME_NEVER;
+    ledc_set_fade_with_time(ledc.mode, channel, toDuty(to), time);
+    ledc_fade_start(ledc.mode, channel, LEDC_FADE_NO_WAIT);
+}
+
+void FastDiode::stopHwFade()
+{
+    if (!hwFading)
+        return;
+    hwFading = false;
+    fadeDone = false;
+#if SOC_LEDC_SUPPORT_FADE_STOP
+    ledc_fade_stop(ledc.mode, channel);
+#endif
+}
+
+// 硬件渐变结束中断，唤醒对应的任务执行下一段
+bool IRAM_ATTR FastDiode::fadeEndISR(const ledc_cb_param_t *param, void *arg)
+{
+    if (param->event != LEDC_FADE_END_EVT)
+        return false;
+
+    FastDiode *led = static_cast<FastDiode *>(arg);
+    BaseType_t woken = pdFALSE;
+    led->fadeDone = true;
+    if (led->timer.started())
+        led->timer.notifyFromISR(&woken);
+    else
+        FastDiodeEngine::wakeFromISR(&woken);
+    return woken == pdTRUE;
+}
+#endif
@@ -1,6 +1,8 @@
 #pragma once
 
-#ifdef ARDUINO
+#if defined(FAST_DIODE_HOST)
+#include "FastDiodeHost.h"
+#elif defined(ARDUINO)
 #include <Arduino.h>
 #include "hal/ledc_types.h"
 #else
@@ -8,19 +10,88 @@
 #include "string"
 #include "driver/gpio.h"
 #include "driver/ledc.h"
+#include "soc/soc_caps.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-
-const auto LEDC_TIMER = LEDC_TIMER_0;
-const auto LEDC_MODE = LEDC_LOW_SPEED_MODE;
+#include "freertos/event_groups.h"
 
 using String = std::string;
 #endif
 
-#define push(x) saveLED = x
-#define pull(x) x = saveLED
+// 电源管理：输出需要LEDC时钟时持有 esp_pm 锁，禁止自动浅睡眠和降低 APB 频率，熄灭后释放
+// 默认跟随 sdkconfig 的 CONFIG_PM_ENABLE，只在 idf 下有效
+#ifndef FAST_DIODE_PM
+#if defined(CONFIG_PM_ENABLE) && !defined(ARDUINO) && !defined(FAST_DIODE_HOST)
+#define FAST_DIODE_PM 1
+#else
+#define FAST_DIODE_PM 0
+#endif
+#endif
+
+// 为 1 时 LEDC 使用 RC_FAST 时钟并在浅睡眠中保持输出，任何亮度都不需要持有电源管理锁
+// RC_FAST 时钟频率较低（约 8~20MHz），频率 × 2^分辨率 不能超过它
+#ifndef FAST_DIODE_PM_SLEEP_CLOCK
+#define FAST_DIODE_PM_SLEEP_CLOCK 0
+#endif
+
+#if FAST_DIODE_PM
+#include "esp_pm.h"
+#endif
+
+#include "FastDiodeCommand.h"
+#include "FastDiodeCurve.h"
+#include "FastDiodeEasing.h"
+#ifndef ARDUINO
+#include "FastDiodeLedc.h"
+#endif
+#include "FastDiodeProgram.h"
+#include "FastDiodeSoftPwm.h"
+#include "FastDiodeStore.h"
+#include "FastDiodeTimer.h"
+#include "FastDiodeTrace.h"
+
 #define MAX_COUNT 0xffffffff / 2
 
+// 内部亮度统一使用16位定点数（Q16），0 为熄灭，LEVEL_MAX 为最亮，输出时再换算成实际的占空比分辨率
+const uint16_t LEVEL_MAX = 0xffff;
+
+// 渐变/呼吸灯的最小帧间隔(ms)，只在输出占空比真正变化时唤醒，且两次唤醒至少间隔这么久
+#ifndef FAST_DIODE_FRAME_INTERVAL
+#define FAST_DIODE_FRAME_INTERVAL 1
+#endif
+
+// 时间抖动：输出亮度落在两个相邻占空比之间时，灯效任务每隔 FAST_DIODE_DITHER_INTERVAL 毫秒重新写入一次，
+// 用误差累加器交替输出这两个占空比，平均值在占空比分辨率之下再多出 8 位，8 位分辨率下低亮度渐变也不再一级一级跳
+// 为 1 时编译抖动代码，每个实例再用 useDithering() 打开；为 0（默认）时没有任何开销
+#ifndef FAST_DIODE_DITHER
+#define FAST_DIODE_DITHER 0
+#endif
+
+// 抖动的帧间隔(ms)，越短闪烁越不明显，CPU 唤醒越多；TICK 时钟下会按 tick 向上取整
+#ifndef FAST_DIODE_DITHER_INTERVAL
+#define FAST_DIODE_DITHER_INTERVAL 1
+#endif
+
+// 定义 FAST_DIODE_WRITE_HOOK 时，每次写入占空比后调用 fastDiodeWriteHook()，由应用实现
+// 性能测试用它测量命令到输出的延迟，默认不定义，没有任何开销
+#ifdef FAST_DIODE_WRITE_HOOK
+void fastDiodeWriteHook(uint8_t pin, uint32_t duty);
+#endif
+
+// 实例名的最大长度（含结尾的 0），超出部分被截断，不使用 String 以免构造时分配内存
+#ifndef FAST_DIODE_NAME_SIZE
+#define FAST_DIODE_NAME_SIZE 16
+#endif
+
+// 0~255 的亮度换算成16位亮度
+constexpr uint16_t toLevel(uint8_t brightness) { return brightness * 257; }
+
+// 为 1 时，新建的实例默认注册到共享调度任务，而不是各自创建一个任务
+// 运行时也可以通过 FastDiode::useSharedEngine() 切换
+#ifndef FAST_DIODE_SHARED_ENGINE
+#define FAST_DIODE_SHARED_ENGINE 0
+#endif
+
 // LED通道枚举，用于LEDC控制
 using ELEDChannel = ledc_channel_t;
 
@@ -39,8 +110,10 @@ enum class EEffectType
   BLINK,    // 闪烁
   FADE_IN,  // 渐亮
   FADE_OUT, // 渐暗
-  BREATHING // 呼吸灯
+  BREATHING, // 呼吸灯
+  PROGRAM    // 关键帧程序
 };
+const int EFFECT_TYPE_COUNT = static_cast<int>(EEffectType::PROGRAM) + 1;
 
 // 呼吸灯方向枚举
 enum class EBreathDirection
@@ -49,219 +122,791 @@ enum class EBreathDirection
   FADE_OUT = true  // 渐暗
 };
 
+// 灯效优先级，每个优先级一层：高优先级的灯效暂时盖住低优先级的，结束后下面的灯效按原来的相位继续
+enum class EEffectPriority : uint8_t
+{
+  BACKGROUND = 0, // 背景：固定亮度、渐变、呼吸灯等持续的灯效
+  STATUS,         // 状态提示：有限次闪烁默认在这一层
+  ALERT           // 告警：盖住所有其他灯效
+};
+const int EFFECT_PRIORITY_COUNT = static_cast<int>(EEffectPriority::ALERT) + 1;
+
+// 灯效层的混合方式，决定这一层和下面各层的结果怎样合成输出亮度
+enum class EBlendMode : uint8_t
+{
+  OVERRIDE = 0, // 覆盖：不透明时完全盖住下面的层，下面的层暂停执行（默认）
+  MAX,          // 取较亮的一个
+  ADD,          // 相加，超过最大亮度时截断
+  MULTIPLY      // 相乘，例如作为全局调光
+};
+
+// 把 level 按 mode 混合到 below 上，opacity 为这一层的不透明度，全部为16位定点数
+inline uint16_t blendLevel(EBlendMode mode, uint16_t below, uint16_t level, uint16_t opacity)
+{
+  uint32_t mixed;
+  switch (mode)
+  {
+  case EBlendMode::MAX:
+    mixed = below > level ? below : level;
+    break;
+  case EBlendMode::ADD:
+    mixed = (uint32_t)below + level > LEVEL_MAX ? LEVEL_MAX : below + level;
+    break;
+  case EBlendMode::MULTIPLY:
+    mixed = ((uint32_t)below * level + LEVEL_MAX / 2) / LEVEL_MAX;
+    break;
+  default:
+    mixed = level;
+    break;
+  }
+  return below + ((int64_t)mixed - below) * opacity / LEVEL_MAX;
+}
+
 struct LEDState
 {
   EEffectType status = EEffectType::NONE;                 // 灯效
-  uint32_t totalDuration;                                 // 灯效总时长,比如在多少时间逐步变亮 / 暗,或者是呼吸灯一次的时间，在开关设定亮度，闪灯等瞬态的事件中，一般为0
-  uint32_t stepInterval;                                  // 步进时间 每个步骤之间的时间间隔，也就是呼吸灯每一步亮度持续的事件，同时这个值也用于任务通知等待事件，如果接收到通知，则进入下一个状态，避免在呼吸灯等持续事件中，没办法及时切换灯效
-  uint32_t repeatCount;                                   // 重复次数主要用于约束闪动次数，闪动次数为0时，则会结束当前灯效，回到上个灯效e，如果闪动次数不指定，则无限闪动
-  uint8_t currentBrightness;                              // 当前亮度值
-  uint16_t stepping;                                      // 渐进量，在渐变，呼吸灯等灯效中，表示每一步的亮度变化量
+  uint32_t totalDuration;                                 // 灯效总时长(ms),比如在多少时间逐步变亮 / 暗,或者是呼吸灯半个周期的时间，在开关设定亮度，闪灯等瞬态的事件中，一般为0
+  uint32_t stepInterval;                                  // 步进时间(ms) 闪灯亮灭切换的间隔，其他灯效为0
+  uint32_t repeatCount;                                   // 重复次数主要用于约束闪动次数，亮灭各算一次，用完后回到上个灯效，如果闪动次数不指定，则无限闪动
+  uint16_t currentBrightness;                             // 最近一次输出的亮度值（16位）
   EBreathDirection direction = EBreathDirection::FADE_IN; // false 呼吸灯上升沿.   ture下降沿
-  uint8_t targetBrightness;                               // 目标亮度
+  uint16_t targetBrightness;                              // 目标亮度（16位）
+  FastDiodeTime startTime;                                // 灯效开始时间(us)，亮度由开始时间和当前时间算出
+  FastDiodeProgramState program;                          // 关键帧程序的执行位置
+  FastDiodeTime next = TIME_NEVER;                        // 这一层下一步的时间，TIME_NEVER 表示亮度不再变化
+  EEasing easing = EEasing::LINEAR;                       // 渐变/呼吸灯的缓动曲线
+};
+
+// 灯效函数，FastDiode、FastDiodeLayer 和 FastDiodeGroup 共用
+// Target 需要提供 sendNotify(灯效, 亮度, 步进时间, 总时间, 重复次数, 程序, 缓动曲线) 和 sendSwitch(开/关)
+template <typename Target>
+class FastDiodeEffects
+{
+public:
+  /// @brief 开灯
+  void open() { target().sendSwitch(true); }
+  /// @brief 关灯
+  void close() { target().sendSwitch(false); }
+
+  /// @brief 设定亮度 0~255
+  void setBrightness(uint8_t brightness) { setBrightness16(toLevel(brightness)); }
+
+  /// @brief  闪灯
+  /// @param time 时间间隔
+  /// @param repeatCount 闪动次数
+  /// @param brightness 闪动亮度
+  void flickering(uint32_t time, uint32_t repeatCount = MAX_COUNT, uint8_t brightness = 255)
+  {
+    flickering16(time, repeatCount, toLevel(brightness));
+  }
+
+  /// @brief 逐渐变亮
+  /// @param time 时间
+  /// @param brightness 最终亮度
+  /// @param easing 缓动曲线，默认匀速
+  void fodeOn(uint32_t time, uint8_t brightness = 255, EEasing easing = EEasing::LINEAR)
+  {
+    fodeOn16(time, toLevel(brightness), easing);
+  }
+
+  /// @brief 逐渐变暗
+  /// @param time 时间
+  /// @param brightness 开始亮度
+  /// @param easing 缓动曲线，默认匀速
+  void fodeOff(uint32_t time, uint8_t brightness = 255, EEasing easing = EEasing::LINEAR)
+  {
+    fodeOff16(time, toLevel(brightness), easing);
+  }
+
+  /// @brief 呼吸灯
+  /// @param time 时间
+  /// @param brightness 亮度
+  /// @param easing 缓动曲线，渐亮和渐暗各用一次，默认匀速（三角波）
+  void breathing(uint32_t time, uint8_t brightness = 255, EEasing easing = EEasing::LINEAR)
+  {
+    breathing16(time, toLevel(brightness), easing);
+  }
+
+  // 16位亮度接口，亮度范围 0~65535，按 init() 设定的分辨率输出，分辨率越高低亮度越平滑
+
+  /// @brief 设定亮度 0~65535
+  void setBrightness16(uint16_t level)
+  {
+    target().sendNotify(EEffectType::STATIC, // 固定亮度
+                        level,               // 亮度
+                        0,                   // 步进时间:无，直接设定
+                        0,                   // 总时间:无，一直保持
+                        0,                   // 重复次数:无，一直保持
+                        nullptr,
+                        EEasing::LINEAR);
+  }
+
+  /// @brief  闪灯
+  /// @param time 时间间隔
+  /// @param repeatCount 闪动次数
+  /// @param level 闪动亮度 0~65535
+  void flickering16(uint32_t time, uint32_t repeatCount = MAX_COUNT, uint16_t level = LEVEL_MAX)
+  {
+    target().sendNotify(EEffectType::BLINK, // 闪烁
+                        level,              // 闪动亮度
+                        time,               // 步进时间:闪烁时间间隔
+                        0,                  // 总时间:无，一直保持
+                        repeatCount,        // 重复次数，默认MAX_COUNT无限闪动
+                        nullptr,
+                        EEasing::LINEAR);
+  }
+
+  /// @brief 逐渐变亮
+  /// @param time 时间
+  /// @param level 最终亮度 0~65535
+  /// @param easing 缓动曲线
+  void fodeOn16(uint32_t time, uint16_t level = LEVEL_MAX, EEasing easing = EEasing::LINEAR)
+  {
+    target().sendNotify(EEffectType::FADE_IN, // 逐渐变亮
+                        level,                // 最终亮度，默认最亮
+                        0,                    // 步进时间:无，由总时间和亮度范围计算得到
+                        time,                 // 总时间：经过多久到达最终亮度
+                        0,                    // 重复次数:无，一直保持
+                        nullptr,
+                        easing);              // 缓动曲线
+  }
+
+  /// @brief 逐渐变暗
+  /// @param time 时间
+  /// @param level 开始亮度 0~65535
+  /// @param easing 缓动曲线
+  void fodeOff16(uint32_t time, uint16_t level = LEVEL_MAX, EEasing easing = EEasing::LINEAR)
+  {
+    target().sendNotify(EEffectType::FADE_OUT, // 逐渐变暗
+                        level,                 // 开始亮度，默认最亮
+                        0,                     // 步进时间:无，由总时间和亮度范围计算得到
+                        time,                  // 总时间：经过多久到达最终亮度
+                        0,                     // 重复次数:无，一直保持
+                        nullptr,
+                        easing);               // 缓动曲线
+  }
+
+  /// @brief 呼吸灯
+  /// @param time 时间
+  /// @param level 亮度 0~65535
+  /// @param easing 缓动曲线
+  void breathing16(uint32_t time, uint16_t level = LEVEL_MAX, EEasing easing = EEasing::LINEAR)
+  {
+    target().sendNotify(EEffectType::BREATHING, // 呼吸灯
+                        level,                  // 亮度
+                        0,                      // 步进时间:无，由总时间和亮度范围计算得到
+                        time,                   // 总时间：呼吸灯一次的时间
+                        0,                      // 重复次数:无，一直保持
+                        nullptr,
+                        easing);                // 缓动曲线
+  }
+
+  /// @brief 播放关键帧程序，从当前亮度开始
+  /// @param program 由 makeProgram() 编译的程序，或者按 FastDiodeProgram.h 中格式手写的字节数组，必须一直有效
+  void play(const uint8_t *program)
+  {
+    target().sendNotify(EEffectType::PROGRAM, // 关键帧程序
+                        0,                    // 亮度:由程序决定
+                        0,                    // 步进时间:由程序决定
+                        0,                    // 总时间:由程序决定
+                        0,                    // 重复次数:由程序中的循环决定
+                        program,
+                        EEasing::LINEAR);
+  }
+  template <size_t N>
+  void play(const FastDiodeProgram<N> &program) { play(program.bytes); }
+
+protected:
+  // 没有指定优先级时：有限次闪烁是临时提示，放在状态层，结束后回到背景灯效；其他灯效放在背景层
+  static EEffectPriority defaultPriority(EEffectType status, uint32_t repeatCount)
+  {
+    return status == EEffectType::BLINK && repeatCount < MAX_COUNT ? EEffectPriority::STATUS : EEffectPriority::BACKGROUND;
+  }
+
+private:
+  Target &target() { return *static_cast<Target *>(this); }
 };
 
-class FastDiode
+class FastDiodeLayer;
+class FastDiode;
+
+// 灯效完成回调，在灯效任务中调用，应尽快返回，不要阻塞
+typedef void (*FastDiodeDoneCallback)(FastDiode &led, void *arg);
+class FastDiodeISR;
+
+class FastDiode : public FastDiodeEffects<FastDiode>
 {
+  friend class FastDiodeEngine;
+  friend class FastDiodeGroup;
+  friend class FastDiodeLayer;
+  friend class FastDiodeISR;
+  friend class FastDiodeEffects<FastDiode>;
+
 private:
   uint8_t pin;                                  // 引脚
   ELEDChannel channel;                          // 通道
-  TaskHandle_t taskHandle = NULL;               // 任务句柄
-  LEDState notifyLED;                           // 用于发送状态的缓存
-  LEDState saveLED;                             // 用于存储 前一个状态的缓存
-  String name;                                  // LED灯标记名
+#ifndef ARDUINO
+  FastDiodeLedcSlot ledc;                       // 分配到的 LEDC 速度模式、定时器和通道
+  ELedcError ledcError = ELedcError::NONE;      // 最近一次 init() 的结果
+#endif
+  FastDiodeTimer timer;                         // 独立任务模式下的任务，共享调度模式下不创建
+  FastDiodeChannel<> commands;                  // 命令通道，API 从任意任务写入，灯效任务取出
+  LEDState layers[EFFECT_PRIORITY_COUNT];       // 每个优先级一层灯效，只执行最高的一层
+  uint8_t layerMask = 1;                        // 哪些层有灯效，背景层一直存在
+  bool layersChanged = true;                    // 有层入栈/出栈，下一步需要重新执行所有可见的层
+  EBlendMode blendMode[EFFECT_PRIORITY_COUNT] = {}; // 每层的混合方式，由灯效任务使用
+  uint16_t opacity[EFFECT_PRIORITY_COUNT] = {LEVEL_MAX, LEVEL_MAX, LEVEL_MAX}; // 每层的不透明度
+  std::atomic<uint32_t> blendRequest[EFFECT_PRIORITY_COUNT]; // API 设置的混合方式，bit23~16 方式，bit15~0 不透明度
+  std::atomic<bool> blendChanged{false};        // 混合方式有变化，等灯效任务取走
+  std::atomic<uint32_t> access{ACCESS_RUNNING}; // 访问状态字，见 ACCESS_*，构造时的第一条命令由灯效任务执行
+  bool composited = false;                      // 输出由多层合成，不能使用硬件渐变
+  uint16_t outputLevel = 0;                     // 合成后正在输出的亮度
+  char name[FAST_DIODE_NAME_SIZE];              // LED灯标记名，也是任务名
   EPinPolarity edge = EPinPolarity::ACTIVE_LOW; // 引脚极性
   bool initialized = false;                     // 是否已初始化，如果调用初始化，就使用LEDC
+  int8_t softChannel = -1;                      // 软件PWM通道，调用 initSoftPwm() 后有效
+  uint8_t resolution = 8;                       // LEDC占空比分辨率（位）
+  const FastDiodeCurveTable *curve = nullptr;   // 亮度曲线查找表，为空时线性输出
+  const FastDiodeEasingTable *customEasing = nullptr; // EEasing::CUSTOM 使用的缓动查找表
+  FastDiodeTime nextTime = TIME_NEVER;          // 下一步的时间，由 step() 设置
+  bool hwFade = true;                           // LEDC模式下渐变/呼吸灯是否交给硬件渐变单元
+  bool hwFading = false;                        // 硬件渐变单元正在执行一段渐变
+  volatile bool fadeDone = false;               // 硬件渐变结束（共享调度模式下由中断置位）
+  uint32_t effectWakeups[EFFECT_TYPE_COUNT] = {}; // 每种灯效执行的步数（即CPU被唤醒的次数）
+#if FAST_DIODE_DEBUG
+  FastDiodeTime effectAwake[EFFECT_TYPE_COUNT] = {}; // 每种灯效占用CPU的时间(us)
+#endif
+#if FAST_DIODE_PM
+  bool powerHeld = false;                       // 输出需要LEDC时钟，持有电源管理锁
+  FastDiodeTime powerSince = 0;                 // 这次持有锁的开始时间
+  FastDiodeTime powerTime = 0;                  // 累计持有锁的时间(us)
+  // 按写入的占空比获取或释放电源管理锁
+  void updatePowerLock(uint32_t duty);
+#endif
+  bool batched = false;                         // 由 FastDiodeGroup 驱动，占空比先写入，由组统一锁存
+  bool dutyDirty = false;                       // 写入了新占空比，等待锁存
+  uint32_t lastDuty = UINT32_MAX;               // 最近写入的占空比，只在组模式下使用
+#if FAST_DIODE_DITHER
+  bool dither = false;                          // 是否打开时间抖动
+  uint8_t ditherError = 0;                      // 误差累加器：还没有输出的占空比小数部分（1/256）
+  uint32_t ditherDuty = UINT32_MAX;             // 抖动时最近写入的占空比，相同时不再写入
+  uint32_t ditherWakeups = 0;                   // 只为抖动执行的步数
+#endif
+#if FAST_DIODE_DEBUG
+  FastDiodeStats stats;                         // 调试计数器
+#endif
+#if FAST_DIODE_PERSIST
+  int8_t persistSlot = -1;                      // 断电记忆的槽位，-1 表示不保存
+#endif
+
+  // 对外发布的状态：灯效任务（或直接写入的调用者）写入，任何任务无锁读取
+  std::atomic<uint32_t> published{0};           // 状态字，见 STATE_*
+  bool finiteShown = false;                     // 上次发布时是否有有限的灯效在进行，由灯效任务使用
+  std::atomic<FastDiodeDoneCallback> doneCallback{nullptr}; // 完成回调
+  void *doneArg = nullptr;                      // 完成回调的参数
+#if !defined(FAST_DIODE_HOST)
+  std::atomic<EventGroupHandle_t> doneGroup{nullptr}; // 完成时设置的应用事件组
+  EventBits_t doneBits = 0;                     // 完成时设置的位
+  std::atomic<EventGroupHandle_t> waitGroup{nullptr}; // waitDone() 使用的事件组，第一次等待时创建
+  std::atomic<uint8_t> waitGroupState{0};       // 0 未创建，1 正在创建，2 已创建
+  bool waitGroupDone = false;                   // waitGroup 中完成位的当前值，由灯效任务使用
+#if FAST_DIODE_STATIC
+  StaticEventGroup_t waitGroupBuffer;           // 静态内存模式下事件组的存储
+#endif
+#endif
+
+  // 共享调度模式下由 FastDiodeEngine 维护的字段
+  FastDiode *engineNext = nullptr; // 已注册实例链表
+  FastDiode *activeNext = nullptr; // 按截止时间排序的活动实例链表
+  FastDiodeTime deadline = 0;      // 下一步的截止时间
+  bool active = false;             // 是否在活动链表中
+  std::atomic<bool> pending{false}; // 命令通道中是否有新命令，调度任务用 exchange() 取走
+
+  static bool sharedEngine;                // 新建实例是否使用共享调度任务
+#if FAST_DIODE_PERSIST
+  static bool persistence;                 // 新建实例是否保存和恢复状态
+#endif
+  static volatile uint32_t wakeupCount;    // 所有灯效任务被唤醒的总次数
 
-  // 处理任务
-  void task();
-  // 等待通知，用来取代vTaskDelay , 这样在延时的过程中, 只要接收到数据就能跳出延时
-  bool waitForNotify(LEDState &led);
+  // 独立任务模式下执行一次：取出新命令并执行一步，返回下一步的时间
+  static FastDiodeTime service(void *_this);
+  // 访问状态字：调用者的直接写入和灯效任务通过它互斥
+  // 只有在没有未取走的命令、没有正在执行的灯效时，调用者才能直接写入固定亮度
+  static const uint32_t ACCESS_DIRECT = 1;  // 调用者正在直接写入
+  static const uint32_t ACCESS_RUNNING = 2; // 灯效任务正在执行，或者有灯效在进行
+  static const uint32_t ACCESS_PENDING = 4; // 每条未取走的命令加一次
+  // 状态字：bit15~0 输出亮度，bit19~16 最上面一层的灯效，以及下面两个标记
+  static const uint32_t STATE_EFFECT_SHIFT = 16;
+  static const uint32_t STATE_BUSY = 1u << 20;   // 亮度还会变化，需要定时唤醒
+  static const uint32_t STATE_FINITE = 1u << 21; // 有会自行结束的灯效（渐变、有限次闪烁、关键帧程序）在进行
+
+  // 直接写入固定亮度，不经过灯效任务，返回 false 表示当前不空闲，需要走命令通道
+  bool writeDirect(uint16_t level);
+  // 灯效任务执行一次：占用实例，take 为 true 时取出新命令，执行一步，空闲时释放；调用者正在直接写入时什么也不做，返回 false
+  bool process(FastDiodeTime now, bool take);
+  // 执行所有可见层中到期的一步，合成后输出；上面的层结束后出栈，返回 false 表示不需要再定时唤醒
+  bool run(FastDiodeTime now);
+  // 最下面一个可见的层：从最高层往下，第一个不透明的覆盖层
+  uint8_t baseLayer() const;
+  // 设置某一层的混合方式，任何任务都可以调用
+  void setBlend(EEffectPriority priority, EBlendMode mode, uint16_t level);
+  // 唤醒灯效任务，woken 非空时在中断中调用
+  bool wake(BaseType_t *woken = nullptr);
+  // 执行一步灯效，返回 false 表示灯效已结束，不需要再定时唤醒
+  bool step(LEDState &LED, FastDiodeTime now);
+  // 渐变在 now 时刻的亮度，同时计算输出下一次变化的时间
+  uint16_t ramp(uint16_t from, uint16_t to, FastDiodeTime start, FastDiodeTime duration, FastDiodeTime now,
+                EEasing easing = EEasing::LINEAR);
+  // 输出占空比发生变化的下一个亮度值
+  uint16_t nextDutyLevel(uint16_t level, bool rising) const;
+  // 把一段渐变的剩余部分交给硬件
+  bool runHwSegment(uint16_t from, uint16_t to, FastDiodeTime remaining);
+
+  // 是否可以使用硬件渐变，只有 idf 下调用过 init() 才可以
+  bool hwFadeReady() const;
+  // 启动一段硬件渐变，结束时由中断唤醒
+  void startHwFade(uint16_t from, uint16_t to, uint32_t time);
+  // 停止正在执行的硬件渐变
+  void stopHwFade();
+  // 结束正在执行的硬件渐变并写入 level，用于中断晚于终点时间、或中途不能再使用硬件渐变时
+  void endHwFade(uint16_t level);
+#if !defined(ARDUINO) && !defined(FAST_DIODE_HOST)
+  // 硬件渐变结束中断回调
+  static bool fadeEndISR(const ledc_cb_param_t *param, void *arg);
+#endif
+#ifndef ARDUINO
+  // 分配 LEDC 资源并配置通道，fixed 为 true 时使用指定的通道；原来的通道和软件PWM先释放
+  bool attachLedc(bool fixed, ELEDChannel _channel, uint32_t freq, uint8_t _resolution);
+  // 释放 LEDC 通道，回到GPIO模式
+  void detachLedc();
+#endif
+  // 取出命令通道中的新命令
+  bool takeCommands();
+  // 按当前的灯效层生成状态字，busy 为亮度是否还会变化
+  uint32_t stateWord(bool busy) const;
+  // 发布状态字；有限的灯效全部结束时调用完成回调、设置事件组，有人在 waitDone() 中等待时唤醒它
+  void publishState(bool busy);
+  // 没有未取走的命令，也没有有限的灯效在进行
+  // 状态字读两次：前一次与 publishState() 中检查等待者的顺序配对，后一次保证看到刚取走的命令的灯效
+  bool isDone() const
+  {
+    uint32_t before = published.load();
+    bool pending = access.load(std::memory_order_acquire) >= ACCESS_PENDING;
+    return !pending && !((before | published.load()) & STATE_FINITE);
+  }
+  // 最高的一层
+  uint8_t topLayer() const { return 31 - __builtin_clz(layerMask); }
+  // 把灯效放到 priority 层，NONE 让这一层出栈
+  void setLayer(EEffectPriority priority, const LEDState &state);
+#if FAST_DIODE_PERSIST
+  // 构造时恢复保存的灯效，没有保存过时熄灭
+  void restore();
+  // 把背景层的灯效交给断电记忆，临时的灯效不保存
+  void persist();
+#endif
+  // 把命令解析成灯效状态，start 为灯效开始时间
+  LEDState decode(const FastDiodeCommand &cmd, FastDiodeTime start);
   // 发送通知
   bool sendNotify(EEffectType _status,       // 灯效
-                  uint8_t _targetBrightness, // 目标亮度
+                  uint16_t _targetBrightness, // 目标亮度（16位）
                   uint32_t _stepInterval,    // 步进时间
                   uint32_t _totalDuration,   // 总时间
-                  uint32_t _repeatCount);    // 重复次数
-  // 启动任务
-  static void startTaskImpl(void *_this) { static_cast<FastDiode *>(_this)->task(); }
+                  uint32_t _repeatCount,     // 重复次数
+                  const uint8_t *_program,   // 关键帧程序
+                  EEasing _easing,           // 渐变/呼吸灯的缓动曲线
+                  EEffectPriority _priority, // 优先级
+                  BaseType_t *_woken = nullptr); // 非空时在中断中调用
+  bool sendNotify(EEffectType _status, uint16_t _targetBrightness, uint32_t _stepInterval, uint32_t _totalDuration,
+                  uint32_t _repeatCount, const uint8_t *_program, EEasing _easing)
+  {
+    return sendNotify(_status, _targetBrightness, _stepInterval, _totalDuration, _repeatCount, _program, _easing,
+                      defaultPriority(_status, _repeatCount));
+  }
+  // 开关灯对应的亮度：低电平有效的LED开灯为 LEVEL_MAX，高电平有效的相反
+  uint16_t switchLevel(bool on) const { return on == (edge == EPinPolarity::ACTIVE_LOW) ? LEVEL_MAX : 0; }
+  void sendSwitch(bool on) { sendNotify(EEffectType::STATIC, switchLevel(on), 0, 0, 0, nullptr, EEasing::LINEAR); }
+
+  // 输出端实际可分辨的最大占空比
+  uint32_t maxDuty() const
+  {
+#ifdef ARDUINO
+    return initialized ? (1u << resolution) - 1 : 255;
+#else
+    return initialized || softChannel >= 0 ? (1u << resolution) - 1 : 1;
+#endif
+  }
+  // 16位亮度换算成占空比，否则线性换算（四舍五入）
+  // 设置了亮度曲线时查表，并在相邻两项之间线性插值（四舍五入）：表长最多 1024 项，10位以上的分辨率靠插值输出全部的占空比
+  uint32_t toDuty(uint16_t level) const
+  {
+    if (curve)
+    {
+      uint8_t shift = 16 - curve->indexBits;
+      uint32_t index = level >> shift;
+      int32_t low = curve->data[index];
+      int32_t high = index + 1 < (1u << curve->indexBits) ? curve->data[index + 1] : low;
+      int32_t rest = level & ((1u << shift) - 1);
+      return low + (((high - low) * rest + (1 << (shift - 1))) >> shift);
+    }
+    return ((uint64_t)level * maxDuty() + LEVEL_MAX / 2) / LEVEL_MAX;
+  }
+#if FAST_DIODE_DITHER
+  // 16位亮度换算成带 8 位小数的占空比，设置了亮度曲线时在相邻两项之间线性插值
+  uint32_t toFineDuty(uint16_t level) const
+  {
+    if (curve)
+    {
+      uint8_t shift = 16 - curve->indexBits;
+      uint32_t index = level >> shift;
+      int32_t low = curve->data[index];
+      int32_t high = index + 1 < (1u << curve->indexBits) ? curve->data[index + 1] : low;
+      int32_t rest = level & ((1u << shift) - 1);
+      return (low << 8) + (((high - low) * rest * 256) >> shift);
+    }
+    return ((uint64_t)level * maxDuty() * 256 + LEVEL_MAX / 2) / LEVEL_MAX;
+  }
+  // level 是否需要抖动：打开了抖动，输出有PWM，且 level 落在两个占空比之间
+  bool dithering(uint16_t level) const { return dither && maxDuty() > 1 && (toFineDuty(level) & 0xff); }
+#endif
 
   // 设置亮度 ,在这边判断initialized，如果initialized为true，则使用LEDC，否则使用analogWrite
   // arduino里应该都是ledc实现
   // idf中如果未使用ledc初始化，只实现高低电平。
-  void setBrightnessImpl(uint8_t brightness)
+  void setBrightnessImpl(uint16_t level)
   {
-#ifdef ARDUINO
+    uint32_t duty = toDuty(level);
+#if FAST_DIODE_DITHER
+    if (dither && maxDuty() > 1) {
+        // 一阶 delta-sigma：加上上次留下的小数部分，输出整数部分，小数部分留给下一帧
+        uint32_t fine = toFineDuty(level) + ditherError;
+        duty = fine >> 8;
+        ditherError = fine & 0xff;
+        if (duty == ditherDuty)
+            return;
+        ditherDuty = duty;
+    }
+#endif
+#if defined(FAST_DIODE_HOST)
+    if (initialized && batched && duty == lastDuty)
+      return;
+    lastDuty = duty;
+    if (softChannel >= 0)
+      FastDiodeSoftPwm::write(softChannel, duty, maxDuty());
+    FastDiodeHost::write(pin, initialized ? channel : -1, duty);
+#elif defined(ARDUINO)
     if (initialized)
-      ledcWrite(channel, brightness);
+      ledcWrite(channel, duty);
     else
-      analogWrite(pin, brightness);
+      analogWrite(pin, duty);
 #else
-    if (initialized) {
-        ledc_set_duty(LEDC_MODE, channel, brightness);
-        ledc_update_duty(LEDC_MODE, channel);
+    if (initialized && batched) {
+        // 组模式：只在占空比变化时写入，由组在一帧结束时统一锁存
+        if (duty != lastDuty) {
+            ledc_set_duty(ledc.mode, channel, duty);
+            lastDuty = duty;
+            dutyDirty = true;
+        }
+    } else if (initialized) {
+        stopHwFade();
+        ledc_set_duty(ledc.mode, channel, duty);
+        ledc_update_duty(ledc.mode, channel);
+    } else if (softChannel >= 0) {
+        FastDiodeSoftPwm::write(softChannel, duty, maxDuty());
     } else {
-        if (brightness) {
+        if (duty) {
             gpio_set_level(static_cast<gpio_num_t>(pin), 1);
         } else {
             gpio_set_level(static_cast<gpio_num_t>(pin), 0);
         }
     }
+#endif
+#if FAST_DIODE_PM
+    updatePowerLock(duty);
+#endif
+#ifdef FAST_DIODE_WRITE_HOOK
+    fastDiodeWriteHook(pin, duty);
+#endif
+#if FAST_DIODE_DEBUG
+    FastDiodeTrace::record(now(), pin, static_cast<uint8_t>(layers[topLayer()].status), duty);
 #endif
   }
 
-public:
-  FastDiode(uint8_t _pin, EPinPolarity _edge = EPinPolarity::ACTIVE_HIGH, String _name = " ")
+  // 锁存组模式下写入的占空比，在下一个PWM周期生效
+  void latch()
   {
-    pin = _pin;
-    edge = _edge;
-    name = _name;
-#ifdef ARDUINO
-    pinMode(pin, OUTPUT);
-#else
-      const gpio_config_t config = {
-          .pin_bit_mask = static_cast<uint64_t>(1 << pin),
-          .mode = GPIO_MODE_OUTPUT,
-          .pull_up_en = GPIO_PULLUP_DISABLE,
-          .pull_down_en = GPIO_PULLDOWN_DISABLE,
-          .intr_type = GPIO_INTR_DISABLE
-      };
-      ESP_ERROR_CHECK(gpio_config(&config));
-#endif
-    xTaskCreate(this->startTaskImpl, _name.c_str(), 1024 * 2, this, 1, &taskHandle);
-    sendNotify(EEffectType::STATIC, 0, 0, 0, 0);
+#if !defined(ARDUINO) && !defined(FAST_DIODE_HOST)
+    if (dutyDirty)
+      ledc_update_duty(ledc.mode, channel);
+#endif
+    dutyDirty = false;
   }
 
-  /// @brief 初始化
-  /// @param channel 通道
+public:
+  FastDiode(uint8_t _pin, EPinPolarity _edge = EPinPolarity::ACTIVE_HIGH, const char *_name = " ");
+  ~FastDiode();
+
+  /// @brief 选择之后新建的实例是否使用共享调度任务
+  /// @param enable true: 所有实例由一个调度任务按截止时间统一驱动; false: 每个实例一个任务
+  static void useSharedEngine(bool enable) { sharedEngine = enable; }
+
+#if FAST_DIODE_PERSIST
+  /// @brief 选择之后新建的有名字的实例是否保存和恢复状态（断电记忆），仅 FAST_DIODE_PERSIST 为 1 时可用，默认开启
+  /// @details 名字就是 NVS 中的键，不同的LED必须使用不同的名字；没有名字的实例不保存
+  static void usePersistence(bool enable) { persistence = enable; }
+
+  /// @brief 状态保持不变多久(ms)后才写入flash，默认 FAST_DIODE_PERSIST_DELAY
+  static void setPersistDelay(uint32_t ms) { FastDiodeStore::setDelay(ms); }
+
+  /// @brief 断电记忆累计写入flash的次数
+  static uint32_t getPersistWrites() { return FastDiodeStore::getWrites(); }
+#endif
+
+  /// @brief 所有灯效任务（包括共享调度任务）被唤醒的总次数，用于评估CPU开销
+  static uint32_t getWakeupCount() { return wakeupCount; }
+
+  /// @brief 灯效使用的当前时间（微秒），来源由 FAST_DIODE_TIMER 选择
+  static FastDiodeTime now() { return FastDiodeTimer::now(); }
+
+  /// @brief 初始化，使用指定的通道
+  /// @param channel 通道，idf 下必须是低速模式的通道；通道已被其他LED占用时失败（CHANNEL_BUSY）
   /// @param freq 频率
   /// @param resolution 分辨率
-  void init(ELEDChannel _channel, uint32_t freq = 5000, uint8_t resolution = 8)
+  /// @return 通道被其他配置占用或定时器用完时返回 false，原因由 getLedcError() 给出，仍然使用GPIO模式
+  bool init(ELEDChannel _channel, uint32_t freq = 5000, uint8_t _resolution = 8)
   {
+#ifdef ARDUINO
     initialized = true;
     channel = _channel;
-#ifdef ARDUINO
+    resolution = _resolution;
+    if (curve && curve->resolution != resolution)
+      curve = nullptr;
     ledcSetup(channel, freq, resolution);
     ledcAttachPin(pin, channel);
+    // 灯效任务可能已经输出过（例如恢复的亮度），接着输出它
+    ledcWrite(channel, toDuty(outputLevel));
+    return true;
 #else
-      // Prepare and then apply the LEDC PWM timer configuration
-      ledc_timer_config_t ledc_timer = {
-          .speed_mode       = LEDC_MODE,
-          .duty_resolution  = static_cast<ledc_timer_bit_t>(resolution),
-          .timer_num        = LEDC_TIMER,
-          .freq_hz          = freq,
-          .clk_cfg          = LEDC_AUTO_CLK,
-          .deconfigure      = false
-      };
-      ESP_ERROR_CHECK(ledc_timer_config(&ledc_timer));
-
-      // Prepare and then apply the LEDC PWM channel configuration
-      ledc_channel_config_t ledc_channel = {
-          .gpio_num       = pin,
-          .speed_mode     = LEDC_MODE,
-          .channel        = channel,
-          .intr_type      = LEDC_INTR_DISABLE,
-          .timer_sel      = LEDC_TIMER,
-          .duty           = 0,
-          .hpoint         = 0,
-          .sleep_mode     = LEDC_SLEEP_MODE_NO_ALIVE_NO_PD,
-          .flags = {
-              .output_invert = 0
-          }
-      };
-      ESP_ERROR_CHECK(ledc_channel_config(&ledc_channel));
+    return attachLedc(true, _channel, freq, _resolution);
 #endif
   }
 
-  /// @brief 开灯
-  void open()
+#ifndef ARDUINO
+  /// @brief 初始化，自动分配通道和定时器，仅 idf 和主机下可用
+  /// @details 频率和分辨率相同的LED共用一个定时器，不会重新配置其他LED正在使用的定时器
+  /// @return 通道或定时器用完时返回 false，原因由 getLedcError() 给出，仍然使用GPIO模式
+  bool init(uint32_t freq = 5000, uint8_t _resolution = 8)
   {
-    if (edge == EPinPolarity::ACTIVE_LOW)
-      sendNotify(EEffectType::STATIC, // 固定亮度
-                 255,                 // 亮度
-                 0,                   // 步进时间:无，直接设定
-                 0,                   // 总时间:无，一直保持
-                 0);                  // 重复次数:无，一直保持
-    else
-      sendNotify(EEffectType::STATIC, // 固定亮度
-                 0,                   // 亮度
-                 0,                   // 步进时间:无，直接设定
-                 0,                   // 总时间:无，一直保持
-                 0);                  // 重复次数:无，一直保持
+    return attachLedc(false, LEDC_CHANNEL_0, freq, _resolution);
   }
-  /// @brief 关灯
-  void close()
+
+  /// @brief 最近一次 init() 失败的原因，成功时为 ELedcError::NONE
+  ELedcError getLedcError() const { return ledcError; }
+
+  /// @brief 分配到的 LEDC 速度模式、定时器和通道，init() 成功后有效
+  const FastDiodeLedcSlot &getLedcSlot() const { return ledc; }
+
+  /// @brief 不调用 init() 时改用软件PWM输出，不占用 LEDC 通道，仅 idf 和主机下可用
+  /// @details 所有软件PWM的LED共用一个定时器，频率为 FAST_DIODE_SOFT_PWM_FREQ；渐变由软件逐步执行
+  /// @param resolution 分辨率（位），一个PWM周期（微秒）内能分出的级数有限，不宜超过 12
+  /// @return 软件PWM通道用完（FAST_DIODE_SOFT_PWM_CHANNELS）或已经调用过 init() 时返回 false，仍然只输出高低电平
+  bool initSoftPwm(uint8_t _resolution = 8)
   {
-    if (edge == EPinPolarity::ACTIVE_LOW)
-      sendNotify(EEffectType::STATIC, // 固定亮度
-                 0,                   // 亮度
-                 0,                   // 步进时间:无，直接设定
-                 0,                   // 总时间:无，一直保持
-                 0);                  // 重复次数:无，一直保持
-    else
-      sendNotify(EEffectType::STATIC, // 固定亮度
-                 255,                 // 亮度
-                 0,                   // 步进时间:无，直接设定
-                 0,                   // 总时间:无，一直保持
-                 0);                  // 重复次数:无，一直保持
+    if (initialized || softChannel >= 0)
+      return false;
+    int soft = FastDiodeSoftPwm::attach(pin);
+    if (soft < 0)
+      return false;
+    resolution = _resolution;
+    if (curve && curve->resolution != resolution)
+      curve = nullptr;
+    softChannel = soft;
+    FastDiodeSoftPwm::write(softChannel, toDuty(outputLevel), maxDuty());
+    return true;
   }
+#endif
 
-  /// @brief 设定亮度 0~255
-  void setBrightness(uint8_t brightness)
+  /// @brief 设置亮度曲线，例如 &FastDiodeCurve<CurveCIE1931, 8>::table，传入 nullptr 恢复线性输出
+  /// @details 查找表在编译期生成并放在flash中，每次输出只查一次表；表的分辨率必须与 init() 的分辨率一致
+  /// @return 分辨率不一致时返回 false，曲线不生效
+  bool setCurve(const FastDiodeCurveTable *table)
   {
-    sendNotify(EEffectType::STATIC, // 固定亮度
-               brightness,          // 亮度
-               0,                   // 步进时间:无，直接设定
-               0,                   // 总时间:无，一直保持
-               0);                  // 重复次数:无，一直保持
+    if (table && table->resolution != resolution)
+      return false;
+    curve = table;
+    return true;
   }
 
-  /// @brief  闪灯
-  /// @param time 时间间隔
-  /// @param repeatCount 闪动次数
-  /// @param brightness 闪动亮度
-  void flickering(uint32_t time, uint32_t repeatCount = MAX_COUNT, uint8_t brightness = 255)
+  /// @brief 设置 EEasing::CUSTOM 使用的缓动曲线，例如 &FastDiodeEasing<MyEase>::table，传入 nullptr 时 CUSTOM 为匀速
+  /// @details 查找表在编译期生成并放在flash中，必须一直有效；只影响之后开始的灯效
+  void setCustomEasing(const FastDiodeEasingTable *table) { customEasing = table; }
+
+  /// @brief 渐变和呼吸灯是否使用LEDC硬件渐变单元，默认开启，仅 idf 下调用 init() 后有效
+  /// @details 硬件渐变时CPU只在每段渐变结束时唤醒一次，关闭后回到软件逐步调节亮度
+  void useHardwareFade(bool enable) { hwFade = enable; }
+
+#if FAST_DIODE_DITHER
+  /// @brief 打开或关闭时间抖动，仅 FAST_DIODE_DITHER 为 1 时可用，需要PWM输出（init() 或 initSoftPwm()）
+  /// @details 输出落在两个相邻占空比之间时，每 FAST_DIODE_DITHER_INTERVAL 毫秒交替输出这两个占空比，
+  /// 平均亮度多出 8 位分辨率；渐变也改为每帧计算。打开后不使用硬件渐变和直接写入，
+  /// 每个抖动中的LED最多每帧唤醒一次，只在占空比变化时写入，次数见 getDitherWakeups()
+  void useDithering(bool enable)
   {
-    sendNotify(EEffectType::BLINK, // 闪烁
-               brightness,         // 闪动亮度
-               time,               // 步进时间:闪烁时间间隔
-               0,                  // 总时间:无，一直保持
-               repeatCount);       // 重复次数，默认MAX_COUNT无限闪动
+    dither = enable;
+    ditherDuty = UINT32_MAX;
+    wake();
   }
 
-  /// @brief 逐渐变亮
-  /// @param time 时间
-  /// @param brightness 最终亮度
-  void fodeOn(uint32_t time, uint8_t brightness = 255)
+  /// @brief 只为抖动执行的步数（没有灯效需要计算、只为交替占空比唤醒的次数）
+  uint32_t getDitherWakeups() const { return ditherWakeups; }
+#endif
+
+  /// @brief 某种灯效累计执行的步数，也就是为它唤醒CPU的次数
+  uint32_t getEffectWakeups(EEffectType effect) const { return effectWakeups[static_cast<int>(effect)]; }
+
+#if FAST_DIODE_DEBUG
+  /// @brief 某种灯效累计占用CPU的时间（微秒，取命令、计算和写入），仅 FAST_DIODE_DEBUG 为 1 时可用
+  FastDiodeTime getEffectAwakeTime(EEffectType effect) const { return effectAwake[static_cast<int>(effect)]; }
+#endif
+
+#if FAST_DIODE_PM
+  /// @brief 累计持有电源管理锁（禁止浅睡眠）的时间（微秒），包括正在持有的这一段
+  FastDiodeTime getPowerLockTime() const { return powerTime + (powerHeld ? now() - powerSince : 0); }
+#endif
+
+#if FAST_DIODE_DEBUG
+  /// @brief 调试计数器，仅 FAST_DIODE_DEBUG 为 1 时可用
+  const FastDiodeStats &getStats() const { return stats; }
+#endif
+
+  // 状态查询，任何任务都可以调用，只读一个原子变量，不加锁也不唤醒灯效任务
+
+  /// @brief 当前输出的亮度 0~255
+  uint8_t getBrightness() const { return (getBrightness16() + 128) / 257; }
+
+  /// @brief 当前输出的亮度 0~65535（多层合成后的结果）
+  /// @details 硬件渐变进行中时为这一段渐变的目标亮度（渐变交给硬件后立即发布）
+  uint16_t getBrightness16() const { return published.load(std::memory_order_acquire) & 0xffff; }
+
+  /// @brief 最上面一层正在执行的灯效，渐变和有限次闪烁结束后为 NONE（保持最后的亮度）
+  EEffectType getEffect() const
   {
-    sendNotify(EEffectType::FADE_IN, // 逐渐变亮
-               brightness,           // 最终亮度，默认255 最亮
-               0,                    // 步进时间:无，直接设定
-               time,                 // 总时间：经过多久到达最终亮度
-               0);                   // 重复次数:无，一直保持
+    return static_cast<EEffectType>(published.load(std::memory_order_acquire) >> STATE_EFFECT_SHIFT & 0x0f);
   }
 
-  /// @brief 逐渐变暗
-  /// @param time 时间
-  /// @param brightness 开始亮度
-  void fodeOff(uint32_t time, uint8_t brightness = 255)
+#if FAST_DIODE_PERSIST
+  /// @brief 最近一次不为 0 的背景亮度 0~255，熄灭后开灯时用它回到上次的亮度；断电后由保存的记录恢复
+  /// @details 没有保存状态的实例、或者从来没有亮过时为 0
+  uint8_t getLastBrightness() const { return (getLastBrightness16() + 128) / 257; }
+
+  /// @brief 最近一次不为 0 的背景亮度 0~65535
+  uint16_t getLastBrightness16() const { return persistSlot >= 0 ? FastDiodeStore::peek(persistSlot).lastOn : 0; }
+#endif
+
+  /// @brief 是否空闲：没有未执行的命令，亮度也不会再变化；呼吸灯、无限闪烁等一直进行的灯效不空闲
+  bool isIdle() const
   {
-    sendNotify(EEffectType::FADE_OUT, // 逐渐变暗
-               brightness,            // 开始亮度，默认255 最亮
-               0,                     // 步进时间:无，直接设定
-               time,                  // 总时间：经过多久到达最终亮度
-               0);                    // 重复次数:无，一直保持
+    return access.load(std::memory_order_acquire) < ACCESS_PENDING &&
+           !(published.load(std::memory_order_acquire) & STATE_BUSY);
   }
 
-  /// @brief 呼吸灯
-  /// @param time 时间
-  /// @param brightness 亮度
-  void breathing(uint32_t time, uint8_t brightness = 255)
+  /// @brief 等待已发出的有限灯效（渐变、有限次闪烁、关键帧程序）全部结束或被新的灯效取代
+  /// @details 呼吸灯、无限闪烁等一直进行的灯效不需要等待；在最上面的层结束前，被盖住的渐变也不算结束。
+  /// 第一次调用时为这个实例创建一个事件组，之后灯效任务只在完成状态变化时设置一次；从不调用时没有开销
+  /// @param timeout 最长等待时间(ms)，UINT32_MAX 表示一直等待
+  /// @return false 表示超时
+  bool waitDone(uint32_t timeout = UINT32_MAX);
+
+  /// @brief 有限的灯效全部结束（或被新的灯效取代）时，在灯效任务中调用 callback，传入 nullptr 取消
+  /// @details 回调在灯效任务（共享调度模式下为调度任务）中执行，应尽快返回，可以在回调中发出下一个灯效
+  void onDone(FastDiodeDoneCallback callback, void *arg = nullptr)
+  {
+    doneArg = arg;
+    doneCallback.store(callback, std::memory_order_release);
+  }
+
+#if !defined(FAST_DIODE_HOST)
+  /// @brief 有限的灯效全部结束（或被新的灯效取代）时，在灯效任务中设置事件组 group 的 bits，传入 nullptr 取消
+  /// @details 由应用等待并清除这些位，一个事件组可以同时接收多个LED的完成事件
+  void setDoneEvent(EventGroupHandle_t group, EventBits_t bits)
   {
-    sendNotify(EEffectType::BREATHING, // 呼吸灯
-               brightness,             // 亮度
-               0,                      // 步进时间:无，直接设定，由总时间和总亮度计算得到。
-               time,                   // 总时间：呼吸灯一次的时间
-               0);                     // 重复次数:无，一直保持
+    doneBits = bits;
+    doneGroup.store(group, std::memory_order_release);
   }
+#endif
+
+  /// @brief 取得某个优先级的灯效层，通过它发出的灯效只占用这一层
+  /// @details 例如 led.layer(EEffectPriority::ALERT).flickering(100)，告警结束后调用 release() 回到下面的灯效
+  FastDiodeLayer layer(EEffectPriority priority);
+
+  /// @brief 在中断中发出灯效，例如 led.fromISR(&woken).flickering(100, 3)
+  /// @param woken 有更高优先级的任务被唤醒时置为 pdTRUE，中断退出前按 portYIELD_FROM_ISR 的约定切换任务
+  FastDiodeISR fromISR(BaseType_t *woken);
 };
+
+// 某个优先级的灯效层，由 FastDiode::layer() 取得，只保存引用，可以随用随取
+class FastDiodeLayer : public FastDiodeEffects<FastDiodeLayer>
+{
+  friend class FastDiodeEffects<FastDiodeLayer>;
+
+public:
+  FastDiodeLayer(FastDiode &_led, EEffectPriority _priority) : led(_led), priority(_priority) {}
+
+  /// @brief 结束这一层的灯效，回到下面一层，下面的灯效按原来的相位继续；背景层不能结束
+  bool release() { return led.sendNotify(EEffectType::NONE, 0, 0, 0, 0, nullptr, EEasing::LINEAR, priority); }
+
+  /// @brief 设置这一层与下面各层的混合方式
+  /// @param mode 覆盖/取大/相加/相乘，默认覆盖
+  /// @param opacity 不透明度 0~255，0 时这一层不起作用
+  void blend(EBlendMode mode, uint8_t opacity = 255) { blend16(mode, toLevel(opacity)); }
+  /// @brief 设置混合方式，不透明度 0~65535
+  void blend16(EBlendMode mode, uint16_t opacity = LEVEL_MAX) { led.setBlend(priority, mode, opacity); }
+
+private:
+  FastDiode &led;
+  EEffectPriority priority;
+
+  bool sendNotify(EEffectType status, uint16_t level, uint32_t stepInterval, uint32_t totalDuration, uint32_t repeatCount,
+                  const uint8_t *program, EEasing easing)
+  {
+    return led.sendNotify(status, level, stepInterval, totalDuration, repeatCount, program, easing, priority);
+  }
+  void sendSwitch(bool on) { sendNotify(EEffectType::STATIC, led.switchLevel(on), 0, 0, 0, nullptr, EEasing::LINEAR); }
+
+public:
+  /// @brief 在中断中向这一层发出灯效
+  FastDiodeISR fromISR(BaseType_t *woken);
+};
+
+// 在中断中使用的灯效函数，由 fromISR() 取得
+// 命令写入无锁的命令通道，不阻塞也不进入临界区，再用 ...FromISR 通知灯效任务，真正的处理推迟到任务中执行。
+// 这些函数不在 IRAM 中，不能在 ESP_INTR_FLAG_IRAM 的中断（flash 缓存关闭时）中调用。
+class FastDiodeISR : public FastDiodeEffects<FastDiodeISR>
+{
+  friend class FastDiodeEffects<FastDiodeISR>;
+
+public:
+  FastDiodeISR(FastDiode &_led, BaseType_t *_woken) : led(_led), woken(_woken) {}
+  FastDiodeISR(FastDiode &_led, BaseType_t *_woken, EEffectPriority _priority)
+      : led(_led), woken(_woken), fixed(true), priority(_priority) {}
+
+  /// @brief 结束这一层的灯效，只对 layer().fromISR() 取得的对象有意义
+  bool release() { return led.sendNotify(EEffectType::NONE, 0, 0, 0, 0, nullptr, EEasing::LINEAR, priority, woken); }
+
+private:
+  FastDiode &led;
+  BaseType_t *woken;
+  bool fixed = false; // 是否指定了优先级，否则与 FastDiode 相同按灯效决定
+  EEffectPriority priority = EEffectPriority::BACKGROUND;
+
+  bool sendNotify(EEffectType status, uint16_t level, uint32_t stepInterval, uint32_t totalDuration, uint32_t repeatCount,
+                  const uint8_t *program, EEasing easing)
+  {
+    return led.sendNotify(status, level, stepInterval, totalDuration, repeatCount, program, easing,
+                          fixed ? priority : defaultPriority(status, repeatCount), woken);
+  }
+  void sendSwitch(bool on) { sendNotify(EEffectType::STATIC, led.switchLevel(on), 0, 0, 0, nullptr, EEasing::LINEAR); }
+};
+
+inline FastDiodeLayer FastDiode::layer(EEffectPriority priority) { return FastDiodeLayer(*this, priority); }
+inline FastDiodeISR FastDiode::fromISR(BaseType_t *woken) { return FastDiodeISR(*this, woken); }
+inline FastDiodeISR FastDiodeLayer::fromISR(BaseType_t *woken) { return FastDiodeISR(led, woken, priority); }
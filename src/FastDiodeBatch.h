@@ -0,0 +1,271 @@
+#pragma once
+
+#include <utility>
+#include "FastDiode.h"
+
+// 批量灯效引擎
+// 几百个LED（IO扩展芯片、软件PWM驱动的指示灯面板）如果每个都是一个 FastDiode 实例，
+// 每个LED单独唤醒、单独 switch 一次，时间都花在调度和分支上。
+// FastDiodeBatch 把所有LED的状态按列存成几个并列的数组（开始时间、相位速度、时长、起点、幅度），
+// 同一种灯效的LED排在一段连续的位置上，每帧对每种灯效执行一个没有分支的循环，编译器可以自动向量化：
+// - 渐变：相位 = min(经过时间, 时长) × 速度，亮度 = 起点 + 幅度 × 相位
+// - 呼吸灯：相位 = 经过时间 × 速度，按 2^32 自然回绕，最高位决定上升/下降，折成三角波
+// - 闪烁：相位同上，最高位就是亮灭，超过次数后熄灭
+// - 固定亮度：设置时算好，每帧不需要计算
+// 灯效函数与 FastDiode 相同，通过 batch.led(i) 取得，例如 batch.led(3).breathing(1000)。
+// 亮度仍然是时间的纯函数，帧间隔不影响结果。不支持关键帧程序、优先级层、亮度曲线和缓动曲线（渐变总是匀速）。
+//
+// 不是线程安全的：设置灯效和 frame() 应在同一个任务中调用，例如在刷新扩展芯片的任务里每帧先 frame() 再输出。
+//
+// 用法：
+//   static FastDiodeBatch<256> panel;
+//   panel.led(0).breathing(1000);
+//   panel.led(1).flickering(200, 6);
+//   while (1) {
+//     panel.frame(FastDiode::now());
+//     panel.forEach([](uint16_t led, uint16_t level) { expander.write(led, level >> 8); });
+//     vTaskDelay(pdMS_TO_TICKS(10));
+//   }
+
+template <size_t N>
+class FastDiodeBatch;
+
+// 批量引擎中的一个LED，由 FastDiodeBatch::led() 取得，只保存引用，可以随用随取
+template <size_t N>
+class FastDiodeBatchLed : public FastDiodeEffects<FastDiodeBatchLed<N>>
+{
+  friend class FastDiodeEffects<FastDiodeBatchLed<N>>;
+
+public:
+  FastDiodeBatchLed(FastDiodeBatch<N> &_batch, uint16_t _index) : batch(_batch), index(_index) {}
+
+private:
+  FastDiodeBatch<N> &batch;
+  uint16_t index;
+
+  bool sendNotify(EEffectType status, uint16_t level, uint32_t stepInterval, uint32_t totalDuration, uint32_t repeatCount,
+                  const uint8_t * /* program: 不支持关键帧程序 */, EEasing /* easing: 渐变总是匀速 */)
+  {
+    return batch.set(index, status, level, stepInterval, totalDuration, repeatCount);
+  }
+  void sendSwitch(bool on) { sendNotify(EEffectType::STATIC, on ? LEVEL_MAX : 0, 0, 0, 0, nullptr, EEasing::LINEAR); }
+};
+
+template <size_t N>
+class FastDiodeBatch
+{
+  static_assert(N > 0 && N <= 0xffff, "FastDiodeBatch supports 1~65535 LEDs");
+  friend class FastDiodeBatchLed<N>;
+
+public:
+  FastDiodeBatch()
+  {
+    for (size_t i = 0; i < N; i++)
+    {
+      ledAt[i] = i;
+      position[i] = i;
+    }
+    // 所有LED都是熄灭的固定亮度
+    for (int k = 1; k <= KIND_COUNT; k++)
+      begin[k] = N;
+  }
+
+  /// @brief 取得第 index 个LED，通过它发出灯效
+  FastDiodeBatchLed<N> led(uint16_t index) { return FastDiodeBatchLed<N>(*this, index); }
+
+  /// @brief 计算 now 时刻所有LED的亮度
+  /// @param now 当前时间（微秒），通常为 FastDiode::now()
+  void frame(FastDiodeTime now)
+  {
+    nowMs = static_cast<uint32_t>(now / 1000);
+    fade(begin[FADE], begin[FADE + 1]);
+    breathe(begin[BREATHING], begin[BREATHING + 1]);
+    blink(begin[BLINK], begin[BLINK + 1]);
+  }
+
+  /// @brief 第 index 个LED在最近一帧的亮度 0~65535
+  uint16_t getLevel(uint16_t index) const { return value[position[index]]; }
+
+  /// @brief 按存储顺序输出所有LED的亮度，fn(LED编号, 亮度)
+  template <typename Fn>
+  void forEach(Fn fn) const
+  {
+    for (size_t i = 0; i < N; i++)
+      fn(ledAt[i], static_cast<uint16_t>(value[i]));
+  }
+
+  /// @brief LED总数
+  static constexpr size_t size() { return N; }
+
+private:
+  // 灯效种类，同一种的LED在数组中连续存放，begin[k] ~ begin[k + 1] 为第 k 种
+  enum Kind
+  {
+    STATIC = 0,
+    FADE,
+    BREATHING,
+    BLINK,
+    KIND_COUNT
+  };
+
+  uint32_t start[N] = {};   // 灯效开始时间(ms)
+  uint32_t rate[N] = {};    // 相位速度：渐变为每毫秒的 Q15 相位 × 256，呼吸灯和闪烁为每毫秒的 2^32 周期相位
+  uint32_t limit[N] = {};   // 渐变的时长(ms)，闪烁的总时长(ms)，无限闪烁为 UINT32_MAX
+  int32_t base[N] = {};     // 亮度起点
+  int32_t delta[N] = {};    // 亮度幅度，终点 - 起点
+  int32_t value[N] = {};    // 最近一帧的亮度
+  uint16_t ledAt[N];        // 存储位置上的LED编号
+  uint16_t position[N];     // LED编号对应的存储位置
+  size_t begin[KIND_COUNT + 1] = {};
+  uint32_t nowMs = 0; // 最近一帧的时间(ms)
+
+  // 以下每个循环都只有加减乘、移位和取小，没有按LED的分支
+
+  void fade(size_t from, size_t to)
+  {
+    for (size_t i = from; i < to; i++)
+    {
+      uint32_t t = nowMs - start[i];
+      t = t < limit[i] ? t : limit[i];
+      uint32_t phase = (t * rate[i]) >> 8;
+      phase = phase < 32768 ? phase : 32768;
+      value[i] = base[i] + ((delta[i] * (int32_t)phase) >> 15);
+    }
+  }
+
+  void breathe(size_t from, size_t to)
+  {
+    for (size_t i = from; i < to; i++)
+    {
+      uint32_t phase = (nowMs - start[i]) * rate[i];
+      // 前半周期上升，后半周期按位取反后下降
+      uint32_t triangle = phase ^ (0u - (phase >> 31));
+      // 取高15位（0~32767）再换算到 0~32768，顶点正好是设定的亮度，与 FastDiode::breathing() 一致
+      int32_t q15 = triangle >> 16;
+      q15 += q15 >> 14;
+      value[i] = base[i] + ((delta[i] * q15) >> 15);
+    }
+  }
+
+  void blink(size_t from, size_t to)
+  {
+    for (size_t i = from; i < to; i++)
+    {
+      uint32_t t = nowMs - start[i];
+      // 先灭后亮；超过总时长后保持熄灭
+      uint32_t on = ((t * rate[i]) >> 31) & (t < limit[i]);
+      value[i] = base[i] + (delta[i] & -(int32_t)on);
+    }
+  }
+
+  // 把存储位置 a 和 b 的LED互换
+  void swap(size_t a, size_t b)
+  {
+    if (a == b)
+      return;
+    std::swap(start[a], start[b]);
+    std::swap(rate[a], rate[b]);
+    std::swap(limit[a], limit[b]);
+    std::swap(base[a], base[b]);
+    std::swap(delta[a], delta[b]);
+    std::swap(value[a], value[b]);
+    std::swap(ledAt[a], ledAt[b]);
+    position[ledAt[a]] = a;
+    position[ledAt[b]] = b;
+  }
+
+  // 种类 k 的LED所在的段，位置 pos 的LED属于哪一种
+  int kindAt(size_t pos) const
+  {
+    int k = 0;
+    while (pos >= begin[k + 1])
+      k++;
+    return k;
+  }
+
+  // 把第 index 个LED移到种类 kind 的段中，每跨过一段边界只交换一次，返回新的存储位置
+  size_t moveTo(uint16_t index, int kind)
+  {
+    size_t pos = position[index];
+    int k = kindAt(pos);
+    for (; k < kind; k++)
+    {
+      // 换到本段末尾，再把边界前移，它就成了下一段的第一个
+      size_t last = begin[k + 1] - 1;
+      swap(pos, last);
+      begin[k + 1]--;
+      pos = last;
+    }
+    for (; k > kind; k--)
+    {
+      // 换到本段开头，再把边界后移，它就成了上一段的最后一个
+      size_t first = begin[k];
+      swap(pos, first);
+      begin[k]++;
+      pos = first;
+    }
+    return pos;
+  }
+
+  // 周期为 period 毫秒时每毫秒的相位增量（一个周期为 2^32），向上取整，保证切换时刻不会晚一帧
+  // 取整误差每个周期不到 1/2^32 周期，连续运行几十天才会累积出一毫秒
+  static uint32_t cycleRate(uint64_t period) { return (uint32_t)(((1ull << 32) + period - 1) / period); }
+
+  // 解析灯效，参数含义与 FastDiode 的命令相同
+  bool set(uint16_t index, EEffectType status, uint16_t level, uint32_t stepInterval, uint32_t totalDuration,
+           uint32_t repeatCount)
+  {
+    if (index >= N)
+      return false;
+    uint32_t now = static_cast<uint32_t>(FastDiode::now() / 1000);
+    // 渐变和呼吸灯的时间最短 255ms，与 FastDiode 相同
+    uint32_t duration = totalDuration < 255 ? 255 : totalDuration;
+    size_t pos;
+    switch (status)
+    {
+    case EEffectType::FADE_IN:
+    case EEffectType::FADE_OUT:
+      pos = moveTo(index, FADE);
+      rate[pos] = ((32768u << 8) + duration - 1) / duration; // 向上取整，保证时长结束时到达终点
+      limit[pos] = duration;
+      base[pos] = status == EEffectType::FADE_IN ? 0 : level;
+      delta[pos] = status == EEffectType::FADE_IN ? level : -(int32_t)level;
+      break;
+
+    case EEffectType::BREATHING:
+      // 一个周期是两个 duration：前一个渐亮，后一个渐暗
+      pos = moveTo(index, BREATHING);
+      rate[pos] = cycleRate(2ull * duration);
+      limit[pos] = UINT32_MAX;
+      base[pos] = 0;
+      delta[pos] = level;
+      break;
+
+    case EEffectType::BLINK:
+    {
+      uint32_t half = stepInterval ? stepInterval : 1;
+      pos = moveTo(index, BLINK);
+      rate[pos] = cycleRate(2ull * half);
+      // 与 FastDiode 相同，亮和灭各算一次，共 2 × repeatCount 个半周期
+      uint64_t total = 2ull * repeatCount * half;
+      limit[pos] = repeatCount < MAX_COUNT && total < UINT32_MAX ? (uint32_t)total : UINT32_MAX;
+      base[pos] = 0;
+      delta[pos] = level;
+    }
+    break;
+
+    case EEffectType::STATIC:
+    case EEffectType::NONE:
+      pos = moveTo(index, STATIC);
+      value[pos] = status == EEffectType::STATIC ? level : 0;
+      return true;
+
+    default:
+      // 关键帧程序需要逐段执行，不适合批量计算
+      return false;
+    }
+    start[pos] = now;
+    value[pos] = base[pos];
+    return true;
+  }
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+enum class EEffectType;
+enum class EEffectPriority : uint8_t;
+enum class EEasing : uint8_t;
+
+// 命令队列长度，必须是2的幂
+#ifndef FAST_DIODE_COMMAND_QUEUE
+#define FAST_DIODE_COMMAND_QUEUE 4
+#endif
+
+// 打包后的灯效命令，只保存 API 的原始参数，由灯效任务解析成 LEDState
+struct FastDiodeCommand
+{
+  EEffectType status;   // 灯效
+  uint16_t brightness;  // 目标亮度（16位）
+  uint32_t time;        // 闪烁为步进时间，渐变/呼吸灯为总时间
+  uint32_t repeatCount; // 重复次数
+  const uint8_t *program; // 关键帧程序，只用于 PROGRAM
+  EEffectPriority priority; // 放在哪一层
+  EEasing easing;           // 渐变/呼吸灯的缓动曲线
+  bool polarized;           // 开关灯命令，亮度按成员的极性换算（只用于 FastDiodeGroup）
+};
+
+// 多生产者、单消费者的无锁命令通道，任何任务都可以同时调用 API 而不会读到写了一半的命令
+//
+// 合并规则：
+// 1. 固定亮度命令（open/close/setBrightness）不进队列，只写入一个32位的最新值槽，
+//    连续的固定亮度命令只保留最新的一个，调用方永远不会阻塞也不会失败
+// 2. 其他带时间的灯效按先后顺序进入有界队列，队列满时 post() 返回 false，命令被丢弃
+// 3. 最新值槽记录了写入时队列的位置，取出时按这个位置插回队列中的先后顺序
+template <size_t N = FAST_DIODE_COMMAND_QUEUE>
+class FastDiodeChannel
+{
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "FAST_DIODE_COMMAND_QUEUE must be a power of two");
+
+public:
+  FastDiodeChannel()
+  {
+    for (size_t i = 0; i < N; i++)
+      cells[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  // 投递带时间的灯效，任何任务都可以调用
+  // 返回：false - 队列已满
+  bool post(const FastDiodeCommand &cmd)
+  {
+    uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (1)
+    {
+      cell = &cells[pos & (N - 1)];
+      int32_t dif = (int32_t)(cell->seq.load(std::memory_order_acquire) - pos);
+      if (dif == 0)
+      {
+        if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (dif < 0)
+        return false;
+      else
+        pos = enqueuePos.load(std::memory_order_relaxed);
+    }
+    cell->cmd = cmd;
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // 写入最新的固定亮度，任何任务都可以调用
+  // 返回：true - 覆盖了一个还没被取走的固定亮度
+  bool postStatic(uint16_t value)
+  {
+    uint32_t pos = enqueuePos.load(std::memory_order_acquire);
+    uint32_t word = STATIC_VALID | (pos & POS_MASK) << POS_SHIFT | value;
+    return latest.exchange(word, std::memory_order_acq_rel) & STATIC_VALID;
+  }
+
+  // 按投递顺序取出所有命令，只能在灯效任务中调用
+  // onCommand(const FastDiodeCommand &) 处理队列中的灯效，onStatic(uint16_t) 处理固定亮度
+  // 返回：是否取到了命令
+  template <typename OnCommand, typename OnStatic>
+  bool drain(OnCommand &&onCommand, OnStatic &&onStatic)
+  {
+    uint32_t word = 0;
+    bool hasStatic = false;
+    bool any = false;
+
+    while (1)
+    {
+      Cell &cell = cells[dequeuePos & (N - 1)];
+      // 生产者还没写完的位置留到下次再取
+      if ((int32_t)(cell.seq.load(std::memory_order_acquire) - (dequeuePos + 1)) < 0)
+        break;
+      // 读到这条命令之后再看最新值槽：同一个生产者在这条命令之前写入的固定亮度一定能看到
+      if (!hasStatic)
+        hasStatic = takeStatic(word);
+      // 固定亮度比这条命令先投递
+      if (hasStatic && !before(dequeuePos, word >> POS_SHIFT))
+      {
+        onStatic(static_cast<uint16_t>(word));
+        hasStatic = false;
+        any = true;
+      }
+      onCommand(cell.cmd);
+      cell.seq.store(dequeuePos + N, std::memory_order_release);
+      dequeuePos++;
+      any = true;
+    }
+    if (!hasStatic)
+      hasStatic = takeStatic(word);
+    if (hasStatic)
+    {
+      // 前面还有生产者没写完的命令：放回最新值槽，等那条命令写完后按顺序取出
+      // 放回前又写入了更新的固定亮度时放不回去，更新的值排在那条命令后面，会取代这个值，这里照常交出
+      uint32_t empty = 0;
+      if (before(dequeuePos, word >> POS_SHIFT) && latest.compare_exchange_strong(empty, word, std::memory_order_acq_rel))
+        return any;
+      onStatic(static_cast<uint16_t>(word));
+      any = true;
+    }
+    return any;
+  }
+
+private:
+  // 最新值槽：bit31~17 队列位置，bit16 有效标记，bit15~0 亮度
+  static const uint32_t STATIC_VALID = 1u << 16;
+  static const uint32_t POS_SHIFT = 17;
+  static const uint32_t POS_MASK = 0x7fff;
+
+  struct Cell
+  {
+    std::atomic<uint32_t> seq;
+    FastDiodeCommand cmd;
+  };
+
+  Cell cells[N];
+  std::atomic<uint32_t> enqueuePos{0};
+  std::atomic<uint32_t> latest{0};
+  uint32_t dequeuePos = 0; // 只有消费者访问
+
+  // 取走最新值槽中的固定亮度，槽为空时不写入
+  bool takeStatic(uint32_t &word)
+  {
+    if (!(latest.load(std::memory_order_relaxed) & STATIC_VALID))
+      return false;
+    word = latest.exchange(0, std::memory_order_acq_rel);
+    return true;
+  }
+
+  // 队列位置 pos 是否在 mark 之前（15位回绕比较）
+  static bool before(uint32_t pos, uint32_t mark)
+  {
+    uint32_t dif = (mark - pos) & POS_MASK;
+    return dif != 0 && dif < POS_MASK / 2;
+  }
+};
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 亮度曲线查找表
+// 人眼对亮度的感知不是线性的，直接把亮度写成占空比时，变化几乎都集中在最暗的一段。
+// 这里在编译期把曲线算成查找表（放在flash中），运行时每一步只需要查一次表并插值，没有 pow() 也不占RAM。
+//
+// 用法：
+//   led.init(LEDC_CHANNEL_0, 5000, 10);
+//   led.setCurve(&FastDiodeCurve<CurveCIE1931, 10>::table);
+//
+// 自定义曲线只需要提供 static constexpr double apply(double x)，输入输出都是 0~1：
+//   struct MyCurve { static constexpr double apply(double x) { return x * x; } };
+
+// 查找表描述，实例只保存它的指针
+struct FastDiodeCurveTable
+{
+  const uint16_t *data; // 占空比表，下标为 16位亮度 >> (16 - indexBits)
+  uint8_t indexBits;    // 表长为 2^indexBits
+  uint8_t resolution;   // 表中占空比的分辨率，必须与 init() 的分辨率一致
+};
+
+namespace fast_diode_math
+{
+  constexpr double LN2 = 0.69314718055994530942;
+
+  // e^r，r 在 [0, ln2) 内，泰勒展开
+  constexpr double expReduced(double r)
+  {
+    double sum = 1, term = 1;
+    for (int i = 1; i < 20; i++)
+    {
+      term *= r / i;
+      sum += term;
+    }
+    return sum;
+  }
+
+  constexpr double exp(double y)
+  {
+    // y = k*ln2 + r
+    int k = static_cast<int>(y / LN2);
+    if (k * LN2 > y)
+      k--;
+    double result = expReduced(y - k * LN2);
+    for (; k > 0; k--)
+      result *= 2;
+    for (; k < 0; k++)
+      result /= 2;
+    return result;
+  }
+
+  // ln(x)，x > 0
+  constexpr double log(double x)
+  {
+    // x = m * 2^k，m 在 [0.5, 1) 内，再用 ln(m) = 2*atanh((m-1)/(m+1))
+    int k = 0;
+    while (x >= 1)
+    {
+      x /= 2;
+      k++;
+    }
+    while (x < 0.5)
+    {
+      x *= 2;
+      k--;
+    }
+    double z = (x - 1) / (x + 1), z2 = z * z, term = z, sum = 0;
+    for (int i = 1; i < 40; i += 2)
+    {
+      sum += term / i;
+      term *= z2;
+    }
+    return 2 * sum + k * LN2;
+  }
+
+  constexpr double pow(double x, double g) { return x <= 0 ? 0 : exp(g * log(x)); }
+
+  constexpr double PI = 3.14159265358979323846;
+
+  // cos(x)，x 在 [0, π] 内，泰勒展开
+  constexpr double cos(double x)
+  {
+    double x2 = x * x, sum = 1, term = 1;
+    for (int i = 2; i < 40; i += 2)
+    {
+      term *= -x2 / ((i - 1) * i);
+      sum += term;
+    }
+    return sum;
+  }
+} // namespace fast_diode_math
+
+// 线性，等同于不使用曲线
+struct CurveLinear
+{
+  static constexpr double apply(double x) { return x; }
+};
+
+// 幂函数伽马曲线，gamma = Num / Den
+template <int Num, int Den = 10>
+struct CurveGamma
+{
+  static constexpr double apply(double x) { return fast_diode_math::pow(x, double(Num) / Den); }
+};
+
+// 伽马 2.2
+using CurveGamma22 = CurveGamma<22, 10>;
+
+// CIE 1931 明度（L*）曲线，输入为感知亮度，输出为相对光强
+struct CurveCIE1931
+{
+  static constexpr double apply(double x)
+  {
+    double l = x * 100;
+    if (l <= 8)
+      return l / 903.3;
+    double t = (l + 16) / 116;
+    return t * t * t;
+  }
+};
+
+// 编译期生成的 (曲线, 分辨率) 查找表
+// 表长为 2^min(分辨率, 10)（最多 1024 项、2KB flash）；FastDiode 查表时在相邻两项之间线性插值，
+// 10位以上的分辨率由插值得到两项之间的每一个占空比，渐变不会在表项之间跳级
+template <typename Curve, uint8_t Resolution>
+struct FastDiodeCurve
+{
+  static_assert(Resolution >= 1 && Resolution <= 16, "curve tables support 1~16 bit duty resolution");
+
+  static constexpr uint8_t INDEX_BITS = Resolution < 10 ? Resolution : 10;
+  static constexpr size_t SIZE = size_t(1) << INDEX_BITS;
+  static constexpr uint32_t MAX_DUTY = (uint32_t(1) << Resolution) - 1;
+
+  struct Data
+  {
+    uint16_t values[SIZE];
+  };
+
+  static constexpr Data generate()
+  {
+    Data data{};
+    for (size_t i = 0; i < SIZE; i++)
+    {
+      double y = Curve::apply(double(i) / (SIZE - 1));
+      y = y < 0 ? 0 : (y > 1 ? 1 : y);
+      data.values[i] = static_cast<uint16_t>(y * MAX_DUTY + 0.5);
+    }
+    return data;
+  }
+
+  static constexpr Data data = generate();
+  static constexpr FastDiodeCurveTable table = {data.values, INDEX_BITS, Resolution};
+};
+
+template <typename Curve, uint8_t Resolution>
+constexpr typename FastDiodeCurve<Curve, Resolution>::Data FastDiodeCurve<Curve, Resolution>::data;
+template <typename Curve, uint8_t Resolution>
+constexpr FastDiodeCurveTable FastDiodeCurve<Curve, Resolution>::table;
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "FastDiodeCurve.h"
+
+// 缓动曲线
+// 渐亮、渐暗、呼吸灯和关键帧程序的每一段渐变都可以指定一条缓动曲线，作用在时间进度上：
+// 正弦呼吸灯比匀速的三角波自然得多，指数渐暗更接近白炽灯熄灭的样子。
+// 运行时只有整数运算，没有浮点，不带 FPU 的芯片（如 ESP32-C3）上同样便宜：
+// - 二次、三次和 smoothstep 直接用定点数多项式计算
+// - 正弦、指数和自定义曲线在编译期生成 257 项的查找表（放在flash中），运行时查表并线性插值
+// OUT 和 IN_OUT 由同一条 IN 曲线对称得到，每种曲线只需要一张表。
+//
+// 用法：
+//   led.breathing(2000, 255, EEasing::SINE_IN_OUT);
+//   led.fodeOff(1500, 255, EEasing::EXPO_OUT);
+//
+// 自定义曲线提供 static constexpr double apply(double x)，输入输出都是 0~1，必须单调不减：
+//   struct MyEase { static constexpr double apply(double x) { return x * x * x * x; } };
+//   led.setCustomEasing(&FastDiodeEasing<MyEase>::table);
+//   led.fodeOn(1000, 255, EEasing::CUSTOM);
+
+// 缓动曲线，作用在一段渐变的时间进度上
+// 数值写在关键帧程序 RAMP 的低4位中，已有的值不能改变
+enum class EEasing : uint8_t
+{
+  LINEAR = 0,   // 匀速
+  IN,           // 先慢后快（二次）
+  OUT,          // 先快后慢（二次）
+  IN_OUT,       // 两头慢中间快（二次）
+  CUBIC_IN,     // 三次
+  CUBIC_OUT,
+  CUBIC_IN_OUT,
+  SINE_IN,      // 正弦
+  SINE_OUT,
+  SINE_IN_OUT,
+  EXPO_IN,      // 指数
+  EXPO_OUT,
+  EXPO_IN_OUT,
+  SMOOTHSTEP,   // 3x² - 2x³
+  CUSTOM,       // 实例的自定义曲线，见 setCustomEasing()，没有设置时匀速
+
+  QUAD_IN = IN,
+  QUAD_OUT = OUT,
+  QUAD_IN_OUT = IN_OUT
+};
+
+// 缓动查找表描述，表长固定为 257 项（进度的高8位为下标，低8位插值），值为 0~65535
+struct FastDiodeEasingTable
+{
+  const uint16_t *data;
+};
+
+// 正弦：1 - cos(x·π/2)
+struct EaseSineIn
+{
+  static constexpr double apply(double x) { return 1 - fast_diode_math::cos(x * fast_diode_math::PI / 2); }
+};
+
+// 指数：(2^(10x) - 1) / 1023，起点和终点正好为 0 和 1
+struct EaseExpoIn
+{
+  static constexpr double apply(double x) { return (fast_diode_math::exp(10 * x * fast_diode_math::LN2) - 1) / 1023; }
+};
+
+// 编译期生成的缓动查找表
+template <typename Ease>
+struct FastDiodeEasing
+{
+  static constexpr size_t SIZE = 257;
+
+  struct Data
+  {
+    uint16_t values[SIZE];
+  };
+
+  static constexpr Data generate()
+  {
+    Data data{};
+    for (size_t i = 0; i < SIZE; i++)
+    {
+      double y = Ease::apply(double(i) / (SIZE - 1));
+      y = y < 0 ? 0 : (y > 1 ? 1 : y);
+      data.values[i] = static_cast<uint16_t>(y * 65535 + 0.5);
+    }
+    // 端点固定，渐变总是从起点开始、在终点结束
+    data.values[0] = 0;
+    data.values[SIZE - 1] = 65535;
+    return data;
+  }
+
+  static constexpr Data data = generate();
+  static constexpr FastDiodeEasingTable table = {data.values};
+};
+
+template <typename Ease>
+constexpr typename FastDiodeEasing<Ease>::Data FastDiodeEasing<Ease>::data;
+template <typename Ease>
+constexpr FastDiodeEasingTable FastDiodeEasing<Ease>::table;
+
+namespace fast_diode_easing
+{
+  // 查表并在相邻两项之间线性插值，输入输出都是 0~65536 的定点数
+  inline uint32_t lookup(const FastDiodeEasingTable *table, uint32_t x)
+  {
+    uint32_t index = x >> 8;
+    if (index >= 256)
+      return 65536;
+    int32_t low = table->data[index], high = table->data[index + 1];
+    uint32_t y = low + ((high - low) * (int32_t)(x & 0xff) >> 8);
+    // 0~65535 换算到 0~65536
+    return y + (y >> 15);
+  }
+
+  // 四种曲线的 IN 形式：0 二次，1 三次，2 正弦，3 指数
+  inline uint32_t easeIn(int shape, uint32_t x)
+  {
+    switch (shape)
+    {
+    case 0:
+      return (uint32_t)((uint64_t)x * x >> 16);
+    case 1:
+      return (uint32_t)((uint64_t)x * x * x >> 32);
+    case 2:
+      return lookup(&FastDiodeEasing<EaseSineIn>::table, x);
+    default:
+      return lookup(&FastDiodeEasing<EaseExpoIn>::table, x);
+    }
+  }
+} // namespace fast_diode_easing
+
+// 缓动后的进度，输入输出都是 0~65536 的定点数；custom 为 CUSTOM 使用的查找表
+inline uint32_t easeQ16(EEasing easing, uint32_t x, const FastDiodeEasingTable *custom = nullptr)
+{
+  using fast_diode_easing::easeIn;
+  uint8_t value = static_cast<uint8_t>(easing);
+  if (easing == EEasing::SMOOTHSTEP)
+    return (uint32_t)((uint64_t)x * x * (3 * 65536 - 2 * (uint64_t)x) >> 32);
+  if (easing == EEasing::CUSTOM)
+    return custom ? fast_diode_easing::lookup(custom, x) : x;
+  if (value == 0 || value > static_cast<uint8_t>(EEasing::EXPO_IN_OUT))
+    return x;
+
+  // OUT 是 IN 的中心对称，IN_OUT 前半段是压缩一半的 IN，后半段是压缩一半的 OUT
+  int shape = (value - 1) / 3;
+  switch ((value - 1) % 3)
+  {
+  case 0:
+    return easeIn(shape, x);
+  case 1:
+    return 65536 - easeIn(shape, 65536 - x);
+  default:
+    return x < 32768 ? easeIn(shape, 2 * x) / 2 : 65536 - easeIn(shape, 2 * (65536 - x)) / 2;
+  }
+}
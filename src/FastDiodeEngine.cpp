@@ -0,0 +1,152 @@
+#include "FastDiodeEngine.h"
+
+FastDiodeTimer FastDiodeEngine::timer;
+portMUX_TYPE FastDiodeEngine::lock = portMUX_INITIALIZER_UNLOCKED;
+FastDiode *FastDiodeEngine::instances = nullptr;
+FastDiode *FastDiodeEngine::activeHead = nullptr;
+FastDiode *volatile FastDiodeEngine::busy = nullptr;
+bool FastDiodeEngine::cancelled = false;
+
+#if FAST_DIODE_STATIC && FAST_DIODE_TIMER != FAST_DIODE_TIMER_STEADY_CLOCK && FAST_DIODE_TIMER != FAST_DIODE_TIMER_VIRTUAL
+// 调度任务的栈和控制块，不占用静态槽位，保证槽位用完的实例总能注册到调度任务
+static StackType_t engineStack[FAST_DIODE_STACK_SIZE];
+static StaticTask_t engineTcb;
+#endif
+
+void FastDiodeEngine::attach(FastDiode *led)
+{
+    portENTER_CRITICAL(&lock);
+    led->engineNext = instances;
+    instances = led;
+    portEXIT_CRITICAL(&lock);
+
+    if (!timer.started())
+#if FAST_DIODE_STATIC && FAST_DIODE_TIMER != FAST_DIODE_TIMER_STEADY_CLOCK && FAST_DIODE_TIMER != FAST_DIODE_TIMER_VIRTUAL
+        timer.start("FastDiodeEngine", service, nullptr, engineStack, FAST_DIODE_STACK_SIZE, &engineTcb);
+#else
+        timer.start("FastDiodeEngine", service, nullptr);
+#endif
+}
+
+void FastDiodeEngine::detach(FastDiode *led)
+{
+    portENTER_CRITICAL(&lock);
+    unschedule(led);
+    for (FastDiode **p = &instances; *p; p = &(*p)->engineNext)
+    {
+        if (*p == led)
+        {
+            *p = led->engineNext;
+            break;
+        }
+    }
+    if (busy == led)
+        cancelled = true;
+    portEXIT_CRITICAL(&lock);
+
+    // 调度任务可能正在执行这个实例，等它执行完这一步
+    while (busy == led)
+        vTaskDelay(1);
+}
+
+bool FastDiodeEngine::wake(FastDiode *led)
+{
+    led->pending.store(true, std::memory_order_release);
+    timer.notify();
+    return true;
+}
+
+void FastDiodeEngine::wakeFromISR(BaseType_t *woken)
+{
+    timer.notifyFromISR(woken);
+}
+
+bool FastDiodeEngine::wakeFromISR(FastDiode *led, BaseType_t *woken)
+{
+    led->pending.store(true, std::memory_order_release);
+    timer.notifyFromISR(woken);
+    return true;
+}
+
+void FastDiodeEngine::schedule(FastDiode *led, FastDiodeTime deadline)
+{
+    led->deadline = deadline;
+    FastDiode **p = &activeHead;
+    // 相同截止时间的实例排在后面，保证先到期的先执行
+    while (*p && (*p)->deadline <= deadline)
+        p = &(*p)->activeNext;
+    led->activeNext = *p;
+    *p = led;
+    led->active = true;
+}
+
+void FastDiodeEngine::unschedule(FastDiode *led)
+{
+    if (!led->active)
+        return;
+    for (FastDiode **p = &activeHead; *p; p = &(*p)->activeNext)
+    {
+        if (*p == led)
+        {
+            *p = led->activeNext;
+            break;
+        }
+    }
+    led->activeNext = nullptr;
+    led->active = false;
+}
+
+// 调度任务睡到最早的截止时间，没有活动实例时一直等待新命令
+FastDiodeTime FastDiodeEngine::service(void *)
+{
+    FastDiode::wakeupCount++;
+
+    FastDiodeTime now = FastDiode::now();
+
+    // 1.收到新命令或硬件渐变结束的实例立即执行
+    portENTER_CRITICAL(&lock);
+    for (FastDiode *led = instances; led; led = led->engineNext)
+    {
+        if (led->pending || (led->fadeDone && !led->active))
+        {
+            unschedule(led);
+            schedule(led, now);
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+
+    // 2.一次处理所有到期的实例
+    while (1)
+    {
+        portENTER_CRITICAL(&lock);
+        FastDiode *led = activeHead;
+        if (led == nullptr || led->deadline > now)
+        {
+            portEXIT_CRITICAL(&lock);
+            break;
+        }
+        unschedule(led);
+        busy = led;
+        portEXIT_CRITICAL(&lock);
+
+        // 新命令在调度任务中取走，避免在临界区内操作LEDC
+        // 先清标记再取命令：取命令期间到来的 wake() 重新置位，下一轮一定会再取一次
+        bool take = led->pending.exchange(false, std::memory_order_acquire);
+        bool running = led->process(now, take);
+
+        portENTER_CRITICAL(&lock);
+        // 执行期间实例可能已被注销，或者又收到了新命令（下一轮处理）
+        // 等待硬件渐变结束的实例不放回链表，由中断唤醒
+        // 按灯效给出的绝对时间排队，不会因为本次唤醒的延迟而累积误差
+        if (running && !cancelled && !led->pending && led->nextTime != TIME_NEVER)
+            schedule(led, led->nextTime);
+        busy = nullptr;
+        cancelled = false;
+        portEXIT_CRITICAL(&lock);
+    }
+
+    portENTER_CRITICAL(&lock);
+    FastDiodeTime deadline = activeHead ? activeHead->deadline : TIME_NEVER;
+    portEXIT_CRITICAL(&lock);
+    return deadline;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "FastDiode.h"
+
+// 共享调度任务
+// 所有注册的 FastDiode 实例由同一个任务驱动：活动实例按截止时间排序成链表，
+// 任务只睡到最早的截止时间，醒来后一次性处理所有到期的实例。
+// 相比每个实例一个任务，N 个LED只占用一个任务栈和一个TCB，且同一时刻到期的LED只需一次唤醒。
+class FastDiodeEngine
+{
+public:
+  // 注册实例，第一次注册时创建调度任务
+  static void attach(FastDiode *led);
+  // 注销实例，返回后调度任务不会再访问该实例
+  static void detach(FastDiode *led);
+  // 通知调度任务该实例有新命令
+  static bool wake(FastDiode *led);
+  // 在中断中唤醒调度任务（硬件渐变结束）
+  static void wakeFromISR(BaseType_t *woken);
+  // 在中断中通知调度任务该实例有新命令
+  static bool wakeFromISR(FastDiode *led, BaseType_t *woken);
+
+private:
+  static FastDiodeTimer timer;     // 调度任务
+  static portMUX_TYPE lock;        // 保护两个链表
+  static FastDiode *instances;     // 已注册实例链表
+  static FastDiode *activeHead;    // 按截止时间排序的活动实例链表
+  static FastDiode *volatile busy; // 调度任务正在执行的实例
+  static bool cancelled;           // 正在执行的实例已被注销，执行完不要再放回链表
+
+  // 调度任务执行一次：处理所有到期的实例，返回最早的截止时间
+  static FastDiodeTime service(void *);
+  // 按截止时间插入活动链表，调用前需持有 lock
+  static void schedule(FastDiode *led, FastDiodeTime deadline);
+  // 从活动链表中移除，调用前需持有 lock
+  static void unschedule(FastDiode *led);
+};
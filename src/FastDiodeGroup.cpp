@@ -0,0 +1,107 @@
+#include "FastDiodeGroup.h"
+#include "FastDiodeEngine.h"
+
+// 静态模式下组也占用一个槽位，槽位用完时组不会执行任何灯效
+FastDiodeGroup::FastDiodeGroup(const char *_name)
+{
+    timer.start(_name, service, this);
+}
+
+// 成员交还给原来的调度方式，唤醒一次，处理在组里期间收到的命令
+FastDiodeGroup::~FastDiodeGroup()
+{
+    timer.stop();
+    for (int i = 0; i < count; i++)
+    {
+        FastDiode *led = members[i].led;
+        led->batched = false;
+        if (!members[i].ownTask || !led->timer.start(led->name, FastDiode::service, led))
+            FastDiodeEngine::attach(led);
+        led->wake();
+    }
+}
+
+// 先停下成员自己的调度（独立任务或共享调度任务），再由组接管，任何时刻只有一个任务执行成员的灯效
+bool FastDiodeGroup::add(FastDiode &led, uint32_t phase)
+{
+    if (count >= FAST_DIODE_GROUP_MAX)
+        return false;
+    bool ownTask = led.timer.started();
+    if (ownTask)
+        led.timer.stop();
+    else
+        FastDiodeEngine::detach(&led);
+    // 不再接受直接写入，已经开始的直接写入等它写完
+    led.batched = true;
+    while (led.access.load(std::memory_order_acquire) & FastDiode::ACCESS_DIRECT)
+        vTaskDelay(1);
+    // 成员还没取走的命令在这里取走，之后由组的命令覆盖
+    led.takeCommands();
+    led.stopHwFade();
+    led.lastDuty = UINT32_MAX;
+    members[count] = {&led, (FastDiodeTime)phase * 1000, ownTask};
+    count++;
+    timer.notify();
+    return true;
+}
+
+// 组的命令全部进队列（固定亮度也是），保证每个成员看到相同的命令序列
+bool FastDiodeGroup::post(const FastDiodeCommand &cmd)
+{
+    if (!commands.post(cmd))
+        return 0;
+    timer.notify();
+    return 1;
+}
+
+bool FastDiodeGroup::sendNotify(EEffectType status, uint16_t level, uint32_t stepInterval, uint32_t totalDuration,
+                                uint32_t repeatCount, const uint8_t *program, EEasing easing)
+{
+    return post({status, level, status == EEffectType::BLINK ? stepInterval : totalDuration, repeatCount, program,
+                 defaultPriority(status, repeatCount), easing, false});
+}
+
+bool FastDiodeGroup::sendSwitch(bool on)
+{
+    return post({EEffectType::STATIC, on ? LEVEL_MAX : (uint16_t)0, 0, 0, nullptr, EEffectPriority::BACKGROUND,
+                 EEasing::LINEAR, true});
+}
+
+void FastDiodeGroup::apply(const FastDiodeCommand &cmd, FastDiodeTime now)
+{
+    for (int i = 0; i < count; i++)
+    {
+        FastDiode *led = members[i].led;
+        FastDiodeCommand member = cmd;
+        // open()/close()：与 FastDiode 相同，按成员的极性换算成亮度
+        if (cmd.polarized)
+            member.brightness = led->switchLevel(cmd.brightness != 0);
+        // 相位偏移：成员的灯效提前开始
+        led->setLayer(cmd.priority, led->decode(member, now - members[i].phase));
+    }
+}
+
+// 每帧：取出命令，所有成员按同一个时刻执行一步，再统一锁存
+FastDiodeTime FastDiodeGroup::service(void *_this)
+{
+    FastDiodeGroup *group = static_cast<FastDiodeGroup *>(_this);
+    group->wakeups++;
+    FastDiode::wakeupCount++;
+
+    FastDiodeTime now = FastDiode::now();
+    group->commands.drain([&](const FastDiodeCommand &cmd) { group->apply(cmd, now); },
+                          [&](uint16_t) {});
+
+    FastDiodeTime next = TIME_NEVER;
+    for (int i = 0; i < group->count; i++)
+    {
+        FastDiode *led = group->members[i].led;
+        bool running = led->run(now);
+        led->publishState(running);
+        if (running && led->nextTime < next)
+            next = led->nextTime;
+    }
+    for (int i = 0; i < group->count; i++)
+        group->members[i].led->latch();
+    return next;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "FastDiode.h"
+
+// 组内最多的LED数量
+#ifndef FAST_DIODE_GROUP_MAX
+#define FAST_DIODE_GROUP_MAX 8
+#endif
+
+// LED组
+// 组内所有成员由组的一个任务按同一个时钟驱动同一个灯效，可以为每个成员设置相位偏移（跑马灯、波浪）。
+// 每一帧先写入所有成员的占空比，再依次锁存，成员共用同一个LEDC定时器时在同一个PWM周期生效；
+// N 个LED每帧只唤醒一次，且相位严格对齐，不会像各自独立运行时那样逐渐错开。
+//
+// 用法：
+//   FastDiodeGroup bank("bank");
+//   bank.add(D4);
+//   bank.add(D5, 250); // D5 的相位超前 250ms
+//   bank.flickering(500, 2);
+//
+// 注意：加入后不要再单独调用成员的灯效函数，这些命令要等组析构、成员交还后才执行。
+// 组模式下只使用软件渐变；Arduino 下 ledcWrite 立即生效，没有统一锁存。
+class FastDiodeGroup : public FastDiodeEffects<FastDiodeGroup>
+{
+  friend class FastDiodeEffects<FastDiodeGroup>;
+
+public:
+  FastDiodeGroup(const char *_name = "group");
+  ~FastDiodeGroup();
+
+  /// @brief 加入成员，成员原来的灯效任务停止，由组的任务驱动，组析构时交还
+  /// @param led 成员，生命周期必须长于组
+  /// @param phase 相位偏移(ms)，成员的灯效比组超前这么久
+  /// @return 组已满时返回 false
+  bool add(FastDiode &led, uint32_t phase = 0);
+
+  /// @brief 组任务被唤醒的次数
+  uint32_t getWakeupCount() const { return wakeups; }
+
+  // 灯效函数与 FastDiode 相同，open()/close() 按每个成员的极性换算
+
+private:
+  struct Member
+  {
+    FastDiode *led;
+    FastDiodeTime phase; // 相位偏移(us)
+    bool ownTask;        // 加入前由自己的任务驱动（否则由共享调度任务驱动），离开组时恢复
+  };
+
+  Member members[FAST_DIODE_GROUP_MAX];
+  uint8_t count = 0;
+  FastDiodeTimer timer; // 组任务
+  FastDiodeChannel<> commands;
+  uint32_t wakeups = 0;
+
+  // 投递命令，所有成员使用相同的优先级规则
+  bool sendNotify(EEffectType status, uint16_t level, uint32_t stepInterval, uint32_t totalDuration, uint32_t repeatCount,
+                  const uint8_t *program, EEasing easing);
+  // 开关灯，亮度为 LEVEL_MAX/0 表示开/关，由 apply() 按成员的极性换算
+  bool sendSwitch(bool on);
+  // 把命令投递到组的队列
+  bool post(const FastDiodeCommand &cmd);
+  // 把命令应用到所有成员，所有成员使用同一个开始时间
+  void apply(const FastDiodeCommand &cmd, FastDiodeTime now);
+  // 组任务执行一次，返回最早到期的成员的下一步时间
+  static FastDiodeTime service(void *_this);
+};
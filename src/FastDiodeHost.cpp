@@ -0,0 +1,25 @@
+#ifdef FAST_DIODE_HOST
+
+#include "FastDiodeHost.h"
+
+std::vector<FastDiodeHostWrite> FastDiodeHost::log;
+std::mutex FastDiodeHost::mutex;
+bool FastDiodeHost::recording = true;
+uint64_t FastDiodeHost::count = 0;
+
+void FastDiodeHost::write(uint8_t pin, int channel, uint32_t duty)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    count++;
+    if (recording)
+        log.push_back({now(), pin, channel, duty});
+}
+
+void FastDiodeHost::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    log.clear();
+    count = 0;
+}
+
+#endif
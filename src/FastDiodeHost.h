@@ -0,0 +1,110 @@
+#pragma once
+
+// 主机（Linux/macOS）硬件抽象层，定义 FAST_DIODE_HOST 时使用
+// 不依赖 Arduino 和 idf：占空比写入只记录下来（带时间戳），时间由虚拟时钟给出，
+// 单线程按时间顺序执行所有灯效任务，10 分钟的呼吸灯在主机上几毫秒就能跑完。
+//
+// 用法：
+//   FastDiode led(12);
+//   led.init(LEDC_CHANNEL_0, 5000, 10);
+//   led.breathing(1000);
+//   FastDiodeHost::advance(600 * 1000000LL); // 执行 10 分钟
+//   for (auto &w : FastDiodeHost::writes()) ...
+//
+// 使用 FAST_DIODE_TIMER_STEADY_CLOCK 时改为每个任务一个线程、按真实时间运行，advance() 不再可用。
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FastDiodeTimer.h"
+
+using String = std::string;
+
+// 模拟的 LEDC 通道数，默认与 ESP32 的低速模式相同；性能测试需要给每个LED一个通道时可以增大，库和应用必须一致
+#ifndef FAST_DIODE_HOST_LEDC_CHANNELS
+#define FAST_DIODE_HOST_LEDC_CHANNELS 8
+#endif
+static_assert(FAST_DIODE_HOST_LEDC_CHANNELS >= 8, "FAST_DIODE_HOST_LEDC_CHANNELS must be at least 8");
+
+// LEDC 通道，取值与 idf 的 ledc_channel_t 相同
+typedef enum
+{
+  LEDC_CHANNEL_0 = 0,
+  LEDC_CHANNEL_1,
+  LEDC_CHANNEL_2,
+  LEDC_CHANNEL_3,
+  LEDC_CHANNEL_4,
+  LEDC_CHANNEL_5,
+  LEDC_CHANNEL_6,
+  LEDC_CHANNEL_7,
+  LEDC_CHANNEL_MAX = FAST_DIODE_HOST_LEDC_CHANNELS
+} ledc_channel_t;
+
+// LEDC 速度模式和定时器，主机上只模拟一个速度模式
+typedef enum
+{
+  LEDC_LOW_SPEED_MODE = 0,
+  LEDC_SPEED_MODE_MAX
+} ledc_mode_t;
+
+typedef enum
+{
+  LEDC_TIMER_0 = 0,
+  LEDC_TIMER_1,
+  LEDC_TIMER_2,
+  LEDC_TIMER_3,
+  LEDC_TIMER_MAX
+} ledc_timer_t;
+
+// 共享调度任务用到的 FreeRTOS 接口
+typedef int BaseType_t;
+#define pdFALSE 0
+#define pdTRUE 1
+typedef std::mutex portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portENTER_CRITICAL(mux) (mux)->lock()
+#define portEXIT_CRITICAL(mux) (mux)->unlock()
+#define vTaskDelay(ticks) std::this_thread::yield()
+
+// 一次占空比写入
+struct FastDiodeHostWrite
+{
+  FastDiodeTime time; // 写入时间(us)
+  uint8_t pin;        // 引脚
+  int channel;        // LEDC 通道，GPIO 模式为 -1
+  uint32_t duty;      // 占空比，GPIO 模式为 0/1
+};
+
+class FastDiodeHost
+{
+public:
+  // 当前时间(us)
+  static FastDiodeTime now() { return FastDiodeTimer::now(); }
+
+#if FAST_DIODE_TIMER == FAST_DIODE_TIMER_VIRTUAL
+  // 虚拟时钟前进 time 微秒，期间所有到期的灯效按时间顺序执行
+  static void advance(FastDiodeTime time) { FastDiodeTimer::runUntil(now() + time); }
+  // 执行已收到的命令，时钟不前进
+  static void flush() { FastDiodeTimer::runUntil(now()); }
+#endif
+
+  // 记录一次占空比写入，由 FastDiode 调用
+  static void write(uint8_t pin, int channel, uint32_t duty);
+
+  // 所有写入记录
+  static const std::vector<FastDiodeHostWrite> &writes() { return log; }
+  // 清空写入记录
+  static void clear();
+  // 是否记录写入，长时间运行只统计时可以关闭以节省内存
+  static void record(bool enable) { recording = enable; }
+  // 累计写入次数（关闭记录后仍然统计）
+  static uint64_t writeCount() { return count; }
+
+private:
+  static std::vector<FastDiodeHostWrite> log;
+  static std::mutex mutex;
+  static bool recording;
+  static uint64_t count;
+};
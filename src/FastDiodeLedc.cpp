@@ -0,0 +1,191 @@
+#include "FastDiode.h"
+
+#ifndef ARDUINO
+
+portMUX_TYPE FastDiodeLedc::lock = portMUX_INITIALIZER_UNLOCKED;
+FastDiodeLedc::Timer FastDiodeLedc::timers[LEDC_SPEED_MODE_MAX][LEDC_TIMER_MAX];
+FastDiodeLedc::Channel FastDiodeLedc::channels[LEDC_SPEED_MODE_MAX][LEDC_CHANNEL_MAX];
+
+// 可以使用的速度模式数，低速模式排在最前面
+// RC_FAST 时钟只有低速模式的定时器可以使用
+#if FAST_DIODE_PM_SLEEP_CLOCK
+static const int MODE_COUNT = 1;
+#else
+static const int MODE_COUNT = LEDC_SPEED_MODE_MAX;
+#endif
+
+// 第 i 个尝试的速度模式
+static int modeAt(int i) { return (LEDC_LOW_SPEED_MODE + i) % LEDC_SPEED_MODE_MAX; }
+
+int FastDiodeLedc::findTimer(int mode, uint32_t freq, uint8_t resolution, bool idle)
+{
+    for (int i = 0; i < LEDC_TIMER_MAX; i++)
+    {
+        const Timer &timer = timers[mode][i];
+        if (idle ? timer.users == 0 : timer.users && timer.freq == freq && timer.resolution == resolution)
+            return i;
+    }
+    return -1;
+}
+
+int FastDiodeLedc::findChannel(int mode)
+{
+    for (int i = 0; i < LEDC_CHANNEL_MAX; i++)
+    {
+        if (!channels[mode][i].used)
+            return i;
+    }
+    return -1;
+}
+
+bool FastDiodeLedc::reserve(int mode, int timer, int channel, uint32_t freq, uint8_t resolution, FastDiodeLedcSlot &slot)
+{
+    Timer &t = timers[mode][timer];
+    bool first = t.users == 0;
+    if (first)
+    {
+        t.freq = freq;
+        t.resolution = resolution;
+    }
+    t.users++;
+    channels[mode][channel].used = true;
+    channels[mode][channel].timer = timer;
+    slot.mode = static_cast<ledc_mode_t>(mode);
+    slot.timer = static_cast<ledc_timer_t>(timer);
+    slot.channel = static_cast<ledc_channel_t>(channel);
+    return first;
+}
+
+// 先在所有速度模式中找同配置的定时器，找不到再占用空闲的定时器，尽量少占用定时器
+ELedcError FastDiodeLedc::allocate(uint32_t freq, uint8_t resolution, FastDiodeLedcSlot &slot)
+{
+    ELedcError error = ELedcError::NO_CHANNEL;
+    portENTER_CRITICAL(&lock);
+    for (int idle = 0; idle < 2; idle++)
+    {
+        for (int i = 0; i < MODE_COUNT; i++)
+        {
+            int mode = modeAt(i);
+            int channel = findChannel(mode);
+            if (channel < 0)
+                continue;
+            int timer = findTimer(mode, freq, resolution, idle);
+            if (timer < 0)
+            {
+                error = ELedcError::NO_TIMER;
+                continue;
+            }
+            bool first = reserve(mode, timer, channel, freq, resolution, slot);
+            portEXIT_CRITICAL(&lock);
+            return configure(slot, first, freq, resolution);
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+    return error;
+}
+
+ELedcError FastDiodeLedc::claim(ledc_channel_t channel, uint32_t freq, uint8_t resolution, FastDiodeLedcSlot &slot)
+{
+    const int mode = LEDC_LOW_SPEED_MODE;
+    // ledc_channel_t 可能是无符号的枚举，按 int 比较才能拦住传入的负数
+    if (static_cast<int>(channel) < 0 || channel >= LEDC_CHANNEL_MAX)
+        return ELedcError::NO_CHANNEL;
+
+    portENTER_CRITICAL(&lock);
+    // 通道只属于一个实例：引脚和硬件渐变的中断回调都绑定在通道上，共用会改掉正在输出的LED
+    if (channels[mode][channel].used)
+    {
+        portEXIT_CRITICAL(&lock);
+        return ELedcError::CHANNEL_BUSY;
+    }
+    int timer = findTimer(mode, freq, resolution, false);
+    if (timer < 0)
+        timer = findTimer(mode, freq, resolution, true);
+    if (timer < 0)
+    {
+        portEXIT_CRITICAL(&lock);
+        return ELedcError::NO_TIMER;
+    }
+    bool first = reserve(mode, timer, channel, freq, resolution, slot);
+    portEXIT_CRITICAL(&lock);
+    return configure(slot, first, freq, resolution);
+}
+
+ELedcError FastDiodeLedc::configure(const FastDiodeLedcSlot &slot, bool first, uint32_t freq, uint8_t resolution)
+{
+    if (!first)
+        return ELedcError::NONE;
+#if !defined(FAST_DIODE_HOST)
+    const ledc_timer_config_t config = {
+        .speed_mode       = slot.mode,
+        .duty_resolution  = static_cast<ledc_timer_bit_t>(resolution),
+        .timer_num        = slot.timer,
+        .freq_hz          = freq,
+#if FAST_DIODE_PM_SLEEP_CLOCK
+        .clk_cfg          = LEDC_USE_RC_FAST_CLK,
+#else
+        .clk_cfg          = LEDC_AUTO_CLK,
+#endif
+        .deconfigure      = false
+    };
+    if (ledc_timer_config(&config) != ESP_OK)
+    {
+        portENTER_CRITICAL(&lock);
+        timers[slot.mode][slot.timer].users--;
+        channels[slot.mode][slot.channel].used = false;
+        portEXIT_CRITICAL(&lock);
+        return ELedcError::CONFIG;
+    }
+    // 定时器可能是上一批使用者释放时暂停的
+    ledc_timer_resume(slot.mode, slot.timer);
+#else
+    // 主机上只模拟分配，不配置定时器
+    (void)slot;
+    (void)freq;
+    (void)resolution;
+#endif
+    return ELedcError::NONE;
+}
+
+void FastDiodeLedc::release(const FastDiodeLedcSlot &slot)
+{
+    portENTER_CRITICAL(&lock);
+    Channel &c = channels[slot.mode][slot.channel];
+    bool stopped = false;
+    if (c.used)
+    {
+        c.used = false;
+        stopped = --timers[slot.mode][c.timer].users == 0;
+    }
+    portEXIT_CRITICAL(&lock);
+#if !defined(FAST_DIODE_HOST)
+    if (stopped)
+        ledc_timer_pause(slot.mode, slot.timer);
+#else
+    (void)stopped;
+#endif
+}
+
+int FastDiodeLedc::freeChannels()
+{
+    int count = 0;
+    portENTER_CRITICAL(&lock);
+    for (int i = 0; i < MODE_COUNT; i++)
+        for (int j = 0; j < LEDC_CHANNEL_MAX; j++)
+            count += !channels[modeAt(i)][j].used;
+    portEXIT_CRITICAL(&lock);
+    return count;
+}
+
+int FastDiodeLedc::freeTimers()
+{
+    int count = 0;
+    portENTER_CRITICAL(&lock);
+    for (int i = 0; i < MODE_COUNT; i++)
+        for (int j = 0; j < LEDC_TIMER_MAX; j++)
+            count += timers[modeAt(i)][j].users == 0;
+    portEXIT_CRITICAL(&lock);
+    return count;
+}
+
+#endif
@@ -0,0 +1,77 @@
+#pragma once
+
+#if defined(FAST_DIODE_HOST)
+#include "FastDiodeHost.h"
+#else
+#include "freertos/FreeRTOS.h"
+#include "driver/ledc.h"
+#endif
+
+// LEDC 资源管理
+// 所有实例的 LEDC 通道和定时器由这里统一分配：
+// - 频率和分辨率相同的LED共用一个定时器，定时器只在第一个使用者分配时配置，之后不会被重新配置，已经在输出的LED不会闪烁
+// - 自动分配时先找同配置的定时器，没有再占用空闲的定时器；低速模式的通道或定时器用完后再使用高速模式（仅 ESP32 有）
+// - 资源用完时返回具体原因，不会覆盖其他LED的配置
+// - 定时器的最后一个使用者释放后暂停，可以按新的配置重新分配
+// 主机上按 8 个通道（FAST_DIODE_HOST_LEDC_CHANNELS）、4 个定时器、一个速度模式模拟分配过程，不访问硬件。
+// 分配通常在启动时调用，配置定时器时不持有锁，不要在多个任务中同时初始化同一个频率的LED。
+
+// 分配失败的原因
+enum class ELedcError : uint8_t
+{
+  NONE = 0,     // 成功
+  NO_CHANNEL,   // 所有速度模式的通道都已占用
+  NO_TIMER,     // 有空闲通道，但没有频率和分辨率相同的定时器，也没有空闲的定时器
+  CHANNEL_BUSY, // 指定的通道已被其他LED占用
+  CONFIG        // LEDC 拒绝了这个配置，例如频率 × 2^分辨率 超过了时钟频率
+};
+
+// 分配到的 LEDC 资源
+struct FastDiodeLedcSlot
+{
+  ledc_mode_t mode = LEDC_LOW_SPEED_MODE; // 速度模式
+  ledc_timer_t timer = LEDC_TIMER_0;      // 定时器
+  ledc_channel_t channel = LEDC_CHANNEL_0; // 通道
+};
+
+class FastDiodeLedc
+{
+public:
+  // 自动分配一个通道，并为它找一个 (freq, resolution) 相同的定时器或配置一个空闲的定时器
+  static ELedcError allocate(uint32_t freq, uint8_t resolution, FastDiodeLedcSlot &slot);
+  // 使用指定的低速模式通道，通道已被占用时返回 CHANNEL_BUSY；只有定时器可以共用
+  static ELedcError claim(ledc_channel_t channel, uint32_t freq, uint8_t resolution, FastDiodeLedcSlot &slot);
+  // 释放通道，定时器的最后一个使用者释放时暂停定时器
+  static void release(const FastDiodeLedcSlot &slot);
+
+  // 空闲的通道数（所有速度模式）
+  static int freeChannels();
+  // 空闲的定时器数（所有速度模式）
+  static int freeTimers();
+
+private:
+  struct Timer
+  {
+    uint32_t freq = 0;      // 频率(Hz)
+    uint8_t resolution = 0; // 分辨率（位）
+    uint16_t users = 0;     // 使用它的通道数，为 0 时空闲
+  };
+  struct Channel
+  {
+    bool used = false; // 是否已被某个实例占用
+    uint8_t timer = 0; // 绑定的定时器
+  };
+
+  static portMUX_TYPE lock;
+  static Timer timers[LEDC_SPEED_MODE_MAX][LEDC_TIMER_MAX];
+  static Channel channels[LEDC_SPEED_MODE_MAX][LEDC_CHANNEL_MAX];
+
+  // 在 mode 中找一个 (freq, resolution) 相同的定时器，idle 为 true 时改为找空闲的，没有时返回 -1；调用前需持有 lock
+  static int findTimer(int mode, uint32_t freq, uint8_t resolution, bool idle);
+  // 在 mode 中找一个空闲通道，没有时返回 -1；调用前需持有 lock
+  static int findChannel(int mode);
+  // 占用通道和定时器，返回定时器是否是第一次使用、需要配置；调用前需持有 lock
+  static bool reserve(int mode, int timer, int channel, uint32_t freq, uint8_t resolution, FastDiodeLedcSlot &slot);
+  // 配置新占用的定时器，失败时撤销占用
+  static ELedcError configure(const FastDiodeLedcSlot &slot, bool first, uint32_t freq, uint8_t resolution);
+};
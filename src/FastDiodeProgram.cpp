@@ -0,0 +1,81 @@
+#include "FastDiodeProgram.h"
+
+using namespace fast_diode_program;
+
+// 连续执行这么多条不占时间的指令仍没有进入有时长的关键帧（例如空的无限循环），视为程序结束
+static const int MAX_INSTANT_STEPS = 256;
+
+static uint16_t read16(const uint8_t *p) { return p[0] | p[1] << 8; }
+static uint32_t read24(const uint8_t *p) { return p[0] | p[1] << 8 | (uint32_t)p[2] << 16; }
+
+void FastDiodeProgramState::begin(const uint8_t *_code, uint16_t _level, FastDiodeTime _start)
+{
+    code = _code;
+    start = _start;
+    pc = 0;
+    level = _level;
+    depth = 0;
+}
+
+bool FastDiodeProgramState::seek(FastDiodeTime now, FastDiodeSegment &segment)
+{
+    int instant = 0;
+    while (code && instant < MAX_INSTANT_STEPS)
+    {
+        const uint8_t *p = code + pc;
+        uint8_t op = p[0] & 0xf0;
+
+        if (op == OP_RAMP || op == OP_HOLD)
+        {
+            bool isRamp = op == OP_RAMP;
+            uint16_t target = isRamp ? read16(p + 1) : level;
+            FastDiodeTime duration = (FastDiodeTime)read24(p + (isRamp ? 3 : 1)) * 1000;
+            if (now < start + duration)
+            {
+                segment = {level, target, start, duration, isRamp ? static_cast<EEasing>(p[0] & 0x0f) : EEasing::LINEAR};
+                return true;
+            }
+            // 这一段已经结束，从它的结束时间开始下一段
+            level = target;
+            start += duration;
+            pc += isRamp ? 6 : 4;
+            instant = duration ? 0 : instant + 1;
+            continue;
+        }
+
+        instant++;
+        if (op == OP_SET)
+        {
+            level = read16(p + 1);
+            pc += 3;
+        }
+        else if (op == OP_LOOP)
+        {
+            // 嵌套超过上限的程序无法正确执行，直接结束
+            if (depth >= FAST_DIODE_PROGRAM_DEPTH)
+                break;
+            loops[depth++] = {static_cast<uint16_t>(pc + 3), read16(p + 1)};
+            pc += 3;
+        }
+        else if (op == OP_NEXT)
+        {
+            if (depth == 0)
+                break;
+            LoopFrame &loop = loops[depth - 1];
+            if (loop.left == 0 || --loop.left > 0)
+                pc = loop.body;
+            else
+            {
+                depth--;
+                pc += 1;
+            }
+        }
+        else // OP_END 或无法识别的指令
+            break;
+    }
+
+    // 程序结束，保持最后的亮度
+    code = nullptr;
+    segment = {level, level, start, 0, EEasing::LINEAR};
+    return false;
+}
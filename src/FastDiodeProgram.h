@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "FastDiodeEasing.h"
+#include "FastDiodeTimer.h"
+
+// 关键帧时间线
+// 把「300ms 渐变到 40%，保持 2 秒，闪 3 次，然后一直呼吸」这样的多段灯效编译成一段只读的字节程序，
+// 由灯效任务解释执行：不需要应用层 vTaskDelay，每一步不分配内存，只在输出变化时唤醒。
+//
+// 用法（constexpr 定义的程序放在flash中）：
+//   static constexpr auto lamp = makeProgram(
+//       keyframe::Ramp(toLevel(102), 300),
+//       keyframe::Hold(2000),
+//       keyframe::Loop(3), keyframe::Set(LEVEL_MAX), keyframe::Hold(250), keyframe::Set(0), keyframe::Hold(250), keyframe::Next(),
+//       keyframe::Loop(), keyframe::Ramp(LEVEL_MAX, 1000, EEasing::IN_OUT), keyframe::Ramp(0, 1000, EEasing::IN_OUT), keyframe::Next());
+//   led.play(lamp);
+//
+// 字节格式（多字节数均为小端）：
+//   SET   [op] [亮度 2B]                     立即设定亮度
+//   RAMP  [op|缓动] [亮度 2B] [时间(ms) 3B]   从当前亮度渐变到目标亮度
+//   HOLD  [op] [时间(ms) 3B]                 保持当前亮度
+//   LOOP  [op] [次数 2B]                     循环开始，次数为 0 时无限循环
+//   NEXT  [op]                               循环结束，回到对应的 LOOP 之后
+//   END   [op]                               程序结束，保持最后的亮度
+
+// 循环最多嵌套的层数
+#ifndef FAST_DIODE_PROGRAM_DEPTH
+#define FAST_DIODE_PROGRAM_DEPTH 3
+#endif
+
+namespace fast_diode_program
+{
+  // 操作码在高4位，RAMP 的低4位为缓动
+  enum Op : uint8_t
+  {
+    OP_END = 0x00,
+    OP_SET = 0x10,
+    OP_RAMP = 0x20,
+    OP_HOLD = 0x30,
+    OP_LOOP = 0x40,
+    OP_NEXT = 0x50
+  };
+
+  const uint32_t MAX_TIME = 0xffffff; // 3字节时间的上限（约4.6小时）
+
+  constexpr uint8_t byte(uint32_t value, int index) { return static_cast<uint8_t>(value >> (index * 8)); }
+} // namespace fast_diode_program
+
+// 关键帧，每种关键帧知道自己编码后的长度
+namespace keyframe
+{
+  // 立即设定亮度（16位）
+  struct Set
+  {
+    static constexpr size_t SIZE = 3;
+    uint16_t level;
+    constexpr explicit Set(uint16_t _level) : level(_level) {}
+    constexpr void write(uint8_t *p) const
+    {
+      p[0] = fast_diode_program::OP_SET;
+      p[1] = fast_diode_program::byte(level, 0);
+      p[2] = fast_diode_program::byte(level, 1);
+    }
+  };
+
+  // 在 time 毫秒内渐变到 level
+  struct Ramp
+  {
+    static constexpr size_t SIZE = 6;
+    uint16_t level;
+    uint32_t time;
+    EEasing easing;
+    constexpr Ramp(uint16_t _level, uint32_t _time, EEasing _easing = EEasing::LINEAR)
+        : level(_level), time(_time), easing(_easing) {}
+    constexpr void write(uint8_t *p) const
+    {
+      p[0] = fast_diode_program::OP_RAMP | static_cast<uint8_t>(easing);
+      p[1] = fast_diode_program::byte(level, 0);
+      p[2] = fast_diode_program::byte(level, 1);
+      p[3] = fast_diode_program::byte(time, 0);
+      p[4] = fast_diode_program::byte(time, 1);
+      p[5] = fast_diode_program::byte(time, 2);
+    }
+  };
+
+  // 保持当前亮度 time 毫秒
+  struct Hold
+  {
+    static constexpr size_t SIZE = 4;
+    uint32_t time;
+    constexpr explicit Hold(uint32_t _time) : time(_time) {}
+    constexpr void write(uint8_t *p) const
+    {
+      p[0] = fast_diode_program::OP_HOLD;
+      p[1] = fast_diode_program::byte(time, 0);
+      p[2] = fast_diode_program::byte(time, 1);
+      p[3] = fast_diode_program::byte(time, 2);
+    }
+  };
+
+  // 循环开始，count 为 0 时无限循环
+  struct Loop
+  {
+    static constexpr size_t SIZE = 3;
+    uint16_t count;
+    constexpr explicit Loop(uint16_t _count = 0) : count(_count) {}
+    constexpr void write(uint8_t *p) const
+    {
+      p[0] = fast_diode_program::OP_LOOP;
+      p[1] = fast_diode_program::byte(count, 0);
+      p[2] = fast_diode_program::byte(count, 1);
+    }
+  };
+
+  // 循环结束
+  struct Next
+  {
+    static constexpr size_t SIZE = 1;
+    constexpr void write(uint8_t *p) const { p[0] = fast_diode_program::OP_NEXT; }
+  };
+} // namespace keyframe
+
+// 编译好的程序，末尾带 END
+template <size_t N>
+struct FastDiodeProgram
+{
+  uint8_t bytes[N];
+};
+
+namespace fast_diode_program
+{
+  template <typename... Keys>
+  constexpr size_t programSize()
+  {
+    size_t sizes[] = {0, Keys::SIZE...};
+    size_t total = 1; // END
+    for (size_t size : sizes)
+      total += size;
+    return total;
+  }
+} // namespace fast_diode_program
+
+// 把关键帧编译成字节程序，可以在编译期求值
+template <typename... Keys>
+constexpr FastDiodeProgram<fast_diode_program::programSize<Keys...>()> makeProgram(Keys... keys)
+{
+  FastDiodeProgram<fast_diode_program::programSize<Keys...>()> program{};
+  size_t pos = 0;
+  int expand[] = {0, (keys.write(program.bytes + pos), pos += Keys::SIZE, 0)...};
+  (void)expand;
+  program.bytes[pos] = fast_diode_program::OP_END;
+  return program;
+}
+
+// 当前所在的一段关键帧
+struct FastDiodeSegment
+{
+  uint16_t from;          // 起始亮度
+  uint16_t to;            // 结束亮度
+  FastDiodeTime start;    // 开始时间(us)
+  FastDiodeTime duration; // 持续时间(us)
+  EEasing easing;         // 缓动
+};
+
+// 程序的执行位置，保存在 LEDState 中，随灯效状态一起保存和恢复
+class FastDiodeProgramState
+{
+public:
+  // 从 start 时刻、亮度 level 开始执行 code
+  void begin(const uint8_t *code, uint16_t level, FastDiodeTime start);
+  // 跳过 now 之前已经结束的关键帧，给出 now 所在的一段
+  // 每段的开始时间都由上一段的结束时间累加，唤醒延迟不会累积误差
+  // 返回：false - 程序已结束，segment.to 为最后的亮度
+  bool seek(FastDiodeTime now, FastDiodeSegment &segment);
+
+private:
+  struct LoopFrame
+  {
+    uint16_t body; // 循环体开始的位置
+    uint16_t left; // 剩余次数，0 表示无限循环
+  };
+
+  const uint8_t *code = nullptr;
+  FastDiodeTime start = 0; // 当前关键帧的开始时间
+  uint16_t pc = 0;         // 当前关键帧的位置
+  uint16_t level = 0;      // 当前关键帧开始时的亮度
+  uint8_t depth = 0;       // 循环嵌套层数
+  LoopFrame loops[FAST_DIODE_PROGRAM_DEPTH];
+};
@@ -0,0 +1,269 @@
+#include "FastDiodeSoftPwm.h"
+
+int FastDiodePwmSchedule::add(FastDiodePinMask pins)
+{
+    for (int i = 0; i < FAST_DIODE_SOFT_PWM_CHANNELS; i++)
+    {
+        if (channels[i].pins)
+            continue;
+        channels[i].pins = pins;
+        channels[i].width = 0;
+        // 点亮时间为 0，排在最前面
+        for (uint8_t j = used; j > 0; j--)
+            order[j] = order[j - 1];
+        order[0] = i;
+        used++;
+        return i;
+    }
+    return -1;
+}
+
+void FastDiodePwmSchedule::remove(int channel)
+{
+    uint8_t pos = 0;
+    while (pos < used && order[pos] != channel)
+        pos++;
+    if (pos == used)
+        return;
+    for (; pos + 1 < used; pos++)
+        order[pos] = order[pos + 1];
+    used--;
+    channels[channel].pins = 0;
+    channels[channel].width = 0;
+}
+
+bool FastDiodePwmSchedule::setWidth(int channel, uint32_t width)
+{
+    if (width > period)
+        width = period;
+    if (channels[channel].width == width)
+        return false;
+    channels[channel].width = width;
+    uint8_t pos = 0;
+    while (order[pos] != channel)
+        pos++;
+    place(pos);
+    return true;
+}
+
+void FastDiodePwmSchedule::place(uint8_t pos)
+{
+    uint8_t channel = order[pos];
+    uint32_t width = channels[channel].width;
+    for (; pos > 0 && channels[order[pos - 1]].width > width; pos--)
+        order[pos] = order[pos - 1];
+    for (; pos + 1 < used && channels[order[pos + 1]].width < width; pos++)
+        order[pos] = order[pos + 1];
+    order[pos] = channel;
+}
+
+// 按点亮时间从小到大扫描一遍：点亮时间为 0 的只在周期开始时熄灭，一直点亮的没有边沿，
+// 其余的在点亮时间处熄灭，与前一个边沿相差不到 minGap 时合并进去
+void FastDiodePwmSchedule::build(FastDiodePwmFrame &frame) const
+{
+    frame.set = 0;
+    frame.off = 0;
+    frame.count = 0;
+    for (uint8_t i = 0; i < used; i++)
+    {
+        const Channel &channel = channels[order[i]];
+        if (channel.width == 0)
+        {
+            frame.off |= channel.pins;
+            continue;
+        }
+        frame.set |= channel.pins;
+        if (channel.width >= period)
+            continue;
+        if (frame.count && channel.width - frame.edges[frame.count - 1].time < minGap)
+            frame.edges[frame.count - 1].clear |= channel.pins;
+        else
+            frame.edges[frame.count++] = {channel.width, channel.pins};
+    }
+}
+
+#ifndef ARDUINO
+
+#if !defined(FAST_DIODE_HOST)
+#include "soc/soc.h"
+#include "soc/soc_caps.h"
+#include "soc/gpio_reg.h"
+#endif
+
+#if defined(FAST_DIODE_HOST)
+#define DRAM_ATTR
+#endif
+
+// PWM周期(us)
+static const uint32_t PERIOD = 1000000 / FAST_DIODE_SOFT_PWM_FREQ;
+
+// 中断读写的数据都放在内部RAM中（DRAM_ATTR），flash 写入（例如断电记忆的 NVS 提交）期间中断照常运行
+portMUX_TYPE FastDiodeSoftPwm::lock = portMUX_INITIALIZER_UNLOCKED;
+FastDiodePwmSchedule FastDiodeSoftPwm::schedule(PERIOD, FAST_DIODE_SOFT_PWM_MIN_GAP);
+DRAM_ATTR FastDiodePwmFrame FastDiodeSoftPwm::frames[3];
+DRAM_ATTR uint8_t FastDiodeSoftPwm::reading = 0;
+DRAM_ATTR uint8_t FastDiodeSoftPwm::latest = 1;
+uint8_t FastDiodeSoftPwm::writing = 2;
+DRAM_ATTR volatile bool FastDiodeSoftPwm::fresh = false;
+DRAM_ATTR volatile uint32_t FastDiodeSoftPwm::interrupts = 0;
+
+#if !defined(FAST_DIODE_HOST)
+gptimer_handle_t FastDiodeSoftPwm::timer = nullptr;
+DRAM_ATTR volatile bool FastDiodeSoftPwm::running = false;
+DRAM_ATTR uint64_t FastDiodeSoftPwm::periodStart = 0;
+DRAM_ATTR uint8_t FastDiodeSoftPwm::edge = 0;
+#endif
+
+int FastDiodeSoftPwm::attach(uint8_t pin)
+{
+#if !defined(FAST_DIODE_HOST)
+    // 第一次注册时创建定时器，之后一直运行；没有点亮的引脚时不设置报警，不产生中断
+    static const bool ready = [] {
+        const gptimer_config_t config = {
+            .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+            .direction = GPTIMER_COUNT_UP,
+            .resolution_hz = 1000000,
+        };
+        ESP_ERROR_CHECK(gptimer_new_timer(&config, &timer));
+        const gptimer_event_callbacks_t callbacks = {
+            .on_alarm = onAlarm
+        };
+        ESP_ERROR_CHECK(gptimer_register_event_callbacks(timer, &callbacks, nullptr));
+        ESP_ERROR_CHECK(gptimer_enable(timer));
+        ESP_ERROR_CHECK(gptimer_start(timer));
+        return true;
+    }();
+    (void)ready;
+#endif
+    portENTER_CRITICAL(&lock);
+    int channel = schedule.add((FastDiodePinMask)1 << pin);
+    portEXIT_CRITICAL(&lock);
+    return channel;
+}
+
+void FastDiodeSoftPwm::detach(int channel)
+{
+    write(channel, 0, 1);
+#if !defined(FAST_DIODE_HOST)
+    // 等中断换上熄灭这个引脚的表，之后的表中不再有它
+    while (fresh && running)
+        vTaskDelay(1);
+#endif
+    portENTER_CRITICAL(&lock);
+    schedule.remove(channel);
+    publish();
+    portEXIT_CRITICAL(&lock);
+}
+
+void FastDiodeSoftPwm::write(int channel, uint32_t duty, uint32_t maxDuty)
+{
+    uint32_t width = schedule.toWidth(duty, maxDuty);
+    portENTER_CRITICAL(&lock);
+    if (schedule.setWidth(channel, width))
+        publish();
+    portEXIT_CRITICAL(&lock);
+}
+
+// 三缓冲：新表生成在 writing 中，再与 latest 交换；中断在周期开始时把 latest 换成自己正在用的表
+// 生成和交换都在 lock 中，中断换表时也持有 lock，不会换到正在生成的表
+void FastDiodeSoftPwm::publish()
+{
+    schedule.build(frames[writing]);
+    uint8_t built = writing;
+    writing = latest;
+    latest = built;
+    fresh = true;
+#if !defined(FAST_DIODE_HOST)
+    // 中断已停止，且新表有要写的引脚：从现在开始一个新周期
+    if (!running && (frames[latest].set || frames[latest].off))
+    {
+        uint64_t count = 0;
+        gptimer_get_raw_count(timer, &count);
+        running = true;
+        periodStart = count - PERIOD;
+        edge = frames[reading].count;
+        const gptimer_alarm_config_t alarm = {
+            .alarm_count = count + 1,
+        };
+        gptimer_set_alarm_action(timer, &alarm);
+    }
+#endif
+}
+
+#if !defined(FAST_DIODE_HOST)
+
+void IRAM_ATTR FastDiodeSoftPwm::setPins(FastDiodePinMask pins)
+{
+    if ((uint32_t)pins)
+        REG_WRITE(GPIO_OUT_W1TS_REG, (uint32_t)pins);
+#if SOC_GPIO_PIN_COUNT > 32
+    if (pins >> 32)
+        REG_WRITE(GPIO_OUT1_W1TS_REG, (uint32_t)(pins >> 32));
+#endif
+}
+
+void IRAM_ATTR FastDiodeSoftPwm::clearPins(FastDiodePinMask pins)
+{
+    if ((uint32_t)pins)
+        REG_WRITE(GPIO_OUT_W1TC_REG, (uint32_t)pins);
+#if SOC_GPIO_PIN_COUNT > 32
+    if (pins >> 32)
+        REG_WRITE(GPIO_OUT1_W1TC_REG, (uint32_t)(pins >> 32));
+#endif
+}
+
+// 相差不到 MIN_GAP 的边沿在这一次中断中一起执行，不再为它们单独设置报警
+// 中断和它调用的函数都在 IRAM 中，不访问 flash 中的代码和常量
+bool IRAM_ATTR FastDiodeSoftPwm::onAlarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *event, void *arg)
+{
+    interrupts++;
+    const uint32_t period = PERIOD;
+    uint64_t now = event->count_value + FAST_DIODE_SOFT_PWM_MIN_GAP;
+    uint64_t at;
+    while (1)
+    {
+        const FastDiodePwmFrame &frame = frames[reading];
+        if (edge < frame.count)
+        {
+            at = periodStart + frame.edges[edge].time;
+            if (at > now)
+                break;
+            clearPins(frame.edges[edge].clear);
+            edge++;
+            continue;
+        }
+
+        // 这张表的边沿都执行完了，等这个周期结束
+        at = periodStart + period;
+        if (at > now)
+            break;
+        portENTER_CRITICAL_ISR(&lock);
+        if (fresh)
+        {
+            uint8_t newest = latest;
+            latest = reading;
+            reading = newest;
+            fresh = false;
+        }
+        const FastDiodePwmFrame &next = frames[reading];
+        clearPins(next.off);
+        setPins(next.set);
+        // 没有点亮的引脚，停止中断，直到再次写入
+        if (!next.set)
+            running = false;
+        portEXIT_CRITICAL_ISR(&lock);
+        if (!next.set)
+            return false;
+        // 中断被长时间屏蔽而落后超过一个周期时从现在重新开始，不补错过的周期
+        periodStart = now - at >= period ? event->count_value : at;
+        edge = 0;
+    }
+    const gptimer_alarm_config_t alarm = {
+        .alarm_count = at,
+    };
+    gptimer_set_alarm_action(timer, &alarm);
+    return false;
+}
+
+#endif
+#endif
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstdint>
+
+// 软件PWM
+// 没有调用 init() 的 GPIO 模式只能输出高低电平，除闪烁以外的灯效都退化成开关；LEDC 通道也只有 6~8 个。
+// 软件PWM用一个高精度定时器同时驱动多个 GPIO：
+// - 每个PWM周期开始时用一次 W1TS 写入点亮所有占空比非 0 的引脚
+// - 之后按排好序的边沿表，在每个边沿时刻用一次 W1TC 写入熄灭一组引脚，同一时刻的边沿合并成一次写入
+// - 每个周期最多 边沿数+1 次中断，每次中断只写一到两个寄存器，与引脚数无关（有引脚号 >= 32 时多写一个）
+// 边沿表只在某个通道的占空比变化时重建：把这个通道移到排序中的新位置，再顺序生成一遍表。
+// 新表交给中断使用，中断只在周期开始时换表，一个周期内的输出总是来自同一张表。
+//
+// 用法：
+//   FastDiode led(4);
+//   led.initSoftPwm();   // 代替 init()，不占用 LEDC 通道
+//   led.breathing(1000);
+//
+// 边沿表的生成（FastDiodePwmSchedule）不依赖硬件，可以在主机上测试。
+
+// 软件PWM最多驱动的LED数
+#ifndef FAST_DIODE_SOFT_PWM_CHANNELS
+#define FAST_DIODE_SOFT_PWM_CHANNELS 16
+#endif
+
+// 软件PWM频率(Hz)，所有软件PWM的LED共用
+#ifndef FAST_DIODE_SOFT_PWM_FREQ
+#define FAST_DIODE_SOFT_PWM_FREQ 200
+#endif
+
+// 两个边沿的最小间隔(us)，小于它的边沿合并到前一个，避免中断来不及响应
+// 合并会让后一组引脚的点亮时间最多缩短这么多
+#ifndef FAST_DIODE_SOFT_PWM_MIN_GAP
+#define FAST_DIODE_SOFT_PWM_MIN_GAP 4
+#endif
+
+// 引脚位图，bit n 为 GPIOn
+typedef uint64_t FastDiodePinMask;
+
+// 边沿：周期开始后 time 时刻熄灭 clear 中的引脚
+struct FastDiodePwmEdge
+{
+  uint32_t time;          // 相对周期开始的时间(us)
+  FastDiodePinMask clear; // 这一时刻熄灭的引脚
+};
+
+// 一个PWM周期的输出表，中断只读它
+struct FastDiodePwmFrame
+{
+  FastDiodePinMask set = 0; // 周期开始时点亮的引脚
+  FastDiodePinMask off = 0; // 周期开始时熄灭的引脚（点亮时间为 0），一直点亮的引脚没有边沿，改为 0 时靠它熄灭
+  uint8_t count = 0;        // 边沿数
+  FastDiodePwmEdge edges[FAST_DIODE_SOFT_PWM_CHANNELS] = {};
+};
+
+// 边沿表生成器
+// 每个通道有一组引脚和一个点亮时间（0~周期），通道按点亮时间从小到大排序；
+// 修改一个通道只移动它在排序中的位置（插入排序的一步），生成表时顺序扫描一遍。
+class FastDiodePwmSchedule
+{
+public:
+  // period 周期(us)，minGap 两个边沿的最小间隔(us)，至少为 1，即同一时刻的边沿总是合并
+  // 构造函数是 constexpr，静态实例在任何构造函数执行前就已初始化
+  constexpr FastDiodePwmSchedule(uint32_t _period, uint32_t _minGap = 1)
+      : period(_period), minGap(_minGap > 1 ? _minGap : 1) {}
+
+  // 增加一个通道，点亮时间为 0，返回通道号，通道用完时返回 -1
+  int add(FastDiodePinMask pins);
+  // 删除通道，删除前应先把点亮时间设为 0，让引脚在这个周期结束时熄灭
+  void remove(int channel);
+  // 设置通道的点亮时间(us)，不小于周期时一直点亮
+  // 返回：false - 点亮时间没有变化，不需要重新生成表
+  bool setWidth(int channel, uint32_t width);
+  // 占空比换算成点亮时间，maxDuty 对应一直点亮
+  uint32_t toWidth(uint32_t duty, uint32_t maxDuty) const
+  {
+    return maxDuty ? ((uint64_t)duty * period + maxDuty / 2) / maxDuty : 0;
+  }
+  // 生成一个周期的输出表
+  void build(FastDiodePwmFrame &frame) const;
+
+  uint32_t getPeriod() const { return period; }
+  uint32_t getWidth(int channel) const { return channels[channel].width; }
+  // 正在使用的通道数
+  uint8_t size() const { return used; }
+
+private:
+  struct Channel
+  {
+    FastDiodePinMask pins = 0; // 为 0 表示通道空闲
+    uint32_t width = 0;        // 点亮时间(us)
+  };
+
+  uint32_t period;
+  uint32_t minGap;
+  Channel channels[FAST_DIODE_SOFT_PWM_CHANNELS];
+  uint8_t order[FAST_DIODE_SOFT_PWM_CHANNELS] = {}; // 正在使用的通道，按点亮时间从小到大
+  uint8_t used = 0;
+
+  // 把 order[pos] 向前或向后移到正确的位置，其余部分已经有序
+  void place(uint8_t pos);
+};
+
+#ifndef ARDUINO
+
+#if defined(FAST_DIODE_HOST)
+#include "FastDiodeHost.h"
+#else
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gptimer.h"
+#endif
+
+// 软件PWM驱动，所有实例共用一个 gptimer（1MHz）
+// 主机上没有定时器，只维护边沿表，占空比写入由 FastDiodeHost 记录
+class FastDiodeSoftPwm
+{
+public:
+  // 注册一个引脚，返回通道号，通道用完时返回 -1；第一次调用时创建定时器
+  static int attach(uint8_t pin);
+  // 注销通道，引脚在这个周期结束时熄灭
+  static void detach(int channel);
+  // 设置通道的占空比，maxDuty 对应一直点亮；只在点亮时间变化时重建边沿表，任何任务都可以调用
+  static void write(int channel, uint32_t duty, uint32_t maxDuty);
+  // 定时器中断的总次数，用于评估CPU开销
+  static uint32_t getInterruptCount() { return interrupts; }
+
+private:
+  static portMUX_TYPE lock;                 // 保护生成器和换表
+  static FastDiodePwmSchedule schedule;     // 边沿表生成器
+  static FastDiodePwmFrame frames[3];       // 三张表：中断正在用的、最新生成的、下一次生成用的
+  static uint8_t reading;                   // 中断正在用的表
+  static uint8_t latest;                    // 最新生成的表
+  static uint8_t writing;                   // 下一次生成用的表
+  static volatile bool fresh;               // latest 还没有被中断换上
+  static volatile uint32_t interrupts;      // 中断次数
+
+#if !defined(FAST_DIODE_HOST)
+  static gptimer_handle_t timer;
+  static volatile bool running;             // 定时器中断是否在运行，没有点亮的引脚时停止
+  static uint64_t periodStart;              // 当前周期的开始时间（定时器计数）
+  static uint8_t edge;                      // 当前表中下一个边沿
+
+  // 定时器中断：执行所有到期的边沿，周期结束时换表，再设置下一个边沿的时刻
+  static bool onAlarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *event, void *arg);
+  // 点亮/熄灭一组引脚，只写需要的寄存器
+  static void setPins(FastDiodePinMask pins);
+  static void clearPins(FastDiodePinMask pins);
+#endif
+
+  // 生成新表并交给中断，调用前需持有 lock
+  static void publish();
+};
+
+#endif
@@ -0,0 +1,209 @@
+#include "FastDiodeStore.h"
+
+#if FAST_DIODE_PERSIST
+
+#include <cstring>
+
+#if defined(FAST_DIODE_HOST)
+#include <map>
+#include <mutex>
+#include <string>
+#else
+#include "nvs_flash.h"
+#include "nvs.h"
+#endif
+
+FastDiodeTimer FastDiodeStore::timer;
+portMUX_TYPE FastDiodeStore::lock = portMUX_INITIALIZER_UNLOCKED;
+FastDiodeStore::Slot FastDiodeStore::slots[FAST_DIODE_PERSIST_SLOTS];
+volatile uint32_t FastDiodeStore::delayMs = FAST_DIODE_PERSIST_DELAY;
+volatile uint32_t FastDiodeStore::writes = 0;
+
+#if FAST_DIODE_STATIC && FAST_DIODE_TIMER != FAST_DIODE_TIMER_STEADY_CLOCK && FAST_DIODE_TIMER != FAST_DIODE_TIMER_VIRTUAL
+// 保存任务的栈和控制块，不占用静态槽位
+static StackType_t storeStack[FAST_DIODE_PERSIST_STACK_SIZE];
+static StaticTask_t storeTcb;
+#endif
+
+int FastDiodeStore::attach(const char *key, FastDiodeStoreRecord &record, bool &found)
+{
+    found = false;
+    // 同名的实例（例如删除后重新构造）使用原来的槽位
+    int index = -1;
+    portENTER_CRITICAL(&lock);
+    for (int i = 0; i < FAST_DIODE_PERSIST_SLOTS && index < 0; i++)
+        if (strncmp(slots[i].key, key, sizeof(slots[i].key) - 1) == 0)
+            index = i;
+    for (int i = 0; i < FAST_DIODE_PERSIST_SLOTS && index < 0; i++)
+    {
+        if (!slots[i].key[0])
+        {
+            strncpy(slots[i].key, key, sizeof(slots[i].key) - 1);
+            index = i;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+    if (index < 0)
+        return -1;
+
+    Slot &slot = slots[index];
+    if (slot.dirty || slot.latest.effect)
+    {
+        // 槽位已经有记录，最新的还没写入也以它为准
+        portENTER_CRITICAL(&lock);
+        record = slot.latest;
+        portEXIT_CRITICAL(&lock);
+        found = true;
+    }
+    else if (read(slot.key, record))
+    {
+        portENTER_CRITICAL(&lock);
+        slot.latest = record;
+        portEXIT_CRITICAL(&lock);
+        slot.saved = record;
+        found = true;
+    }
+
+    if (!timer.started())
+#if FAST_DIODE_STATIC && FAST_DIODE_TIMER != FAST_DIODE_TIMER_STEADY_CLOCK && FAST_DIODE_TIMER != FAST_DIODE_TIMER_VIRTUAL
+        timer.start("FastDiodeStore", service, nullptr, storeStack, FAST_DIODE_PERSIST_STACK_SIZE, &storeTcb);
+#else
+        timer.start("FastDiodeStore", service, nullptr, FAST_DIODE_PERSIST_STACK_SIZE);
+#endif
+    return index;
+}
+
+void FastDiodeStore::save(int index, FastDiodeStoreRecord record)
+{
+    Slot &slot = slots[index];
+    FastDiodeTime now = FastDiodeTimer::now();
+    bool wake = false;
+    portENTER_CRITICAL(&lock);
+    record.lastOn = record.level ? record.level : slot.latest.lastOn;
+    if (record != slot.latest)
+    {
+        // 每次变化都重新计时，已经在等待的保存任务醒来后按新的时间再睡
+        slot.latest = record;
+        slot.changed = now;
+        wake = !slot.dirty;
+        slot.dirty = true;
+    }
+    portEXIT_CRITICAL(&lock);
+    if (wake)
+        timer.notify();
+}
+
+FastDiodeStoreRecord FastDiodeStore::peek(int index)
+{
+    portENTER_CRITICAL(&lock);
+    FastDiodeStoreRecord record = slots[index].latest;
+    portEXIT_CRITICAL(&lock);
+    return record;
+}
+
+// 保存任务只在有记录变化时醒来：第一次变化时被唤醒，之后睡到最早的记录稳定的时间
+// flash 写入不持有锁，写入期间灯效任务和调用者照常更新记录
+FastDiodeTime FastDiodeStore::service(void *)
+{
+    FastDiodeTime now = FastDiodeTimer::now();
+    FastDiodeTime delay = (FastDiodeTime)delayMs * 1000;
+    FastDiodeTime next = TIME_NEVER;
+    for (int i = 0; i < FAST_DIODE_PERSIST_SLOTS; i++)
+    {
+        Slot &slot = slots[i];
+        portENTER_CRITICAL(&lock);
+        bool due = slot.dirty && now - slot.changed >= delay;
+        FastDiodeStoreRecord record = slot.latest;
+        if (due)
+            slot.dirty = false;
+        else if (slot.dirty && slot.changed + delay < next)
+            next = slot.changed + delay;
+        portEXIT_CRITICAL(&lock);
+        if (!due || record == slot.saved)
+            continue;
+
+        if (write(slot.key, record))
+        {
+            slot.saved = record;
+            writes++;
+            continue;
+        }
+        // 写入失败（例如 NVS 空间不足），过一段稳定时间再试
+        portENTER_CRITICAL(&lock);
+        if (!slot.dirty)
+        {
+            slot.dirty = true;
+            slot.changed = now;
+        }
+        if (slot.changed + delay < next)
+            next = slot.changed + delay;
+        portEXIT_CRITICAL(&lock);
+    }
+    return next;
+}
+
+#if defined(FAST_DIODE_HOST)
+
+// 主机上的“flash”：进程内一直保留，重新构造同名实例时读出
+static std::mutex hostFlashLock;
+static std::map<std::string, FastDiodeStoreRecord> hostFlash;
+
+bool FastDiodeStore::read(const char *key, FastDiodeStoreRecord &record)
+{
+    std::lock_guard<std::mutex> guard(hostFlashLock);
+    auto it = hostFlash.find(key);
+    if (it == hostFlash.end() || it->second.version != FastDiodeStoreRecord::VERSION)
+        return false;
+    record = it->second;
+    return true;
+}
+
+bool FastDiodeStore::write(const char *key, const FastDiodeStoreRecord &record)
+{
+    std::lock_guard<std::mutex> guard(hostFlashLock);
+    hostFlash[key] = record;
+    return true;
+}
+
+#else
+
+// 打开命名空间，NVS 还没有初始化时初始化它；分区需要擦除（页面已满或版本不符）时由应用处理，这里不擦除
+static esp_err_t openStore(nvs_open_mode_t mode, nvs_handle_t *handle)
+{
+    esp_err_t err = nvs_open(FAST_DIODE_PERSIST_NAMESPACE, mode, handle);
+    if (err == ESP_ERR_NVS_NOT_INITIALIZED && nvs_flash_init() == ESP_OK)
+        err = nvs_open(FAST_DIODE_PERSIST_NAMESPACE, mode, handle);
+    return err;
+}
+
+bool FastDiodeStore::read(const char *key, FastDiodeStoreRecord &record)
+{
+    nvs_handle_t handle;
+    // 第一次使用时命名空间还不存在，只读打开会失败，当作没有记录
+    if (openStore(NVS_READONLY, &handle) != ESP_OK)
+        return false;
+    FastDiodeStoreRecord stored;
+    size_t size = sizeof(stored);
+    esp_err_t err = nvs_get_blob(handle, key, &stored, &size);
+    nvs_close(handle);
+    if (err != ESP_OK || size != sizeof(stored) || stored.version != FastDiodeStoreRecord::VERSION)
+        return false;
+    record = stored;
+    return true;
+}
+
+bool FastDiodeStore::write(const char *key, const FastDiodeStoreRecord &record)
+{
+    nvs_handle_t handle;
+    if (openStore(NVS_READWRITE, &handle) != ESP_OK)
+        return false;
+    esp_err_t err = nvs_set_blob(handle, key, &record, sizeof(record));
+    if (err == ESP_OK)
+        err = nvs_commit(handle);
+    nvs_close(handle);
+    return err == ESP_OK;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include "FastDiodeTimer.h"
+
+#if defined(FAST_DIODE_HOST)
+#include "FastDiodeHost.h"
+#elif defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include "freertos/FreeRTOS.h"
+#endif
+
+// 断电记忆
+// 每个有名字的实例把背景层最近的稳定灯效（固定亮度、呼吸灯或无限闪烁）保存在 NVS 中，重新上电构造时恢复，
+// 第一次写入的占空比就是记住的亮度，不会先熄灭再亮起来。
+// 写入是合并的：灯效变化只更新内存中的记录，由一个低优先级的保存任务在记录保持 FAST_DIODE_PERSIST_DELAY 毫秒不变后才写入flash，
+// 连续调光时只写最后一次；与上次写入相同的记录不写，调用者的任务从不等待flash擦写。
+// 渐亮按目标亮度、渐暗按熄灭保存；有限次闪烁、关键帧程序和高优先级层的灯效是临时的，不保存。
+// 主机上用内存中的表代替 NVS，进程内重新构造同名实例即可模拟重新上电。
+//
+// 用法：
+//   // 在编译选项中定义 FAST_DIODE_PERSIST=1，库和应用必须一致
+//   FastDiode led(4, EPinPolarity::ACTIVE_HIGH, "desk_lamp"); // 名字就是 NVS 中的键，不超过 15 个字符
+//   led.init();                     // 构造时已经恢复了上次的灯效
+
+// 为 1 时编译断电记忆代码，之后新建的有名字的实例默认保存和恢复状态，运行时也可以通过 FastDiode::usePersistence() 切换
+// 为 0（默认）时没有任何开销，也不依赖 nvs_flash 组件（idf 组件只在构建属性 COMPILE_DEFINITIONS 中有 FAST_DIODE_PERSIST=1 时才依赖它）
+#ifndef FAST_DIODE_PERSIST
+#define FAST_DIODE_PERSIST 0
+#endif
+
+// 记录保持不变多久(ms)后才写入flash，越长写入越少，断电前最后这段时间的变化会丢失；运行时可以通过 FastDiode::setPersistDelay() 修改
+#ifndef FAST_DIODE_PERSIST_DELAY
+#define FAST_DIODE_PERSIST_DELAY 3000
+#endif
+
+// 最多保存状态的实例数，超出的实例不保存
+#ifndef FAST_DIODE_PERSIST_SLOTS
+#define FAST_DIODE_PERSIST_SLOTS 8
+#endif
+
+// 保存任务的栈大小（字节），NVS 写入比灯效任务需要更多的栈
+#ifndef FAST_DIODE_PERSIST_STACK_SIZE
+#define FAST_DIODE_PERSIST_STACK_SIZE 3072
+#endif
+
+// NVS 命名空间
+#ifndef FAST_DIODE_PERSIST_NAMESPACE
+#define FAST_DIODE_PERSIST_NAMESPACE "fast_diode"
+#endif
+
+// 保存的灯效记录，按原样写入 NVS，改变布局时增加 VERSION，旧记录不再恢复
+struct FastDiodeStoreRecord
+{
+  static const uint8_t VERSION = 1;
+
+  uint8_t version = VERSION;
+  uint8_t effect = 0;  // EEffectType：STATIC、BREATHING 或 BLINK
+  uint8_t easing = 0;  // 呼吸灯的缓动曲线
+  uint8_t reserved = 0;
+  uint16_t level = 0;  // 亮度（16位）
+  uint16_t lastOn = 0; // 最近一次不为 0 的亮度，熄灭后开灯时回到它
+  uint32_t time = 0;   // 呼吸灯半个周期 / 闪烁间隔(ms)
+
+  bool operator==(const FastDiodeStoreRecord &other) const
+  {
+    return effect == other.effect && easing == other.easing && level == other.level && lastOn == other.lastOn &&
+           time == other.time;
+  }
+  bool operator!=(const FastDiodeStoreRecord &other) const { return !(*this == other); }
+};
+
+class FastDiodeStore
+{
+public:
+  // 为 key 占用一个槽位并读出保存的记录，第一次调用时创建保存任务
+  // 返回槽位号，槽位用完时返回 -1；found 为是否读到了有效的记录
+  static int attach(const char *key, FastDiodeStoreRecord &record, bool &found);
+  // 更新槽位的记录，不访问flash；lastOn 由这里维护。只在记录变化时唤醒保存任务
+  static void save(int slot, FastDiodeStoreRecord record);
+  // 槽位中最新的记录（可能还没有写入flash）
+  static FastDiodeStoreRecord peek(int slot);
+
+  // 记录保持不变多久(ms)后写入
+  static void setDelay(uint32_t ms) { delayMs = ms; }
+  // 写入flash的次数
+  static uint32_t getWrites() { return writes; }
+
+private:
+  struct Slot
+  {
+    char key[16] = {};           // NVS 键，为空时槽位空闲
+    FastDiodeStoreRecord latest; // 最新的记录
+    FastDiodeStoreRecord saved;  // flash中的记录，只由保存任务访问
+    FastDiodeTime changed = 0;   // 最新记录的变化时间
+    bool dirty = false;          // 最新记录还没有写入
+  };
+
+  static FastDiodeTimer timer;          // 保存任务
+  static portMUX_TYPE lock;             // 保护槽位表
+  static Slot slots[FAST_DIODE_PERSIST_SLOTS];
+  static volatile uint32_t delayMs;     // 稳定时间(ms)
+  static volatile uint32_t writes;      // 写入次数
+
+  // 保存任务执行一次：写入所有已经稳定的记录，返回下一个记录稳定的时间
+  static FastDiodeTime service(void *);
+  // 读写flash，失败时返回 false
+  static bool read(const char *key, FastDiodeStoreRecord &record);
+  static bool write(const char *key, const FastDiodeStoreRecord &record);
+};
@@ -0,0 +1,300 @@
+#include "FastDiodeTimer.h"
+
+#if FAST_DIODE_TIMER != FAST_DIODE_TIMER_VIRTUAL
+// 任务主循环：睡到 service 返回的时间或被唤醒，再执行一次
+void FastDiodeTimer::run(void *_this)
+{
+    FastDiodeTimer *timer = static_cast<FastDiodeTimer *>(_this);
+    FastDiodeTime next = TIME_NEVER;
+    while (1)
+    {
+        timer->wait(next);
+#if FAST_DIODE_TIMER == FAST_DIODE_TIMER_STEADY_CLOCK
+        if (timer->stopping)
+            return;
+#endif
+        next = timer->service(timer->arg);
+    }
+}
+#endif
+
+#if FAST_DIODE_TIMER == FAST_DIODE_TIMER_VIRTUAL
+
+FastDiodeTimer *FastDiodeTimer::hostList = nullptr;
+FastDiodeTime FastDiodeTimer::clock = 0;
+
+FastDiodeTime FastDiodeTimer::now()
+{
+    return clock;
+}
+
+// 虚拟任务没有名字和栈
+bool FastDiodeTimer::start(const char *, FastDiodeService _service, void *_arg, uint32_t)
+{
+    service = _service;
+    arg = _arg;
+    hostNext = hostList;
+    hostList = this;
+    return true;
+}
+
+void FastDiodeTimer::stop()
+{
+    if (!started())
+        return;
+    for (FastDiodeTimer **p = &hostList; *p; p = &(*p)->hostNext)
+    {
+        if (*p == this)
+        {
+            *p = hostNext;
+            break;
+        }
+    }
+    service = nullptr;
+}
+
+void FastDiodeTimer::notify()
+{
+    notified = true;
+}
+
+// 每次取出最早到期的任务执行，收到通知的任务在当前时刻执行
+// 时间相同时先创建的任务排在链表后面，按链表顺序取第一个
+void FastDiodeTimer::runUntil(FastDiodeTime target)
+{
+    while (1)
+    {
+        FastDiodeTimer *due = nullptr;
+        FastDiodeTime when = TIME_NEVER;
+        for (FastDiodeTimer *timer = hostList; timer; timer = timer->hostNext)
+        {
+            FastDiodeTime t = timer->notified ? clock : timer->deadline;
+            if (t < when)
+            {
+                due = timer;
+                when = t;
+            }
+        }
+        if (due == nullptr || when > target)
+            break;
+        if (when > clock)
+            clock = when;
+        due->notified = false;
+        due->deadline = due->service(due->arg);
+    }
+    if (target > clock)
+        clock = target;
+}
+
+#elif FAST_DIODE_TIMER == FAST_DIODE_TIMER_STEADY_CLOCK
+
+#include <chrono>
+
+FastDiodeTime FastDiodeTimer::now()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+bool FastDiodeTimer::start(const char *, FastDiodeService _service, void *_arg, uint32_t)
+{
+    service = _service;
+    arg = _arg;
+    thread = std::thread(run, this);
+    return true;
+}
+
+void FastDiodeTimer::stop()
+{
+    if (!started())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        cv.notify_one();
+    }
+    thread.join();
+    service = nullptr;
+}
+
+void FastDiodeTimer::wait(FastDiodeTime deadline)
+{
+    using namespace std::chrono;
+    std::unique_lock<std::mutex> lock(mutex);
+    auto woken = [this] { return notified || stopping; };
+    if (deadline == TIME_NEVER)
+        cv.wait(lock, woken);
+    else
+        cv.wait_until(lock, steady_clock::time_point(microseconds(deadline)), woken);
+    notified = false;
+}
+
+void FastDiodeTimer::notify()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    notified = true;
+    cv.notify_one();
+}
+
+#else
+
+#if FAST_DIODE_STATIC
+
+#include <atomic>
+
+static_assert(FAST_DIODE_MAX_INSTANCES <= 32, "FAST_DIODE_MAX_INSTANCES must not exceed 32");
+
+// 静态槽位：每个槽位一个栈和控制块，由位图分配
+static StackType_t slotStacks[FAST_DIODE_MAX_INSTANCES][FAST_DIODE_STACK_SIZE];
+static StaticTask_t slotTcbs[FAST_DIODE_MAX_INSTANCES];
+static std::atomic<uint32_t> slotsUsed{0};
+
+bool FastDiodeTimer::start(const char *name, FastDiodeService _service, void *_arg, uint32_t stackSize)
+{
+    uint32_t used = slotsUsed.load(std::memory_order_relaxed);
+    int index;
+    do
+    {
+        for (index = 0; index < FAST_DIODE_MAX_INSTANCES && (used >> index & 1); index++)
+            ;
+        if (index == FAST_DIODE_MAX_INSTANCES)
+            return false;
+    } while (!slotsUsed.compare_exchange_weak(used, used | 1u << index, std::memory_order_acquire));
+
+    slot = index;
+    if (start(name, _service, _arg, slotStacks[index], FAST_DIODE_STACK_SIZE, &slotTcbs[index]))
+        return true;
+    slotsUsed.fetch_and(~(1u << index), std::memory_order_release);
+    slot = -1;
+    return false;
+}
+
+bool FastDiodeTimer::start(const char *name, FastDiodeService _service, void *_arg, StackType_t *stack, uint32_t stackSize, StaticTask_t *tcb)
+{
+    service = _service;
+    arg = _arg;
+    task = xTaskCreateStatic(run, name, stackSize, this, 1, stack, tcb);
+    if (task == NULL)
+    {
+        service = nullptr;
+        return false;
+    }
+    return true;
+}
+
+#else
+
+bool FastDiodeTimer::start(const char *name, FastDiodeService _service, void *_arg, uint32_t stackSize)
+{
+    service = _service;
+    arg = _arg;
+    // 内存不足时返回 false，调用者改用共享调度任务
+    if (xTaskCreate(run, name, stackSize, this, 1, &task) != pdPASS)
+    {
+        task = NULL;
+        service = nullptr;
+        return false;
+    }
+    return true;
+}
+
+#endif
+
+void FastDiodeTimer::stop()
+{
+#if FAST_DIODE_TIMER == FAST_DIODE_TIMER_ESP_TIMER
+    // 只通过 begin()/wait() 使用时没有任务，定时器同样要删除
+    if (timer)
+    {
+        esp_timer_stop(timer);
+        esp_timer_delete(timer);
+        timer = nullptr;
+    }
+#endif
+    if (!started())
+        return;
+    vTaskDelete(task);
+    task = NULL;
+    service = nullptr;
+#if FAST_DIODE_STATIC
+    // 灯效任务平时阻塞在等待中，删除后它的栈和控制块不再使用，槽位可以复用
+    if (slot >= 0)
+    {
+        slotsUsed.fetch_and(~(1u << slot), std::memory_order_release);
+        slot = -1;
+    }
+#endif
+}
+
+#if FAST_DIODE_TIMER == FAST_DIODE_TIMER_ESP_TIMER
+
+FastDiodeTime FastDiodeTimer::now()
+{
+    return esp_timer_get_time();
+}
+
+// 定时器到期，在 esp_timer 任务中唤醒等待的任务
+void FastDiodeTimer::expired(void *arg)
+{
+    xTaskNotifyGive(static_cast<FastDiodeTimer *>(arg)->task);
+}
+
+// 用一次性定时器唤醒，任务本身无限期等待通知
+void FastDiodeTimer::wait(FastDiodeTime deadline)
+{
+    if (timer == nullptr)
+    {
+        const esp_timer_create_args_t args = {
+            .callback = expired,
+            .arg = this,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "FastDiode",
+            .skip_unhandled_events = true
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&args, &timer));
+    }
+
+    if (deadline != TIME_NEVER)
+    {
+        FastDiodeTime left = deadline - now();
+        if (left <= 0)
+            return;
+        esp_timer_start_once(timer, left);
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    // 被新命令提前唤醒时取消定时器；如果定时器恰好同时到期，多出的一次通知只会多执行一步
+    if (deadline != TIME_NEVER)
+        esp_timer_stop(timer);
+}
+
+#else // FAST_DIODE_TIMER_TICK
+
+// 由 RTOS 节拍换算成微秒
+// 32 位的节拍数在 1000Hz 时约 49.7 天回绕，回绕后时间倒退，所有截止时间都会错乱；
+// 用内核自己的回绕计数补成 64 位，两者在同一个临界区中读出，不会错过回绕，也不要求定期调用
+// 只能在任务中调用
+FastDiodeTime FastDiodeTimer::now()
+{
+    static_assert(sizeof(TickType_t) == 4, "FAST_DIODE_TIMER_TICK needs 32-bit ticks");
+    TimeOut_t state;
+    vTaskSetTimeOutState(&state);
+    uint64_t ticks = (uint64_t)(uint32_t)state.xOverflowCount << 32 | state.xTimeOnEntering;
+    return (FastDiodeTime)(ticks * 1000000 / configTICK_RATE_HZ);
+}
+
+// 等待的节拍数向上取整，保证醒来时已经到达 deadline
+void FastDiodeTimer::wait(FastDiodeTime deadline)
+{
+    TickType_t ticks = portMAX_DELAY;
+    if (deadline != TIME_NEVER)
+    {
+        FastDiodeTime left = deadline - now();
+        if (left <= 0)
+            return;
+        ticks = (left * configTICK_RATE_HZ + 999999) / 1000000;
+    }
+    ulTaskNotifyTake(pdTRUE, ticks);
+}
+
+#endif
+#endif
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstdint>
+
+// 计时后端
+// FAST_DIODE_TIMER_TICK:         FreeRTOS 节拍，精度为一个节拍（默认 100Hz 时为 10ms）
+// FAST_DIODE_TIMER_ESP_TIMER:    esp_timer 一次性定时器，微秒精度，不需要提高整个系统的 configTICK_RATE_HZ
+// FAST_DIODE_TIMER_STEADY_CLOCK: std::chrono::steady_clock + 条件变量，每个任务一个 std::thread，用于主机上实时运行
+// FAST_DIODE_TIMER_VIRTUAL:      虚拟时钟，单线程按时间顺序执行所有任务，只能在主机上使用（FAST_DIODE_HOST）
+#define FAST_DIODE_TIMER_TICK 0
+#define FAST_DIODE_TIMER_ESP_TIMER 1
+#define FAST_DIODE_TIMER_STEADY_CLOCK 2
+#define FAST_DIODE_TIMER_VIRTUAL 3
+
+#ifndef FAST_DIODE_TIMER
+#ifdef FAST_DIODE_HOST
+#define FAST_DIODE_TIMER FAST_DIODE_TIMER_VIRTUAL
+#else
+#define FAST_DIODE_TIMER FAST_DIODE_TIMER_TICK
+#endif
+#endif
+
+// 为 1 时任务的栈和控制块使用静态内存（xTaskCreateStatic），不从堆中分配：
+// 调用方可以在 start() 中提供，否则从 FAST_DIODE_MAX_INSTANCES 个静态槽位中取一个，
+// 库的内存占用在链接时就确定了，启动后不再使用堆。只对 FreeRTOS 的计时后端有效。
+#ifndef FAST_DIODE_STATIC
+#define FAST_DIODE_STATIC 0
+#endif
+
+// 静态槽位数，独立任务模式的实例和组各占一个，共享调度任务有自己的栈，不占用
+#ifndef FAST_DIODE_MAX_INSTANCES
+#define FAST_DIODE_MAX_INSTANCES 8
+#endif
+
+// 每个任务的栈大小（字节）
+#ifndef FAST_DIODE_STACK_SIZE
+#define FAST_DIODE_STACK_SIZE 2048
+#endif
+
+#if FAST_DIODE_TIMER == FAST_DIODE_TIMER_STEADY_CLOCK
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#elif FAST_DIODE_TIMER == FAST_DIODE_TIMER_VIRTUAL
+#include <atomic>
+#elif defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#endif
+
+#if FAST_DIODE_TIMER == FAST_DIODE_TIMER_ESP_TIMER
+#include "esp_timer.h"
+#endif
+
+// 灯效时间统一使用微秒
+using FastDiodeTime = int64_t;
+// 表示不需要定时唤醒（灯效已结束，或者在等待硬件渐变结束的事件）
+const FastDiodeTime TIME_NEVER = INT64_MAX;
+
+// 灯效任务执行一次的函数，返回下一次需要执行的时间
+using FastDiodeService = FastDiodeTime (*)(void *arg);
+
+// 灯效任务及其定时等待：任务循环执行 service，每次执行完睡到它返回的时间，期间收到新命令可以被提前唤醒
+// 每个独立任务模式的实例、共享调度任务和每个组各持有一个
+class FastDiodeTimer
+{
+public:
+  ~FastDiodeTimer() { stop(); }
+
+  // 当前时间（微秒）
+  static FastDiodeTime now();
+
+  // 创建任务，立即执行一次 service 前先等待 notify()
+  // stackSize 为任务的栈大小（字节），静态槽位的栈固定为 FAST_DIODE_STACK_SIZE，主机上忽略
+  // 返回：false - 没有创建任务（静态模式下槽位已用完，或内存不足）
+  bool start(const char *name, FastDiodeService _service, void *_arg, uint32_t stackSize = FAST_DIODE_STACK_SIZE);
+#if FAST_DIODE_STATIC && FAST_DIODE_TIMER != FAST_DIODE_TIMER_STEADY_CLOCK && FAST_DIODE_TIMER != FAST_DIODE_TIMER_VIRTUAL
+  // 使用调用方提供的栈（stackSize 字节）和控制块创建任务，不占用静态槽位
+  bool start(const char *name, FastDiodeService _service, void *_arg, StackType_t *stack, uint32_t stackSize, StaticTask_t *tcb);
+#endif
+  // 删除任务和 esp_timer 定时器，不能在任务自身中调用
+  void stop();
+  // 是否已创建任务
+  bool started() const { return service != nullptr; }
+
+#if FAST_DIODE_TIMER == FAST_DIODE_TIMER_STEADY_CLOCK || FAST_DIODE_TIMER == FAST_DIODE_TIMER_VIRTUAL
+  // 唤醒任务
+  void notify();
+  // 主机上没有中断，与 notify() 相同
+  template <typename T>
+  void notifyFromISR(T *) { notify(); }
+#else
+  // 设置被唤醒的任务，start() 会自动设置，只有直接使用 wait() 时才需要
+  void begin(TaskHandle_t _task) { task = _task; }
+  // 唤醒任务
+  void notify() { xTaskNotifyGive(task); }
+  // 在中断中唤醒任务，内联以便在 IRAM 中断中调用
+  void notifyFromISR(BaseType_t *woken) { vTaskNotifyGiveFromISR(task, woken); }
+#endif
+
+#if FAST_DIODE_TIMER == FAST_DIODE_TIMER_VIRTUAL
+  // 把虚拟时钟推进到 target，期间按时间顺序执行所有到期的任务
+  static void runUntil(FastDiodeTime target);
+#else
+  // 在任务中调用：等到 deadline，或者被 notify() 提前唤醒
+  void wait(FastDiodeTime deadline);
+#endif
+
+private:
+  FastDiodeService service = nullptr;
+  void *arg = nullptr;
+
+#if FAST_DIODE_TIMER == FAST_DIODE_TIMER_STEADY_CLOCK
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool notified = false;
+  bool stopping = false;
+  std::thread thread;
+#elif FAST_DIODE_TIMER == FAST_DIODE_TIMER_VIRTUAL
+  FastDiodeTimer *hostNext = nullptr;   // 已创建的虚拟任务链表
+  FastDiodeTime deadline = TIME_NEVER;  // 下一次执行的时间
+  std::atomic<bool> notified{false};    // 收到通知，在当前时刻执行；API 可以在其他线程中调用 notify()
+  static FastDiodeTimer *hostList;
+  static FastDiodeTime clock;
+#else
+  TaskHandle_t task = NULL;
+#if FAST_DIODE_STATIC
+  int8_t slot = -1; // 占用的静态槽位，-1 表示没有占用
+#endif
+#endif
+
+#if FAST_DIODE_TIMER == FAST_DIODE_TIMER_ESP_TIMER
+  esp_timer_handle_t timer = nullptr; // 第一次等待时创建，构造时 esp_timer 可能还没有初始化
+  static void expired(void *arg);
+#endif
+
+#if FAST_DIODE_TIMER != FAST_DIODE_TIMER_VIRTUAL
+  // 任务主函数
+  static void run(void *_this);
+#endif
+};
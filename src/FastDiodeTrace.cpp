@@ -0,0 +1,50 @@
+#include "FastDiodeTrace.h"
+
+#if FAST_DIODE_DEBUG
+
+#include <cstdio>
+
+std::atomic<uint32_t> FastDiodeTrace::head{0};
+FastDiodeTrace::Slot FastDiodeTrace::slots[FAST_DIODE_TRACE_SIZE];
+
+size_t FastDiodeTrace::read(uint32_t &cursor, FastDiodeTraceEvent *events, size_t max)
+{
+    uint32_t end = head.load(std::memory_order_acquire);
+    // 落后超过一圈的事件已被覆盖
+    if (end - cursor > FAST_DIODE_TRACE_SIZE)
+        cursor = end - FAST_DIODE_TRACE_SIZE;
+
+    size_t count = 0;
+    for (; cursor != end && count < max; cursor++)
+    {
+        Slot &slot = slots[cursor & (FAST_DIODE_TRACE_SIZE - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != cursor + 1)
+            continue;
+        FastDiodeTraceEvent event;
+        event.time = slot.time.load(std::memory_order_relaxed);
+        uint32_t info = slot.info.load(std::memory_order_relaxed);
+        event.pin = static_cast<uint8_t>(info);
+        event.effect = static_cast<uint8_t>(info >> 8);
+        event.duty = slot.duty.load(std::memory_order_relaxed);
+        // 读取期间被新的事件覆盖
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != cursor + 1)
+            continue;
+        events[count++] = event;
+    }
+    return count;
+}
+
+void FastDiodeTrace::dump(uint32_t &cursor)
+{
+    FastDiodeTraceEvent events[8];
+    size_t count;
+    while ((count = read(cursor, events, 8)) > 0)
+    {
+        for (size_t i = 0; i < count; i++)
+            printf("FastDiode trace t=%lu pin=%u effect=%u duty=%lu\n",
+                   (unsigned long)events[i].time, events[i].pin, events[i].effect, (unsigned long)events[i].duty);
+    }
+}
+
+#endif
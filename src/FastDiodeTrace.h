@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "FastDiodeTimer.h"
+
+// 运行时调试统计，FAST_DIODE_DEBUG 为 1 时启用
+// - 每个实例的计数器：收到的命令、未执行就被覆盖/丢弃的命令、执行的步数、迟到的唤醒和最大迟到时间
+// - 全局的无锁环形缓冲区，记录每次占空比写入 (时间, 引脚, 灯效, 占空比)，可以一次性导出，也可以持续读取后通过串口输出
+// 关闭时这些代码全部不编译，没有任何开销；打开后也只使用静态内存，不会分配内存。
+#ifndef FAST_DIODE_DEBUG
+#define FAST_DIODE_DEBUG 0
+#endif
+
+#if FAST_DIODE_DEBUG
+
+// 环形缓冲区能保存的事件数，必须是2的幂
+#ifndef FAST_DIODE_TRACE_SIZE
+#define FAST_DIODE_TRACE_SIZE 64
+#endif
+
+// 比计划时间晚多少微秒算作迟到，节拍计时下默认为一个节拍
+#ifndef FAST_DIODE_LATE_US
+#if FAST_DIODE_TIMER == FAST_DIODE_TIMER_TICK
+#define FAST_DIODE_LATE_US (1000000 / configTICK_RATE_HZ)
+#else
+#define FAST_DIODE_LATE_US 1000
+#endif
+#endif
+
+// 实际经过的时间(us)，用于测量CPU时间；虚拟时钟和节拍计时的 now() 不能反映实际执行时间
+#if FAST_DIODE_TIMER == FAST_DIODE_TIMER_VIRTUAL || FAST_DIODE_TIMER == FAST_DIODE_TIMER_STEADY_CLOCK
+#include <chrono>
+inline FastDiodeTime fastDiodeWallTime()
+{
+  using namespace std::chrono;
+  return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+#else
+#include "esp_timer.h"
+inline FastDiodeTime fastDiodeWallTime() { return esp_timer_get_time(); }
+#endif
+
+// 每个实例的计数器
+struct FastDiodeStats
+{
+  std::atomic<uint32_t> commands{0};    // 投递的命令数
+  std::atomic<uint32_t> overwritten{0}; // 还没执行就被新的固定亮度覆盖的命令数
+  std::atomic<uint32_t> dropped{0};     // 队列已满被丢弃的命令数
+  std::atomic<uint32_t> direct{0};      // 在调用者任务中直接写入的固定亮度命令数
+  uint32_t steps = 0;                   // 执行的步数
+  uint32_t late = 0;                    // 迟到的唤醒次数
+  FastDiodeTime maxLateness = 0;        // 最大迟到时间(us)
+};
+
+// 一次占空比写入
+struct FastDiodeTraceEvent
+{
+  uint32_t time;  // 写入时间(us)的低32位
+  uint8_t pin;    // 实例的引脚
+  uint8_t effect; // 当时的灯效（EEffectType）
+  uint32_t duty;  // 占空比
+};
+
+class FastDiodeTrace
+{
+public:
+  // 记录一次写入，任何任务都可以调用，不会阻塞
+  static void record(FastDiodeTime time, uint8_t pin, uint8_t effect, uint32_t duty)
+  {
+    uint32_t index = head.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = slots[index & (FAST_DIODE_TRACE_SIZE - 1)];
+    slot.seq.store(0, std::memory_order_relaxed); // 写入中
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.time.store(static_cast<uint32_t>(time), std::memory_order_relaxed);
+    slot.info.store(pin | (uint32_t)effect << 8, std::memory_order_relaxed);
+    slot.duty.store(duty, std::memory_order_relaxed);
+    slot.seq.store(index + 1, std::memory_order_release);
+  }
+
+  // 从 cursor 开始读取事件，最多 max 个，读完后 cursor 指向下一个未读的事件
+  // 已被覆盖或正在写入的事件会被跳过；第一次读取时 cursor 传 0
+  // 返回：读到的事件数
+  static size_t read(uint32_t &cursor, FastDiodeTraceEvent *events, size_t max);
+
+  // 通过 printf 输出 cursor 之后的所有事件，可以在任务中周期性调用以持续输出
+  static void dump(uint32_t &cursor);
+
+  // 已记录的事件总数
+  static uint32_t count() { return head.load(std::memory_order_relaxed); }
+
+private:
+  static_assert((FAST_DIODE_TRACE_SIZE & (FAST_DIODE_TRACE_SIZE - 1)) == 0, "FAST_DIODE_TRACE_SIZE must be a power of two");
+
+  struct Slot
+  {
+    std::atomic<uint32_t> seq{0}; // 事件序号 + 1，0 表示正在写入
+    std::atomic<uint32_t> time{0};
+    std::atomic<uint32_t> info{0}; // bit7~0 引脚，bit15~8 灯效
+    std::atomic<uint32_t> duty{0};
+  };
+
+  static std::atomic<uint32_t> head;
+  static Slot slots[FAST_DIODE_TRACE_SIZE];
+};
+
+#endif
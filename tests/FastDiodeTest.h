@@ -0,0 +1,54 @@
+#pragma once
+
+// 主机测试用的断言，失败时打印位置和两边的值，继续执行，main() 返回失败的数量
+
+#include <cstdio>
+
+static int fastDiodeTestFailures = 0;
+
+#define CHECK(cond)                                                               \
+  do                                                                              \
+  {                                                                               \
+    if (!(cond))                                                                  \
+    {                                                                             \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);             \
+      fastDiodeTestFailures++;                                                    \
+    }                                                                             \
+  } while (0)
+
+#define CHECK_EQ(a, b)                                                            \
+  do                                                                              \
+  {                                                                               \
+    long long _a = (long long)(a), _b = (long long)(b);                           \
+    if (_a != _b)                                                                 \
+    {                                                                             \
+      printf("%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, \
+             #a, #b, _a, _b);                                                     \
+      fastDiodeTestFailures++;                                                    \
+    }                                                                             \
+  } while (0)
+
+// |a - b| <= tolerance
+#define CHECK_NEAR(a, b, tolerance)                                               \
+  do                                                                              \
+  {                                                                               \
+    long long _a = (long long)(a), _b = (long long)(b);                           \
+    if (_a - _b > (tolerance) || _b - _a > (tolerance))                           \
+    {                                                                             \
+      printf("%s:%d: CHECK_NEAR(%s, %s, %s) failed: %lld vs %lld\n", __FILE__,    \
+             __LINE__, #a, #b, #tolerance, _a, _b);                               \
+      fastDiodeTestFailures++;                                                    \
+    }                                                                             \
+  } while (0)
+
+// 执行一个测试函数并打印名字
+#define RUN_TEST(test)          \
+  do                            \
+  {                             \
+    printf("[ RUN  ] %s\n", #test); \
+    test();                     \
+  } while (0)
+
+#define TEST_RESULT()                                             \
+  (printf(fastDiodeTestFailures ? "FAILED: %d\n" : "PASSED\n", fastDiodeTestFailures), \
+   fastDiodeTestFailures ? 1 : 0)
@@ -0,0 +1,166 @@
+/**
+ * @file test_batch.cpp
+ * @brief 批量引擎与 FastDiode 的亮度对比
+ * @details 同样的灯效分别交给 FastDiodeBatch 和 16 位分辨率的 FastDiode 实例，每毫秒比较一次亮度：
+ *          - 渐亮、渐暗与 FastDiode 相差不超过定点相位的舍入误差，时长结束时正好到达终点
+ *          - 呼吸灯的顶点正好是设定的亮度，谷底为 0
+ *          - 闪烁的亮灭与 FastDiode 完全相同，有限次闪烁结束后熄灭，长时间运行不错开
+ *          - 改变灯效时LED在数组中换位，其他LED的亮度不受影响
+ */
+
+#include <vector>
+#include "FastDiode.h"
+#include "FastDiodeBatch.h"
+#include "FastDiodeTest.h"
+
+// 定点相位（Q15，每个相位约 2 级亮度）和向上取整的相位速度（1 秒内最多超前约 4 个相位）带来的误差，不到满量程的 1/8000
+static const long long TOLERANCE = 8;
+
+// 与批量引擎对照的实例，16 位分辨率下每级亮度都是一个占空比
+struct Reference
+{
+  FastDiode led;
+  Reference(uint8_t pin) : led(pin, EPinPolarity::ACTIVE_HIGH, "ref")
+  {
+    led.init(5000, 16);
+    FastDiodeHost::flush();
+  }
+};
+
+// 逐毫秒推进到 ms，每毫秒调用一次 check(t)；t 为相对开始的毫秒数
+template <typename Check>
+static void runEach(FastDiodeTime start, FastDiodeTime ms, Check check)
+{
+  for (FastDiodeTime t = 0; t <= ms; t++)
+  {
+    FastDiodeTimer::runUntil(start + t * 1000);
+    check(t);
+  }
+}
+
+static void testFade()
+{
+  static FastDiodeBatch<4> batch;
+  Reference on(12), off(13);
+  FastDiodeTime start = FastDiodeHost::now();
+  batch.led(0).fodeOn16(1000, 50000);
+  on.led.fodeOn16(1000, 50000);
+  batch.led(1).fodeOff(600, 200);
+  off.led.fodeOff(600, 200);
+
+  long long worst = 0;
+  runEach(start, 1200, [&](FastDiodeTime) {
+    batch.frame(FastDiode::now());
+    for (int i = 0; i < 2; i++)
+    {
+      long long expected = (i ? off : on).led.getBrightness16();
+      long long error = batch.getLevel(i) > expected ? batch.getLevel(i) - expected : expected - batch.getLevel(i);
+      worst = error > worst ? error : worst;
+    }
+  });
+  CHECK_NEAR(worst, 0, TOLERANCE);
+  CHECK_EQ(batch.getLevel(0), 50000);
+  CHECK_EQ(batch.getLevel(1), 0);
+  CHECK_EQ(batch.getLevel(2), 0);
+}
+
+// 呼吸灯：每个周期的顶点正好是设定的亮度，与 FastDiode 一致
+static void testBreathe()
+{
+  static FastDiodeBatch<4> batch;
+  Reference full(12), partial(13);
+  FastDiodeTime start = FastDiodeHost::now();
+  batch.led(0).breathing16(500);
+  full.led.breathing16(500);
+  batch.led(3).breathing16(300, 40000);
+  partial.led.breathing16(300, 40000);
+
+  long long worst = 0;
+  uint16_t peak[2] = {0, 0}, trough[2] = {LEVEL_MAX, LEVEL_MAX};
+  runEach(start, 3000, [&](FastDiodeTime) {
+    batch.frame(FastDiode::now());
+    const uint16_t levels[] = {batch.getLevel(0), batch.getLevel(3)};
+    const long long expected[] = {full.led.getBrightness16(), partial.led.getBrightness16()};
+    for (int i = 0; i < 2; i++)
+    {
+      long long error = levels[i] > expected[i] ? levels[i] - expected[i] : expected[i] - levels[i];
+      worst = error > worst ? error : worst;
+      peak[i] = levels[i] > peak[i] ? levels[i] : peak[i];
+      trough[i] = levels[i] < trough[i] ? levels[i] : trough[i];
+    }
+  });
+  CHECK_NEAR(worst, 0, TOLERANCE);
+  CHECK_EQ(peak[0], LEVEL_MAX);
+  CHECK_EQ(peak[1], 40000);
+  CHECK_EQ(trough[0], 0);
+  CHECK_EQ(trough[1], 0);
+
+  // 顶点在半个周期处
+  batch.frame(start + 3500 * 1000);
+  CHECK_EQ(batch.getLevel(0), LEVEL_MAX);
+}
+
+// 闪烁：先灭后亮，切换时刻与 FastDiode 完全相同
+static void testBlink()
+{
+  static FastDiodeBatch<4> batch;
+  Reference finite(12), infinite(13);
+  FastDiodeTime start = FastDiodeHost::now();
+  batch.led(2).flickering(100, 3, 200);
+  finite.led.flickering(100, 3, 200);
+  batch.led(1).flickering16(70);
+  infinite.led.flickering16(70);
+
+  int mismatches = 0;
+  runEach(start, 2000, [&](FastDiodeTime) {
+    batch.frame(FastDiode::now());
+    mismatches += batch.getLevel(2) != finite.led.getBrightness16();
+    mismatches += batch.getLevel(1) != infinite.led.getBrightness16();
+  });
+  CHECK_EQ(mismatches, 0);
+  CHECK_EQ(batch.getLevel(2), 0);
+
+  // 一小时后无限闪烁仍按半周期切换
+  FastDiodeTime later = start + 3600ull * 1000 * 1000;
+  for (FastDiodeTime t = 0; t < 140; t++)
+  {
+    batch.frame(later + t * 1000);
+    CHECK_EQ(batch.getLevel(1), (3600 * 1000 + t) / 70 % 2 ? LEVEL_MAX : 0);
+  }
+}
+
+// 改变灯效时LED在各段之间换位，forEach() 每个LED正好输出一次，其他LED不受影响
+static void testMoveKinds()
+{
+  static FastDiodeBatch<8> batch;
+  for (uint16_t i = 0; i < 8; i++)
+    batch.led(i).setBrightness16(1000 * (i + 1));
+  batch.led(2).breathing(1000);
+  batch.led(5).fodeOn(1000);
+  batch.led(0).flickering(100);
+  batch.led(2).setBrightness16(123);
+  batch.led(7).breathing(1000);
+  batch.led(5).setBrightness16(456);
+  batch.frame(FastDiodeHost::now());
+
+  const uint16_t expected[] = {0, 2000, 123, 4000, 5000, 456, 7000, 0};
+  std::vector<int> seen(8, 0);
+  batch.forEach([&](uint16_t led, uint16_t level) {
+    seen[led]++;
+    CHECK_EQ(level, expected[led]);
+  });
+  for (int i = 0; i < 8; i++)
+  {
+    CHECK_EQ(seen[i], 1);
+    CHECK_EQ(batch.getLevel(i), expected[i]);
+  }
+}
+
+int main()
+{
+  RUN_TEST(testFade);
+  RUN_TEST(testBreathe);
+  RUN_TEST(testBlink);
+  RUN_TEST(testMoveKinds);
+  return TEST_RESULT();
+}
@@ -0,0 +1,213 @@
+/**
+ * @file test_channel.cpp
+ * @brief 命令通道的多生产者压力测试
+ * @details 几个生产者线程同时投递带时间的灯效和固定亮度，一个消费者线程同时取出：
+ *          - 每条投递成功的命令恰好取出一次，同一个生产者的命令保持投递顺序，字段不会读到写了一半的值
+ *          - 固定亮度只保留最新值，取出时插在投递它之前和之后的命令之间；
+ *            只有已经被更新的值取代时才可能提前交出，取代它的值一定排在后面
+ *          - 所有生产者结束后，最后写入的固定亮度一定被取出，且排在最后
+ */
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "FastDiode.h"
+#include "FastDiodeTest.h"
+
+static const int PRODUCERS = 4;
+static const uint32_t COMMANDS = 20000; // 每个生产者投递的命令数
+static const uint32_t STATICS = 4000;   // 每个生产者写入的固定亮度数，每 5 条命令一次
+static const uint32_t IDLE_SPINS = 64;  // 消费者连续取空多少次后让出CPU
+
+// 命令的各个字段都由 (生产者, 序号) 算出，取出时逐一核对，任何一个字段不符就是读到了写了一半的命令
+static FastDiodeCommand makeCommand(uint32_t producer, uint32_t seq)
+{
+  uint32_t id = producer << 24 | seq;
+  return {EEffectType::BLINK,
+          static_cast<uint16_t>(id * 40503u),
+          ~id,
+          id,
+          reinterpret_cast<const uint8_t *>(static_cast<uintptr_t>(id) * 2654435761u),
+          static_cast<EEffectPriority>(id % EFFECT_PRIORITY_COUNT),
+          static_cast<EEasing>(id % 13),
+          (id & 1) != 0};
+}
+
+static bool sameCommand(const FastDiodeCommand &a, const FastDiodeCommand &b)
+{
+  return a.status == b.status && a.brightness == b.brightness && a.time == b.time && a.repeatCount == b.repeatCount &&
+         a.program == b.program && a.priority == b.priority && a.easing == b.easing && a.polarized == b.polarized;
+}
+
+// 固定亮度：高 3 位为生产者，低 13 位为序号（从 1 开始）
+static uint16_t staticValue(uint32_t producer, uint32_t seq) { return static_cast<uint16_t>(producer << 13 | seq); }
+
+template <size_t N>
+static void stress()
+{
+  static_assert(STATICS < (1u << 13) && COMMANDS * PRODUCERS < 1u << 24, "ids must fit");
+  FastDiodeChannel<N> channel;
+  // 生产者写入第 s 个固定亮度之前已经投递的命令数，消费者取出这个固定亮度时核对
+  static std::atomic<uint32_t> postedBefore[PRODUCERS][STATICS + 1];
+  std::atomic<bool> done{false};
+  std::atomic<int> waiting{PRODUCERS};
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < PRODUCERS; p++)
+  {
+    producers.emplace_back([&, p] {
+      // 所有生产者同时开始，尽量让投递交错
+      waiting--;
+      while (waiting.load())
+        std::this_thread::yield();
+      uint32_t statics = 0;
+      for (uint32_t seq = 0; seq < COMMANDS; seq++)
+      {
+        // 队列满时重试，保证每条命令都投递成功
+        while (!channel.post(makeCommand(p, seq)))
+          std::this_thread::yield();
+        if (seq % 5 == 4 && statics < STATICS)
+        {
+          statics++;
+          postedBefore[p][statics].store(seq + 1, std::memory_order_relaxed);
+          channel.postStatic(staticValue(p, statics));
+        }
+      }
+    });
+  }
+
+  uint32_t nextSeq[PRODUCERS] = {};
+  uint32_t lastStatic[PRODUCERS] = {};
+  uint32_t torn = 0, misordered = 0, staticMisplaced = 0, staticsSeen = 0;
+  uint16_t lastValue = 0;
+  bool lastWasStatic = false;
+  bool superseded = false; // 提前交出的固定亮度还在等待取代它的值
+  auto onCommand = [&](const FastDiodeCommand &cmd) {
+    uint32_t producer = cmd.repeatCount >> 24, seq = cmd.repeatCount & 0xffffff;
+    if (producer >= PRODUCERS || !sameCommand(cmd, makeCommand(producer, seq)))
+    {
+      torn++;
+      return;
+    }
+    // 丢失或重复都会让序号不连续
+    if (seq != nextSeq[producer])
+      misordered++;
+    nextSeq[producer] = seq + 1;
+    lastWasStatic = false;
+  };
+  auto onStatic = [&](uint16_t value) {
+    uint32_t producer = value >> 13, seq = value & 0x1fff;
+    staticsSeen++;
+    // 同一个生产者的固定亮度只会越来越新，且排在之后投递的命令前面
+    uint32_t posted = postedBefore[producer][seq].load(std::memory_order_relaxed);
+    if (seq <= lastStatic[producer] || nextSeq[producer] > posted)
+      staticMisplaced++;
+    // 排在之前投递的命令前面：只允许已经被取代的值，后面必须再取出一个固定亮度
+    superseded = nextSeq[producer] < posted;
+    lastStatic[producer] = seq;
+    lastValue = value;
+    lastWasStatic = true;
+  };
+
+  std::thread consumer([&] {
+    // 空转一会儿再让出，生产者和消费者交替得越频繁越容易暴露问题
+    for (uint32_t idle = 0; !done.load(std::memory_order_acquire);)
+      if (channel.drain(onCommand, onStatic))
+        idle = 0;
+      else if (++idle % IDLE_SPINS == 0)
+        std::this_thread::yield();
+  });
+  for (std::thread &producer : producers)
+    producer.join();
+  done.store(true, std::memory_order_release);
+  consumer.join();
+  channel.drain(onCommand, onStatic);
+
+  CHECK_EQ(torn, 0);
+  CHECK_EQ(misordered, 0);
+  CHECK_EQ(staticMisplaced, 0);
+  CHECK(!superseded);
+  for (int p = 0; p < PRODUCERS; p++)
+    CHECK_EQ(nextSeq[p], COMMANDS);
+  CHECK(staticsSeen > 0);
+
+  // 生产者全部结束后再写入两次，只有最后一次被取出，排在所有命令之后
+  channel.post(makeCommand(0, COMMANDS));
+  channel.postStatic(1);
+  channel.postStatic(staticValue(PRODUCERS - 1, STATICS));
+  uint32_t before = staticsSeen;
+  lastStatic[PRODUCERS - 1] = 0;
+  postedBefore[PRODUCERS - 1][STATICS].store(COMMANDS, std::memory_order_relaxed);
+  channel.drain(onCommand, onStatic);
+  CHECK_EQ(staticsSeen - before, 1);
+  CHECK_EQ(lastValue, staticValue(PRODUCERS - 1, STATICS));
+  CHECK(lastWasStatic);
+  CHECK_EQ(nextSeq[0], COMMANDS + 1);
+  CHECK(!channel.drain(onCommand, onStatic));
+}
+
+// 默认长度的队列经常是满的，走重试路径；长队列让消费者一次取出很多
+static void testStressSmallQueue() { stress<FAST_DIODE_COMMAND_QUEUE>(); }
+static void testStressLargeQueue() { stress<256>(); }
+
+// 消费者取出的过程中生产者继续投递：在回调里投递，交错的位置是确定的，单核上也能重现
+static void testStaticDuringDrain()
+{
+  FastDiodeChannel<> channel;
+  std::vector<uint32_t> order; // 取出顺序：命令为序号，固定亮度为 1000 + 亮度
+  auto onStatic = [&](uint16_t value) { order.push_back(1000 + value); };
+
+  // 取出第 0 条命令时写入固定亮度再投递第 1 条：固定亮度要排在第 1 条前面
+  channel.post(makeCommand(0, 0));
+  bool posted = false;
+  auto onCommand = [&](const FastDiodeCommand &cmd) {
+    order.push_back(cmd.repeatCount);
+    if (!posted)
+    {
+      posted = true;
+      channel.postStatic(5);
+      channel.post(makeCommand(0, 1));
+    }
+  };
+  channel.drain(onCommand, onStatic);
+  channel.drain(onCommand, onStatic);
+  CHECK_EQ(order.size(), 3);
+  if (order.size() == 3)
+  {
+    CHECK_EQ(order[0], 0);
+    CHECK_EQ(order[1], 1005);
+    CHECK_EQ(order[2], 1);
+  }
+}
+
+// 通过 FastDiode 的接口：几个线程同时调光，最后一次写入的亮度就是最终的输出
+static void testLastStaticWins()
+{
+  FastDiode led(12, EPinPolarity::ACTIVE_HIGH, "test");
+  led.init(5000, 8);
+  led.breathing(1000); // 灯效进行中，固定亮度不能直接写入，都经过命令通道
+  FastDiodeHost::flush();
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < PRODUCERS; t++)
+    threads.emplace_back([&led, t] {
+      for (int i = 0; i < 1000; i++)
+        led.setBrightness(static_cast<uint8_t>(t * 50 + i % 50));
+    });
+  for (std::thread &thread : threads)
+    thread.join();
+  led.setBrightness(7);
+  FastDiodeHost::flush();
+  CHECK_EQ(FastDiodeHost::writes().back().duty, 7);
+  CHECK_EQ(led.getBrightness(), 7);
+  CHECK(led.isIdle());
+}
+
+int main()
+{
+  RUN_TEST(testStressSmallQueue);
+  RUN_TEST(testStressLargeQueue);
+  RUN_TEST(testStaticDuringDrain);
+  RUN_TEST(testLastStaticWins);
+  return TEST_RESULT();
+}
@@ -0,0 +1,176 @@
+/**
+ * @file test_curve.cpp
+ * @brief 编译期查找表与浮点参考值的对比
+ * @details 亮度曲线和缓动曲线的表在编译期用自己实现的 exp/log/cos 算出，这里逐项与标准库的结果比较：
+ *          - 每一项与 round(参考值 × 满量程) 相差不超过 1
+ *          - 表单调不减，端点为 0 和满量程
+ *          - 10位以上的分辨率在相邻两项之间插值：亮度逐级增加时占空比每次最多变化 1，渐变经过每一个占空比
+ */
+
+#include <cmath>
+#include <set>
+#include "FastDiode.h"
+#include "FastDiodeCurve.h"
+#include "FastDiodeEasing.h"
+#include "FastDiodeTest.h"
+
+static double referenceCIE1931(double x)
+{
+  double l = x * 100;
+  return l <= 8 ? l / 903.3 : std::pow((l + 16) / 116, 3);
+}
+
+// 逐项比较 values[0..size) 与 round(reference(i / (size - 1)) × full)，返回最大误差
+template <typename Reference>
+static long long maxError(const uint16_t *values, size_t size, uint32_t full, Reference reference)
+{
+  long long worst = 0;
+  for (size_t i = 0; i < size; i++)
+  {
+    long long expected = std::lround(reference(double(i) / (size - 1)) * full);
+    long long error = values[i] > expected ? values[i] - expected : expected - values[i];
+    if (error > worst)
+      worst = error;
+  }
+  return worst;
+}
+
+static bool monotonic(const uint16_t *values, size_t size)
+{
+  for (size_t i = 1; i < size; i++)
+    if (values[i] < values[i - 1])
+      return false;
+  return true;
+}
+
+template <typename Curve, uint8_t Resolution, typename Reference>
+static void checkCurve(Reference reference)
+{
+  using Table = FastDiodeCurve<Curve, Resolution>;
+  const uint16_t *values = Table::data.values;
+  CHECK_NEAR(maxError(values, Table::SIZE, Table::MAX_DUTY, reference), 0, 1);
+  CHECK(monotonic(values, Table::SIZE));
+  CHECK_EQ(values[0], 0);
+  CHECK_EQ(values[Table::SIZE - 1], Table::MAX_DUTY);
+  CHECK(Table::table.data == values);
+  CHECK_EQ(Table::table.resolution, Resolution);
+}
+
+template <typename Curve, typename Reference>
+static void checkResolutions(Reference reference)
+{
+  checkCurve<Curve, 8>(reference);
+  checkCurve<Curve, 10>(reference);
+  checkCurve<Curve, 12>(reference);
+  checkCurve<Curve, 13>(reference);
+  checkCurve<Curve, 16>(reference);
+}
+
+static void testLinear()
+{
+  checkResolutions<CurveLinear>([](double x) { return x; });
+}
+
+static void testGamma()
+{
+  checkResolutions<CurveGamma22>([](double x) { return std::pow(x, 2.2); });
+  checkResolutions<CurveGamma<28>>([](double x) { return std::pow(x, 2.8); });
+  checkResolutions<CurveGamma<18>>([](double x) { return std::pow(x, 1.8); });
+}
+
+static void testCIE1931()
+{
+  checkResolutions<CurveCIE1931>(referenceCIE1931);
+}
+
+// 10位以上表长不变，同一项换算到不同的满量程，两项之间由插值补齐
+static void testTableSize()
+{
+  CHECK_EQ((FastDiodeCurve<CurveGamma22, 8>::SIZE), 256);
+  CHECK_EQ((FastDiodeCurve<CurveGamma22, 10>::SIZE), 1024);
+  CHECK_EQ((FastDiodeCurve<CurveGamma22, 16>::SIZE), 1024);
+  CHECK_EQ((FastDiodeCurve<CurveGamma22, 16>::table.indexBits), 10);
+}
+
+template <typename Ease, typename Reference>
+static void checkEasing(Reference reference)
+{
+  using Table = FastDiodeEasing<Ease>;
+  const uint16_t *values = Table::data.values;
+  CHECK_NEAR(maxError(values, Table::SIZE, 65535, reference), 0, 1);
+  CHECK(monotonic(values, Table::SIZE));
+  CHECK_EQ(values[0], 0);
+  CHECK_EQ(values[Table::SIZE - 1], 65535);
+}
+
+static void testEasingTables()
+{
+  checkEasing<EaseSineIn>([](double x) { return 1 - std::cos(x * M_PI / 2); });
+  checkEasing<EaseExpoIn>([](double x) { return (std::exp2(10 * x) - 1) / 1023; });
+}
+
+// 14位 CIE 曲线的表只有 1024 项，相邻两项最多相差约 30；插值后逐级调光不会跳过占空比
+static void testInterpolatedLevels()
+{
+  FastDiode led(12, EPinPolarity::ACTIVE_HIGH, "curve");
+  led.init(5000, 14);
+  led.setCurve(&FastDiodeCurve<CurveCIE1931, 14>::table);
+  FastDiodeHost::flush();
+  FastDiodeHost::clear();
+
+  // 空闲时固定亮度直接写入，每次调用对应一条记录
+  uint32_t last = 0, maxJump = 0;
+  std::set<uint32_t> duties;
+  for (uint32_t level = 1; level <= LEVEL_MAX; level++)
+  {
+    led.setBrightness16(level);
+    if (FastDiodeHost::writes().empty())
+      continue;
+    uint32_t duty = FastDiodeHost::writes().back().duty;
+    maxJump = duty - last > maxJump ? duty - last : maxJump;
+    last = duty;
+    duties.insert(duty);
+  }
+  CHECK_EQ(maxJump, 1);
+  CHECK_EQ(last, 16383);
+  CHECK_EQ(duties.size(), 16384); // 0~16383 全部出现
+}
+
+// 软件渐变按占空比变化的时刻唤醒：设置曲线后同样经过每一个占空比，不在表项之间停顿
+static void testInterpolatedFade()
+{
+  FastDiode led(12, EPinPolarity::ACTIVE_HIGH, "curve");
+  led.init(5000, 14);
+  led.setCurve(&FastDiodeCurve<CurveCIE1931, 14>::table);
+  FastDiodeHost::flush();
+  FastDiodeHost::clear();
+
+  // 最陡处每个占空比约为平均时长的 1/2.6，总时长足够长，每一步都不短于一帧
+  led.fodeOn16(100000);
+  FastDiodeTimer::runUntil(FastDiodeHost::now() + 101000000);
+  uint32_t last = 0, steps = 0;
+  bool ordered = true;
+  for (const FastDiodeHostWrite &write : FastDiodeHost::writes())
+  {
+    if (write.duty == last)
+      continue;
+    ordered = ordered && write.duty == last + 1;
+    last = write.duty;
+    steps++;
+  }
+  CHECK(ordered);
+  CHECK_EQ(steps, 16383);
+  CHECK_EQ(last, 16383);
+}
+
+int main()
+{
+  RUN_TEST(testLinear);
+  RUN_TEST(testGamma);
+  RUN_TEST(testCIE1931);
+  RUN_TEST(testTableSize);
+  RUN_TEST(testEasingTables);
+  RUN_TEST(testInterpolatedLevels);
+  RUN_TEST(testInterpolatedFade);
+  return TEST_RESULT();
+}
@@ -0,0 +1,99 @@
+/**
+ * @file test_dither.cpp
+ * @brief 时间抖动的平均亮度
+ * @details 库以 FAST_DIODE_DITHER=1 单独构建，8 位分辨率、每 1ms 一帧，逐帧采样输出的占空比：
+ *          - 落在两个占空比之间的亮度只在这两个占空比之间切换，平均值就是 8 位小数的细分占空比
+ *          - 正好落在某个占空比上的亮度不抖动，也不为抖动唤醒
+ *          - 渐暗结束后停在 0，不再唤醒；关闭抖动后输出四舍五入的占空比
+ */
+
+#include <set>
+#include "FastDiode.h"
+#include "FastDiodeTest.h"
+
+// 8 位分辨率下细分占空比为 10.25（10 × 256 + 64）和正好为 10 的亮度
+static const uint16_t LEVEL_QUARTER = 2634;
+static const uint16_t LEVEL_EXACT = toLevel(10);
+
+// 每个测试一个新的打开了抖动的LED，构造时的熄灭已经执行，写入记录已清空
+struct Bench
+{
+  FastDiode led;
+
+  Bench() : led(12, EPinPolarity::ACTIVE_HIGH, "dither")
+  {
+    led.init(5000, 8);
+    led.useDithering(true);
+    FastDiodeHost::flush();
+    FastDiodeHost::clear();
+  }
+  // 逐帧推进 frames 帧，返回每帧输出的占空比之和，duties 收集出现过的占空比
+  uint64_t sample(int frames, std::set<uint32_t> &duties)
+  {
+    uint64_t sum = 0;
+    for (int i = 0; i < frames; i++)
+    {
+      FastDiodeHost::advance(FAST_DIODE_DITHER_INTERVAL * 1000);
+      uint32_t duty = FastDiodeHost::writes().back().duty;
+      duties.insert(duty);
+      sum += duty;
+    }
+    return sum;
+  }
+};
+
+static void testAverage()
+{
+  Bench bench;
+  bench.led.setBrightness16(LEVEL_QUARTER);
+  FastDiodeHost::flush();
+  std::set<uint32_t> duties;
+  uint64_t sum = bench.sample(1024, duties);
+  CHECK_EQ(duties.size(), 2);
+  CHECK(duties.count(10) && duties.count(11));
+  // 1024 帧的平均值为 10.25，累加器的余数最多差一帧
+  CHECK_NEAR(sum, 1024 * 10 + 256, 1);
+  CHECK(bench.led.getDitherWakeups() >= 1000);
+}
+
+// 正好落在占空比上：只写一次，不为抖动唤醒
+static void testExactLevel()
+{
+  Bench bench;
+  bench.led.setBrightness16(LEVEL_EXACT);
+  FastDiodeHost::flush();
+  uint32_t wakeups = bench.led.getDitherWakeups();
+  std::set<uint32_t> duties;
+  CHECK_EQ(bench.sample(100, duties), 100 * 10);
+  CHECK_EQ(duties.size(), 1);
+  CHECK_EQ(FastDiodeHost::writes().size(), 1);
+  CHECK_EQ(bench.led.getDitherWakeups(), wakeups);
+}
+
+// 渐暗结束后停在 0 并空闲；关闭抖动后输出四舍五入的占空比，不再切换
+static void testFadeAndDisable()
+{
+  Bench bench;
+  bench.led.fodeOff(1000, 20);
+  FastDiodeHost::advance(1100 * 1000);
+  CHECK_EQ(FastDiodeHost::writes().back().duty, 0);
+  CHECK(bench.led.isIdle());
+  uint32_t wakeups = bench.led.getDitherWakeups();
+  FastDiodeHost::advance(1000 * 1000);
+  CHECK_EQ(bench.led.getDitherWakeups(), wakeups);
+
+  bench.led.setBrightness16(LEVEL_QUARTER);
+  bench.led.useDithering(false);
+  FastDiodeHost::flush();
+  std::set<uint32_t> duties;
+  CHECK_EQ(bench.sample(100, duties), 100 * 10);
+  CHECK_EQ(duties.size(), 1);
+}
+
+int main()
+{
+  RUN_TEST(testAverage);
+  RUN_TEST(testExactLevel);
+  RUN_TEST(testFadeAndDisable);
+  return TEST_RESULT();
+}
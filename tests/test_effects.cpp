@@ -0,0 +1,636 @@
+/**
+ * @file test_effects.cpp
+ * @brief 灯效的占空比序列
+ * @details 用虚拟时钟推进时间，检查 FastDiodeHost 记录下的每次占空比写入：
+ *          固定亮度、有限/无限闪烁、渐亮、渐暗、呼吸灯、关键帧程序，以及灯效抢占和优先级层。
+ *          空闲时固定亮度直接写入，有灯效或未执行的命令时经过命令通道。
+ *          完成回调、waitDone() 和查询到的灯效与亮度。
+ *          共享调度任务与每个实例一个任务的写入序列相同，同时到期的实例共用一次唤醒。
+ *          所有LED使用 8 位分辨率，亮度 LEVEL_MAX 对应占空比 255。
+ */
+
+#include <vector>
+#include "FastDiode.h"
+#include "FastDiodeTest.h"
+
+// 一次占空比变化：相对灯效开始的时间(ms)和占空比
+struct Change
+{
+  FastDiodeTime ms;
+  uint32_t duty;
+};
+
+// 从写入记录中取出占空比的变化，与前一次相同的写入不算；pin 不为 -1 时只看这个引脚
+static std::vector<Change> changes(FastDiodeTime start, int pin = -1)
+{
+  std::vector<Change> result;
+  for (const FastDiodeHostWrite &write : FastDiodeHost::writes())
+    if ((pin < 0 || write.pin == pin) && (result.empty() || write.duty != result.back().duty))
+      result.push_back({(write.time - start) / 1000, write.duty});
+  return result;
+}
+
+// 最后一次写入的占空比
+static uint32_t lastDuty() { return FastDiodeHost::writes().back().duty; }
+
+// 线性渐变在 t 时刻的占空比：t 从 0 到 duration 时从 from 变到 to
+static long long linearDuty(long long from, long long to, FastDiodeTime t, FastDiodeTime duration)
+{
+  return from + ((to - from) * t * 2 + duration * (to > from ? 1 : -1)) / (duration * 2);
+}
+
+// 每个测试一个新的LED，构造时的熄灭已经执行，写入记录已清空
+struct Bench
+{
+  FastDiode led;
+  FastDiodeTime start;
+
+  Bench(EPinPolarity edge = EPinPolarity::ACTIVE_HIGH) : led(12, edge, "test")
+  {
+    led.init(5000, 8);
+    FastDiodeHost::flush();
+    FastDiodeHost::clear();
+    start = FastDiodeHost::now();
+  }
+  // 执行到灯效开始后 ms 毫秒
+  void runTo(FastDiodeTime ms) { FastDiodeTimer::runUntil(start + ms * 1000); }
+  // 重新开始计时：之后的时间相对现在
+  void restart()
+  {
+    FastDiodeHost::clear();
+    start = FastDiodeHost::now();
+  }
+};
+
+static void testStatic()
+{
+  Bench bench;
+  bench.led.setBrightness(128);
+  CHECK_EQ(FastDiodeHost::writes().size(), 1);
+  CHECK_EQ(lastDuty(), 128);
+  CHECK_EQ(FastDiodeHost::writes().back().time, bench.start);
+
+  // 相同的亮度不再写入
+  bench.led.setBrightness(128);
+  bench.runTo(100);
+  CHECK_EQ(FastDiodeHost::writes().size(), 1);
+
+  bench.led.setBrightness16(LEVEL_MAX);
+  CHECK_EQ(lastDuty(), 255);
+  bench.led.setBrightness(0);
+  CHECK_EQ(lastDuty(), 0);
+  bench.runTo(1000);
+  CHECK_EQ(FastDiodeHost::writes().size(), 3);
+}
+
+// 直接写入：空闲时固定亮度在调用者中立即写出；有灯效在运行或有命令还没取走时经过命令通道，顺序不变
+static void testDirectWrite()
+{
+  Bench bench;
+  bench.led.setBrightness(50);
+  CHECK_EQ(FastDiodeHost::writes().size(), 1);
+  CHECK_EQ(FastDiodeHost::writes().back().time, bench.start);
+  CHECK_EQ(lastDuty(), 50);
+  CHECK(bench.led.isIdle());
+
+  // 呼吸灯运行中：调用时不写，灯效任务在同一时刻取走命令后写出，之后不再变化
+  bench.led.breathing(1000);
+  bench.runTo(100);
+  bench.restart();
+  bench.led.setBrightness(77);
+  CHECK(FastDiodeHost::writes().empty());
+  bench.runTo(0);
+  CHECK_EQ(FastDiodeHost::writes().size(), 1);
+  CHECK_EQ(FastDiodeHost::writes().back().time, bench.start);
+  CHECK_EQ(lastDuty(), 77);
+  bench.runTo(1000);
+  CHECK_EQ(FastDiodeHost::writes().size(), 1);
+  CHECK(bench.led.isIdle());
+
+  // 渐亮还没取走时的固定亮度排在它后面：两条命令在同一次唤醒中执行，只写出固定亮度，不会被渐亮盖住
+  bench.restart();
+  bench.led.fodeOn(1000);
+  bench.led.setBrightness(30);
+  CHECK(FastDiodeHost::writes().empty());
+  bench.runTo(2000);
+  CHECK_EQ(FastDiodeHost::writes().size(), 1);
+  CHECK_EQ(FastDiodeHost::writes().back().time, bench.start);
+  CHECK_EQ(lastDuty(), 30);
+  CHECK(bench.led.isIdle());
+
+  // 灯效结束后回到直接写入
+  bench.restart();
+  bench.led.setBrightness(200);
+  CHECK_EQ(FastDiodeHost::writes().size(), 1);
+  CHECK_EQ(FastDiodeHost::writes().back().time, bench.start);
+  CHECK_EQ(lastDuty(), 200);
+}
+
+// open()/close() 按极性换算：低电平有效的LED开灯为 LEVEL_MAX，高电平有效的相反
+static void testSwitch()
+{
+  {
+    Bench bench(EPinPolarity::ACTIVE_LOW);
+    bench.led.open();
+    CHECK_EQ(lastDuty(), 255);
+    bench.led.close();
+    CHECK_EQ(lastDuty(), 0);
+  }
+  {
+    Bench bench(EPinPolarity::ACTIVE_HIGH);
+    bench.led.close();
+    CHECK_EQ(lastDuty(), 255);
+    bench.led.open();
+    CHECK_EQ(lastDuty(), 0);
+  }
+}
+
+// 有限次闪烁：先灭后亮，亮灭各算一次，3 次共 6 个半周期，之后回到背景层的熄灭
+static void testBlinkFinite()
+{
+  Bench bench;
+  bench.led.flickering(100, 3);
+  bench.runTo(2000);
+  std::vector<Change> seq = changes(bench.start);
+  const Change expected[] = {{0, 0}, {100, 255}, {200, 0}, {300, 255}, {400, 0}, {500, 255}, {600, 0}};
+  CHECK_EQ(seq.size(), sizeof(expected) / sizeof(expected[0]));
+  for (size_t i = 0; i < seq.size() && i < sizeof(expected) / sizeof(expected[0]); i++)
+  {
+    CHECK_EQ(seq[i].ms, expected[i].ms);
+    CHECK_EQ(seq[i].duty, expected[i].duty);
+  }
+  CHECK(bench.led.isIdle());
+}
+
+// 无限闪烁：一直按半周期切换，不会结束
+static void testBlinkInfinite()
+{
+  Bench bench;
+  bench.led.flickering(50, MAX_COUNT, 128);
+  bench.runTo(1000);
+  std::vector<Change> seq = changes(bench.start);
+  CHECK_EQ(seq.size(), 21);
+  for (size_t k = 0; k < seq.size(); k++)
+  {
+    CHECK_EQ(seq[k].ms, (FastDiodeTime)k * 50);
+    CHECK_EQ(seq[k].duty, k % 2 ? 128 : 0);
+  }
+  CHECK(!bench.led.isIdle());
+  bench.runTo(60 * 1000);
+  CHECK_EQ(changes(bench.start).size(), 60 * 1000 / 50 + 1);
+}
+
+// 渐亮：占空比逐级上升，每一级都出现且只出现一次，每次写入都是当时应有的亮度，到终点后不再唤醒
+static void testFadeIn()
+{
+  Bench bench;
+  bench.led.fodeOn(1000);
+  bench.runTo(1000);
+  for (const FastDiodeHostWrite &write : FastDiodeHost::writes())
+    CHECK_NEAR(write.duty, linearDuty(0, 255, write.time - bench.start, 1000 * 1000), 1);
+  std::vector<Change> seq = changes(bench.start);
+  CHECK_EQ(seq.size(), 256);
+  for (size_t i = 0; i < seq.size(); i++)
+    CHECK_EQ(seq[i].duty, i);
+  CHECK_EQ(FastDiodeHost::writes().back().time - bench.start, 1000 * 1000);
+  uint32_t wakeups = FastDiode::getWakeupCount();
+  bench.runTo(5000);
+  CHECK_EQ(FastDiode::getWakeupCount(), wakeups);
+  CHECK_EQ(bench.led.getBrightness(), 255);
+}
+
+// 渐暗：从开始亮度逐级下降到 0
+static void testFadeOut()
+{
+  Bench bench;
+  bench.led.fodeOff(500, 200);
+  bench.runTo(2000);
+  for (const FastDiodeHostWrite &write : FastDiodeHost::writes())
+    CHECK_NEAR(write.duty, linearDuty(200, 0, write.time - bench.start, 500 * 1000), 1);
+  std::vector<Change> seq = changes(bench.start);
+  CHECK_EQ(seq.size(), 201);
+  for (size_t i = 0; i < seq.size(); i++)
+    CHECK_EQ(seq[i].duty, 200 - i);
+  CHECK_EQ(FastDiodeHost::writes().back().time - bench.start, 500 * 1000);
+  CHECK(bench.led.isIdle());
+}
+
+// 缓动曲线：IN 先慢后快，前一半时间只走了四分之一
+static void testFadeEasing()
+{
+  Bench bench;
+  bench.led.fodeOn(1000, 255, EEasing::IN);
+  bench.runTo(500);
+  CHECK_NEAR(lastDuty(), 64, 1);
+  bench.runTo(1000);
+  CHECK_EQ(lastDuty(), 255);
+}
+
+// 呼吸灯：三角波，每个周期两个 time，一直运行
+static void testBreathing()
+{
+  Bench bench;
+  bench.led.breathing(500);
+  bench.runTo(2000);
+  for (const FastDiodeHostWrite &write : FastDiodeHost::writes())
+  {
+    FastDiodeTime t = (write.time - bench.start) % (1000 * 1000);
+    long long expected = t < 500 * 1000 ? linearDuty(0, 255, t, 500 * 1000) : linearDuty(255, 0, t - 500 * 1000, 500 * 1000);
+    CHECK_NEAR(write.duty, expected, 1);
+  }
+  // 两个周期：每个周期上升 255 级、下降 255 级
+  CHECK_EQ(changes(bench.start).size(), 1 + 2 * 2 * 255);
+  bench.runTo(2500);
+  CHECK_EQ(lastDuty(), 255);
+  CHECK(!bench.led.isIdle());
+}
+
+// 关键帧程序：渐亮、保持、设定、渐暗，结束后保持最后的亮度
+static void testProgram()
+{
+  static constexpr auto program = makeProgram(keyframe::Ramp(LEVEL_MAX, 1000), keyframe::Hold(300),
+                                              keyframe::Set(toLevel(100)), keyframe::Hold(100),
+                                              keyframe::Ramp(0, 1000));
+  Bench bench;
+  bench.led.play(program);
+  bench.runTo(500);
+  CHECK_NEAR(lastDuty(), 128, 1);
+  bench.runTo(1000);
+  CHECK_EQ(lastDuty(), 255);
+  bench.runTo(1299);
+  CHECK_EQ(lastDuty(), 255);
+  bench.runTo(1300);
+  CHECK_EQ(lastDuty(), 100);
+  bench.runTo(1900);
+  CHECK_NEAR(lastDuty(), 50, 1);
+  bench.runTo(3000);
+  CHECK_EQ(lastDuty(), 0);
+  CHECK_EQ(FastDiodeHost::writes().back().time - bench.start, 2400 * 1000);
+  CHECK(bench.led.isIdle());
+
+  // 两段渐变之间每一级只写一次
+  std::vector<Change> seq = changes(bench.start);
+  CHECK_EQ(seq.size(), 256 + 1 + 100);
+}
+
+// 同一层的新灯效立即替换正在进行的灯效
+static void testPreempt()
+{
+  Bench bench;
+  bench.led.fodeOn(1000);
+  bench.runTo(300);
+  CHECK_NEAR(lastDuty(), 77, 1);
+  bench.led.setBrightness(10);
+  bench.runTo(300);
+  CHECK_EQ(lastDuty(), 10);
+  size_t count = changes(bench.start).size();
+  bench.runTo(2000);
+  CHECK_EQ(changes(bench.start).size(), count);
+
+  // 呼吸灯被渐暗替换：渐暗从它自己的开始亮度开始
+  bench.restart();
+  bench.led.breathing(1000);
+  bench.runTo(500);
+  bench.led.fodeOff(1000, 200);
+  bench.runTo(500);
+  CHECK_EQ(lastDuty(), 200);
+  bench.runTo(1000);
+  CHECK_NEAR(lastDuty(), 100, 1);
+}
+
+// 有限次闪烁在状态层，结束后回到背景层，背景灯效按原来的相位继续
+static void testStatusLayer()
+{
+  Bench bench;
+  bench.led.breathing(1000);
+  bench.runTo(250);
+  bench.led.flickering(100, 2);
+  bench.runTo(349);
+  CHECK_EQ(lastDuty(), 0);
+  bench.runTo(350);
+  CHECK_EQ(lastDuty(), 255);
+  bench.runTo(450);
+  CHECK_EQ(lastDuty(), 0);
+  bench.runTo(550);
+  CHECK_EQ(lastDuty(), 255);
+  // 闪烁结束，呼吸灯在 650ms 处
+  bench.runTo(650);
+  CHECK_NEAR(lastDuty(), linearDuty(0, 255, 650, 1000), 1);
+  bench.runTo(1200);
+  CHECK_NEAR(lastDuty(), linearDuty(255, 0, 200, 1000), 1);
+}
+
+// 高优先级层覆盖低优先级层；低优先级层的命令照常执行但不可见，释放后立即显示
+static void testPriorityLayers()
+{
+  Bench bench;
+  bench.led.breathing(1000);
+  bench.runTo(100);
+  bench.led.layer(EEffectPriority::ALERT).setBrightness16(LEVEL_MAX);
+  bench.runTo(100);
+  CHECK_EQ(lastDuty(), 255);
+  size_t count = changes(bench.start).size();
+  bench.runTo(900);
+  CHECK_EQ(changes(bench.start).size(), count);
+
+  // 状态层的闪烁在告警层下面，看不到
+  bench.led.layer(EEffectPriority::STATUS).flickering(50);
+  bench.runTo(1100);
+  CHECK_EQ(changes(bench.start).size(), count);
+
+  // 释放告警层，露出状态层的闪烁（开始于 900ms，此时在第 4 个半周期：灭）
+  bench.led.layer(EEffectPriority::ALERT).release();
+  bench.runTo(1100);
+  CHECK_EQ(lastDuty(), 0);
+  bench.runTo(1150);
+  CHECK_EQ(lastDuty(), 255);
+
+  // 释放状态层，回到背景层的呼吸灯
+  bench.led.layer(EEffectPriority::STATUS).release();
+  bench.runTo(1200);
+  CHECK_NEAR(lastDuty(), linearDuty(255, 0, 200, 1000), 1);
+
+  // 背景层的新灯效在高优先级层下面执行，释放后显示的是它
+  bench.led.layer(EEffectPriority::ALERT).setBrightness(0);
+  bench.runTo(1300);
+  bench.led.setBrightness(40);
+  bench.runTo(1400);
+  CHECK_EQ(lastDuty(), 0);
+  bench.led.layer(EEffectPriority::ALERT).release();
+  bench.runTo(1400);
+  CHECK_EQ(lastDuty(), 40);
+}
+
+// 混合方式：告警层以一半的不透明度覆盖
+static void testBlend()
+{
+  Bench bench;
+  bench.led.setBrightness(200);
+  FastDiodeLayer alert = bench.led.layer(EEffectPriority::ALERT);
+  alert.blend(EBlendMode::OVERRIDE, 128);
+  alert.setBrightness(0);
+  bench.runTo(10);
+  CHECK_NEAR(lastDuty(), 100, 1);
+  alert.blend(EBlendMode::MAX);
+  bench.runTo(20);
+  CHECK_EQ(lastDuty(), 200);
+}
+
+// 完成回调的调用记录：调用时的时间和亮度
+struct DoneLog
+{
+  FastDiode *led = nullptr;
+  std::vector<FastDiodeTime> times;
+  std::vector<uint16_t> levels;
+};
+
+static void onDoneLog(FastDiode &led, void *arg)
+{
+  DoneLog *log = static_cast<DoneLog *>(arg);
+  log->led = &led;
+  log->times.push_back(FastDiodeHost::now());
+  log->levels.push_back(led.getBrightness16());
+}
+
+// 渐变和有限次闪烁结束时各调用一次完成回调，结束后灯效为 NONE；呼吸灯不调用
+static void testDoneCallback()
+{
+  Bench bench;
+  DoneLog log;
+  bench.led.onDone(onDoneLog, &log);
+  bench.led.fodeOn(500);
+  bench.runTo(499);
+  CHECK(log.times.empty());
+  CHECK_EQ(bench.led.getEffect(), EEffectType::FADE_IN);
+  bench.runTo(500);
+  CHECK_EQ(log.times.size(), 1);
+  CHECK(log.led == &bench.led);
+  CHECK_EQ(log.times.back(), bench.start + 500 * 1000);
+  CHECK_EQ(log.levels.back(), LEVEL_MAX);
+  CHECK_EQ(bench.led.getEffect(), EEffectType::NONE);
+  CHECK_EQ(bench.led.getBrightness16(), LEVEL_MAX);
+
+  // 有限次闪烁：最后一个半周期结束时调用，之后回到背景层的亮度
+  bench.restart();
+  bench.led.flickering(100, 2);
+  bench.runTo(10);
+  CHECK_EQ(bench.led.getEffect(), EEffectType::BLINK);
+  bench.runTo(399);
+  CHECK_EQ(log.times.size(), 1);
+  bench.runTo(400);
+  CHECK_EQ(log.times.size(), 2);
+  CHECK_EQ(log.times.back(), bench.start + 400 * 1000);
+  CHECK_EQ(bench.led.getEffect(), EEffectType::NONE);
+  CHECK_EQ(bench.led.getBrightness16(), LEVEL_MAX);
+  CHECK_EQ(lastDuty(), 255);
+
+  // 呼吸灯一直进行，不调用
+  bench.restart();
+  bench.led.breathing(200);
+  bench.runTo(2000);
+  CHECK_EQ(log.times.size(), 2);
+  CHECK_EQ(bench.led.getEffect(), EEffectType::BREATHING);
+
+  // 取消回调后不再调用
+  bench.led.onDone(nullptr);
+  bench.led.fodeOff(100);
+  bench.runTo(3000);
+  CHECK_EQ(log.times.size(), 2);
+  CHECK_EQ(bench.led.getBrightness16(), 0);
+}
+
+// 呼吸灯上面的有限次闪烁结束时算完成，回到呼吸灯
+static void testDoneOverBreathing()
+{
+  Bench bench;
+  DoneLog log;
+  bench.led.onDone(onDoneLog, &log);
+  bench.led.breathing(1000);
+  bench.runTo(250);
+  bench.led.flickering(100, 1);
+  bench.runTo(449);
+  CHECK(log.times.empty());
+  bench.runTo(450);
+  CHECK_EQ(log.times.size(), 1);
+  CHECK_EQ(log.times.back(), bench.start + 450 * 1000);
+  CHECK_EQ(bench.led.getEffect(), EEffectType::BREATHING);
+  bench.runTo(500);
+  CHECK_NEAR(bench.led.getBrightness16(), LEVEL_MAX / 2, 257);
+}
+
+// waitDone() 在虚拟时钟下推进时间直到完成；一直进行的灯效不需要等待
+static void testWaitDone()
+{
+  Bench bench;
+  bench.led.fodeOn(300);
+  CHECK(bench.led.waitDone());
+  CHECK(FastDiodeHost::now() >= bench.start + 300 * 1000);
+  CHECK(FastDiodeHost::now() < bench.start + 302 * 1000);
+  CHECK_EQ(bench.led.getBrightness16(), LEVEL_MAX);
+  CHECK_EQ(bench.led.getEffect(), EEffectType::NONE);
+
+  // 超时返回 false，闪烁还在进行
+  bench.restart();
+  bench.led.flickering(100, 5);
+  CHECK(!bench.led.waitDone(200));
+  CHECK_EQ(bench.led.getEffect(), EEffectType::BLINK);
+  CHECK(bench.led.waitDone(2000));
+  CHECK(FastDiodeHost::now() >= bench.start + 1000 * 1000);
+
+  bench.led.breathing(1000);
+  FastDiodeTime before = FastDiodeHost::now();
+  CHECK(bench.led.waitDone(100));
+  CHECK(FastDiodeHost::now() - before <= 1000);
+}
+
+// 查询到的亮度是多层合成后的输出：告警层以一半的不透明度覆盖，结束后回到背景层
+static void testBrightnessLayered()
+{
+  Bench bench;
+  bench.led.setBrightness(200);
+  FastDiodeLayer alert = bench.led.layer(EEffectPriority::ALERT);
+  alert.blend(EBlendMode::OVERRIDE, 128);
+  alert.setBrightness(0);
+  bench.runTo(10);
+  CHECK_NEAR(bench.led.getBrightness16(), toLevel(200) / 2, 257);
+  CHECK_NEAR(bench.led.getBrightness(), lastDuty(), 1);
+  alert.release();
+  bench.runTo(20);
+  CHECK_EQ(bench.led.getBrightness16(), toLevel(200));
+  CHECK_EQ(bench.led.getBrightness(), 200);
+}
+
+// 在指定的调度方式下依次执行几种灯效，返回全部写入记录（时间相对开始）
+static std::vector<FastDiodeHostWrite> runEffects(bool shared)
+{
+  FastDiode::useSharedEngine(shared);
+  Bench bench;
+  FastDiode::useSharedEngine(false);
+  bench.led.flickering(100, 3);
+  bench.runTo(1000);
+  bench.led.fodeOn(500);
+  bench.runTo(1600);
+  bench.led.breathing(300);
+  bench.runTo(2500);
+  bench.led.fodeOff(400, 100);
+  bench.runTo(3000);
+  std::vector<FastDiodeHostWrite> writes = FastDiodeHost::writes();
+  for (FastDiodeHostWrite &write : writes)
+    write.time -= bench.start;
+  return writes;
+}
+
+// 共享调度任务与每个实例一个任务写出的序列完全相同：时间、占空比和次数都一样
+static void testSharedEngineSequence()
+{
+  std::vector<FastDiodeHostWrite> task = runEffects(false);
+  std::vector<FastDiodeHostWrite> shared = runEffects(true);
+  CHECK(task.size() > 500);
+  CHECK_EQ(shared.size(), task.size());
+  for (size_t i = 0; i < shared.size() && i < task.size(); i++)
+  {
+    CHECK_EQ(shared[i].time, task[i].time);
+    CHECK_EQ(shared[i].duty, task[i].duty);
+  }
+}
+
+// 同时到期的实例在一次唤醒中处理；每个实例一个任务时各自唤醒
+static void testSharedEngineWakeups()
+{
+  uint32_t counts[2];
+  for (int shared = 0; shared < 2; shared++)
+  {
+    FastDiode::useSharedEngine(shared);
+    FastDiode a(12, EPinPolarity::ACTIVE_HIGH, "a"), b(13, EPinPolarity::ACTIVE_HIGH, "b"), c(14, EPinPolarity::ACTIVE_HIGH, "c");
+    FastDiode::useSharedEngine(false);
+    a.init(5000, 8);
+    b.init(5000, 8);
+    c.init(5000, 8);
+    FastDiodeTimer::runUntil(FastDiodeHost::now());
+    FastDiodeHost::clear();
+    FastDiodeTime start = FastDiodeHost::now();
+    a.flickering(100);
+    b.flickering(100);
+    c.flickering(100);
+    FastDiodeTimer::runUntil(start + 1000);
+    uint32_t wakeups = FastDiode::getWakeupCount();
+    FastDiodeTimer::runUntil(start + 1000 * 1000);
+    counts[shared] = FastDiode::getWakeupCount() - wakeups;
+    for (int pin = 12; pin <= 14; pin++)
+      CHECK_EQ(changes(start, pin).size(), 11);
+  }
+  // 1 秒内 10 个半周期：三个任务各唤醒 10 次，共享调度任务一共 10 次
+  CHECK_EQ(counts[0], 30);
+  CHECK_EQ(counts[1], 10);
+}
+
+// 活动实例按截止时间排序：周期不同的实例各按自己的时刻切换，注销的实例不再写入，其余的照常执行
+static void testSharedEngineDeadlines()
+{
+  FastDiode::useSharedEngine(true);
+  FastDiode *fast = new FastDiode(12, EPinPolarity::ACTIVE_HIGH, "fast");
+  FastDiode slow(13, EPinPolarity::ACTIVE_HIGH, "slow"), mid(14, EPinPolarity::ACTIVE_HIGH, "mid");
+  FastDiode::useSharedEngine(false);
+  fast->init(5000, 8);
+  slow.init(5000, 8);
+  mid.init(5000, 8);
+  FastDiodeTimer::runUntil(FastDiodeHost::now());
+  FastDiodeHost::clear();
+  FastDiodeTime start = FastDiodeHost::now();
+  slow.flickering(70);
+  fast->flickering(30);
+  mid.flickering(50);
+  FastDiodeTimer::runUntil(start + 1050 * 1000);
+
+  const int pins[] = {12, 13, 14};
+  const FastDiodeTime periods[] = {30, 70, 50};
+  for (int i = 0; i < 3; i++)
+  {
+    std::vector<Change> seq = changes(start, pins[i]);
+    CHECK_EQ(seq.size(), 1050 / periods[i] + 1);
+    for (size_t k = 0; k < seq.size(); k++)
+      CHECK_EQ(seq[k].ms, (FastDiodeTime)k * periods[i]);
+  }
+  // 同一时刻到期的实例共用一次唤醒：唤醒次数等于不同切换时刻的个数
+  uint32_t wakeups = FastDiode::getWakeupCount();
+  FastDiodeTimer::runUntil(start + 2100 * 1000);
+  uint32_t due = 0;
+  for (FastDiodeTime ms = 1051; ms <= 2100; ms++)
+    due += ms % 30 == 0 || ms % 70 == 0 || ms % 50 == 0;
+  CHECK_EQ(FastDiode::getWakeupCount() - wakeups, due);
+
+  // 注销正在闪烁的实例，另外两个不受影响
+  delete fast;
+  FastDiodeHost::clear();
+  start = FastDiodeHost::now();
+  FastDiodeTimer::runUntil(start + 2100 * 1000);
+  CHECK(changes(start, 12).empty());
+  CHECK_EQ(changes(start, 13).size(), 2100 / 70);
+  CHECK_EQ(changes(start, 14).size(), 2100 / 50);
+}
+
+int main()
+{
+  RUN_TEST(testStatic);
+  RUN_TEST(testDirectWrite);
+  RUN_TEST(testSwitch);
+  RUN_TEST(testBlinkFinite);
+  RUN_TEST(testBlinkInfinite);
+  RUN_TEST(testFadeIn);
+  RUN_TEST(testFadeOut);
+  RUN_TEST(testFadeEasing);
+  RUN_TEST(testBreathing);
+  RUN_TEST(testProgram);
+  RUN_TEST(testPreempt);
+  RUN_TEST(testStatusLayer);
+  RUN_TEST(testPriorityLayers);
+  RUN_TEST(testBlend);
+  RUN_TEST(testDoneCallback);
+  RUN_TEST(testDoneOverBreathing);
+  RUN_TEST(testWaitDone);
+  RUN_TEST(testBrightnessLayered);
+  RUN_TEST(testSharedEngineSequence);
+  RUN_TEST(testSharedEngineWakeups);
+  RUN_TEST(testSharedEngineDeadlines);
+  return TEST_RESULT();
+}
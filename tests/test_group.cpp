@@ -0,0 +1,157 @@
+/**
+ * @file test_group.cpp
+ * @brief LED组的相位偏移和整帧写入
+ * @details 组内成员由组的一个任务驱动，检查 FastDiodeHost 记录的每次占空比写入：
+ *          - 每个成员的灯效按相位偏移提前开始，切换时刻与理想时间表一致，长时间运行也不错开
+ *          - 同一帧的成员在同一时刻写入，每帧只唤醒一次组任务，占空比没有变化的成员不写
+ *          - 组析构后成员交还给原来的调度方式
+ */
+
+#include <vector>
+#include "FastDiodeGroup.h"
+#include "FastDiodeTest.h"
+
+static const uint8_t PINS[] = {12, 13, 14};
+
+// 三个成员加入组，构造时的熄灭已经执行，写入记录已清空
+struct Bench
+{
+  FastDiode leds[3] = {{PINS[0], EPinPolarity::ACTIVE_HIGH, "a"},
+                       {PINS[1], EPinPolarity::ACTIVE_HIGH, "b"},
+                       {PINS[2], EPinPolarity::ACTIVE_HIGH, "c"}};
+  FastDiodeGroup group{"group"};
+  FastDiodeTime start;
+
+  Bench(const uint32_t (&phases)[3])
+  {
+    for (int i = 0; i < 3; i++)
+    {
+      leds[i].init(5000, 8);
+      group.add(leds[i], phases[i]);
+    }
+    FastDiodeHost::advance(1000 * 1000);
+    FastDiodeHost::clear();
+    start = FastDiodeHost::now();
+  }
+  // 执行到灯效开始后 ms 毫秒
+  void runTo(FastDiodeTime ms) { FastDiodeTimer::runUntil(start + ms * 1000); }
+};
+
+// 某个引脚的写入记录：相对开始的时间(us)和占空比
+static std::vector<FastDiodeHostWrite> writesOf(int pin, FastDiodeTime start)
+{
+  std::vector<FastDiodeHostWrite> result;
+  for (FastDiodeHostWrite write : FastDiodeHost::writes())
+    if (write.pin == pin)
+    {
+      write.time -= start;
+      result.push_back(write);
+    }
+  return result;
+}
+
+// 无限闪烁：相位超前 p 的成员在 t 时刻处于第 (t + p) / 半周期 个半周期，先灭后亮
+static void testPhaseOffsets()
+{
+  const uint32_t phases[] = {0, 100, 250};
+  Bench bench(phases);
+  bench.group.flickering(300);
+  bench.runTo(60 * 1000);
+  for (int i = 0; i < 3; i++)
+  {
+    std::vector<FastDiodeHostWrite> writes = writesOf(PINS[i], bench.start);
+    CHECK(writes.size() >= 199);
+    for (const FastDiodeHostWrite &write : writes)
+    {
+      FastDiodeTime t = write.time + phases[i] * 1000;
+      CHECK_EQ(write.time % 1000, 0);
+      CHECK_EQ(write.duty, t / (300 * 1000) % 2 ? 255 : 0);
+      // 除第一次写入外，每次写入都在切换时刻
+      if (write.time > 0)
+        CHECK_EQ(t % (300 * 1000), 0);
+    }
+  }
+}
+
+// 渐亮：相位超前 500ms 的成员在一半时间到达终点，之后保持
+static void testPhaseFade()
+{
+  const uint32_t phases[] = {0, 500, 0};
+  Bench bench(phases);
+  bench.group.fodeOn(1000);
+  bench.runTo(250);
+  CHECK_NEAR(bench.leds[0].getBrightness(), 64, 1);
+  CHECK_NEAR(bench.leds[1].getBrightness(), 191, 1);
+  bench.runTo(500);
+  CHECK_EQ(bench.leds[1].getBrightness(), 255);
+  CHECK(writesOf(PINS[1], bench.start).back().time <= 500 * 1000);
+  CHECK_EQ(writesOf(PINS[1], bench.start).back().duty, 255);
+  bench.runTo(1000);
+  CHECK_EQ(bench.leds[0].getBrightness(), 255);
+  CHECK_EQ(bench.leds[2].getBrightness(), 255);
+}
+
+// 相位相同的成员在同一帧中写入：时刻相同，每帧只唤醒一次组任务
+static void testBatchedFrame()
+{
+  const uint32_t phases[] = {0, 0, 0};
+  Bench bench(phases);
+  bench.group.flickering(100);
+  bench.runTo(1);
+  uint32_t wakeups = bench.group.getWakeupCount();
+  bench.runTo(1000);
+  CHECK_EQ(bench.group.getWakeupCount() - wakeups, 10);
+
+  std::vector<FastDiodeHostWrite> a = writesOf(PINS[0], bench.start);
+  std::vector<FastDiodeHostWrite> b = writesOf(PINS[1], bench.start);
+  std::vector<FastDiodeHostWrite> c = writesOf(PINS[2], bench.start);
+  // 0ms 时占空比仍为 0，不写；之后每个半周期三个成员各写一次
+  CHECK_EQ(a.size(), 10);
+  CHECK_EQ(b.size(), a.size());
+  CHECK_EQ(c.size(), a.size());
+  for (size_t k = 0; k < a.size() && k < b.size() && k < c.size(); k++)
+  {
+    CHECK_EQ(a[k].time, (FastDiodeTime)(k + 1) * 100 * 1000);
+    CHECK_EQ(b[k].time, a[k].time);
+    CHECK_EQ(c[k].time, a[k].time);
+    CHECK_EQ(b[k].duty, a[k].duty);
+    CHECK_EQ(c[k].duty, a[k].duty);
+  }
+
+  // 固定亮度：占空比没有变化的帧不写
+  bench.group.setBrightness(80);
+  bench.runTo(1000);
+  size_t count = FastDiodeHost::writes().size();
+  bench.group.setBrightness(80);
+  bench.runTo(1100);
+  CHECK_EQ(FastDiodeHost::writes().size(), count);
+}
+
+// 组析构后成员回到自己的任务，单独调用灯效函数照常执行
+static void testRelease()
+{
+  FastDiode led(12, EPinPolarity::ACTIVE_HIGH, "solo");
+  led.init(5000, 8);
+  {
+    FastDiodeGroup group("group");
+    group.add(led);
+    group.setBrightness(40);
+    FastDiodeHost::advance(10 * 1000);
+    CHECK_EQ(led.getBrightness(), 40);
+  }
+  FastDiodeHost::clear();
+  led.fodeOff(300, 200);
+  FastDiodeHost::advance(400 * 1000);
+  CHECK(FastDiodeHost::writes().size() > 100);
+  CHECK_EQ(FastDiodeHost::writes().back().duty, 0);
+  CHECK(led.isIdle());
+}
+
+int main()
+{
+  RUN_TEST(testPhaseOffsets);
+  RUN_TEST(testPhaseFade);
+  RUN_TEST(testBatchedFrame);
+  RUN_TEST(testRelease);
+  return TEST_RESULT();
+}
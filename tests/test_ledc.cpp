@@ -0,0 +1,148 @@
+/**
+ * @file test_ledc.cpp
+ * @brief LEDC 通道和定时器的分配
+ * @details 主机上按 8 个通道、4 个定时器、一个速度模式模拟分配过程：
+ *          - 频率和分辨率相同的通道共用一个定时器，不同的各占一个
+ *          - 定时器用完时返回 NO_TIMER，同配置的仍能分配；最后一个使用者释放后定时器可以按新配置使用
+ *          - 指定的通道已被占用时返回 CHANNEL_BUSY，通道用完时返回 NO_CHANNEL
+ *          - init() 失败时实例保留 GPIO 模式，析构时交还通道
+ *          每个测试结束时释放所有资源。
+ */
+
+#include <vector>
+#include "FastDiode.h"
+#include "FastDiodeTest.h"
+
+static void releaseAll(std::vector<FastDiodeLedcSlot> &slots)
+{
+  for (const FastDiodeLedcSlot &slot : slots)
+    FastDiodeLedc::release(slot);
+  slots.clear();
+}
+
+static void testTimerSharing()
+{
+  std::vector<FastDiodeLedcSlot> slots(5);
+  CHECK_EQ(FastDiodeLedc::allocate(5000, 8, slots[0]), ELedcError::NONE);
+  CHECK_EQ(FastDiodeLedc::allocate(5000, 8, slots[1]), ELedcError::NONE);
+  CHECK_EQ(FastDiodeLedc::allocate(1000, 8, slots[2]), ELedcError::NONE);
+  CHECK_EQ(FastDiodeLedc::allocate(5000, 10, slots[3]), ELedcError::NONE);
+  CHECK_EQ(FastDiodeLedc::allocate(5000, 8, slots[4]), ELedcError::NONE);
+
+  // 同配置共用定时器，不同配置各占一个，每个LED一个通道
+  CHECK_EQ(slots[1].timer, slots[0].timer);
+  CHECK_EQ(slots[4].timer, slots[0].timer);
+  CHECK(slots[2].timer != slots[0].timer);
+  CHECK(slots[3].timer != slots[0].timer);
+  CHECK(slots[3].timer != slots[2].timer);
+  for (size_t i = 0; i < slots.size(); i++)
+    for (size_t j = i + 1; j < slots.size(); j++)
+      CHECK(slots[i].channel != slots[j].channel);
+  CHECK_EQ(FastDiodeLedc::freeTimers(), LEDC_TIMER_MAX - 3);
+  CHECK_EQ(FastDiodeLedc::freeChannels(), LEDC_CHANNEL_MAX - 5);
+
+  // 共用的定时器在最后一个使用者释放后才空闲
+  FastDiodeLedc::release(slots[0]);
+  FastDiodeLedc::release(slots[1]);
+  CHECK_EQ(FastDiodeLedc::freeTimers(), LEDC_TIMER_MAX - 3);
+  FastDiodeLedc::release(slots[4]);
+  CHECK_EQ(FastDiodeLedc::freeTimers(), LEDC_TIMER_MAX - 2);
+  FastDiodeLedc::release(slots[2]);
+  FastDiodeLedc::release(slots[3]);
+  CHECK_EQ(FastDiodeLedc::freeTimers(), LEDC_TIMER_MAX);
+  CHECK_EQ(FastDiodeLedc::freeChannels(), LEDC_CHANNEL_MAX);
+}
+
+static void testNoTimer()
+{
+  std::vector<FastDiodeLedcSlot> slots;
+  for (int i = 0; i < LEDC_TIMER_MAX; i++)
+  {
+    FastDiodeLedcSlot slot;
+    CHECK_EQ(FastDiodeLedc::allocate(1000 * (i + 1), 8, slot), ELedcError::NONE);
+    slots.push_back(slot);
+  }
+  CHECK_EQ(FastDiodeLedc::freeTimers(), 0);
+
+  // 还有空闲通道，但没有同配置的定时器也没有空闲的定时器
+  FastDiodeLedcSlot extra;
+  CHECK_EQ(FastDiodeLedc::allocate(7000, 8, extra), ELedcError::NO_TIMER);
+  CHECK_EQ(FastDiodeLedc::claim(LEDC_CHANNEL_7, 7000, 8, extra), ELedcError::NO_TIMER);
+  CHECK_EQ(FastDiodeLedc::freeChannels(), LEDC_CHANNEL_MAX - LEDC_TIMER_MAX);
+
+  // 同配置的仍能共用
+  CHECK_EQ(FastDiodeLedc::allocate(2000, 8, extra), ELedcError::NONE);
+  CHECK_EQ(extra.timer, slots[1].timer);
+  slots.push_back(extra);
+
+  // 释放一个定时器的唯一使用者后，它可以按新的配置分配
+  FastDiodeLedc::release(slots[0]);
+  CHECK_EQ(FastDiodeLedc::allocate(7000, 8, extra), ELedcError::NONE);
+  CHECK_EQ(extra.timer, slots[0].timer);
+  slots[0] = extra;
+  releaseAll(slots);
+  CHECK_EQ(FastDiodeLedc::freeTimers(), LEDC_TIMER_MAX);
+}
+
+static void testClaim()
+{
+  std::vector<FastDiodeLedcSlot> slots(1);
+  CHECK_EQ(FastDiodeLedc::claim(LEDC_CHANNEL_3, 5000, 8, slots[0]), ELedcError::NONE);
+  CHECK_EQ(slots[0].channel, LEDC_CHANNEL_3);
+
+  // 通道只属于一个实例，即使配置相同
+  FastDiodeLedcSlot other;
+  CHECK_EQ(FastDiodeLedc::claim(LEDC_CHANNEL_3, 5000, 8, other), ELedcError::CHANNEL_BUSY);
+  CHECK_EQ(FastDiodeLedc::claim(LEDC_CHANNEL_MAX, 5000, 8, other), ELedcError::NO_CHANNEL);
+  CHECK_EQ(FastDiodeLedc::claim(static_cast<ledc_channel_t>(-1), 5000, 8, other), ELedcError::NO_CHANNEL);
+
+  // 自动分配跳过被指定的通道，通道用完时返回 NO_CHANNEL
+  for (int i = 1; i < LEDC_CHANNEL_MAX; i++)
+  {
+    FastDiodeLedcSlot slot;
+    CHECK_EQ(FastDiodeLedc::allocate(5000, 8, slot), ELedcError::NONE);
+    CHECK(slot.channel != LEDC_CHANNEL_3);
+    CHECK_EQ(slot.timer, slots[0].timer);
+    slots.push_back(slot);
+  }
+  CHECK_EQ(FastDiodeLedc::allocate(5000, 8, other), ELedcError::NO_CHANNEL);
+  CHECK_EQ(FastDiodeLedc::freeTimers(), LEDC_TIMER_MAX - 1);
+
+  // 释放后可以再次指定
+  FastDiodeLedc::release(slots[0]);
+  CHECK_EQ(FastDiodeLedc::claim(LEDC_CHANNEL_3, 5000, 8, slots[0]), ELedcError::NONE);
+  releaseAll(slots);
+  CHECK_EQ(FastDiodeLedc::freeChannels(), LEDC_CHANNEL_MAX);
+}
+
+// 通过 FastDiode 使用：失败的 init() 给出原因并保留 GPIO 模式，析构时交还通道
+static void testInit()
+{
+  {
+    FastDiode a(12, EPinPolarity::ACTIVE_HIGH, "a"), b(13, EPinPolarity::ACTIVE_HIGH, "b");
+    CHECK(a.init(LEDC_CHANNEL_2, 5000, 8));
+    CHECK(!b.init(LEDC_CHANNEL_2, 5000, 8));
+    CHECK_EQ(b.getLedcError(), ELedcError::CHANNEL_BUSY);
+    FastDiodeHost::flush();
+    FastDiodeHost::clear();
+    b.setBrightness(200);
+    CHECK_EQ(FastDiodeHost::writes().back().channel, -1);
+    CHECK_EQ(FastDiodeHost::writes().back().duty, 1);
+
+    CHECK(b.init(5000, 8));
+    CHECK_EQ(b.getLedcError(), ELedcError::NONE);
+    CHECK_EQ(FastDiodeLedc::freeChannels(), LEDC_CHANNEL_MAX - 2);
+    CHECK_EQ(FastDiodeLedc::freeTimers(), LEDC_TIMER_MAX - 1);
+  }
+  CHECK_EQ(FastDiodeLedc::freeChannels(), LEDC_CHANNEL_MAX);
+  CHECK_EQ(FastDiodeLedc::freeTimers(), LEDC_TIMER_MAX);
+}
+
+int main()
+{
+  RUN_TEST(testTimerSharing);
+  RUN_TEST(testNoTimer);
+  RUN_TEST(testClaim);
+  RUN_TEST(testInit);
+  return TEST_RESULT();
+}
@@ -0,0 +1,116 @@
+/**
+ * @file test_persist.cpp
+ * @brief 断电记忆的写入合并与恢复
+ * @details 库以 FAST_DIODE_PERSIST=1 单独构建，主机上的“flash”是进程内的表，删除后重新构造同名实例即模拟重新上电：
+ *          - 稳定时间内的多次变化只写入一次，写入的是最后的亮度
+ *          - 与flash中相同的记录不写
+ *          - 重新构造的实例第一次写入的占空比就是记住的亮度，不会先熄灭
+ *          - 呼吸灯按原来的参数恢复，临时的灯效不改变记录
+ */
+
+#include "FastDiode.h"
+#include "FastDiodeTest.h"
+
+static const uint32_t DELAY = 100;
+
+// 执行到现在之后 ms 毫秒
+static void runFor(FastDiodeTime ms) { FastDiodeTimer::runUntil(FastDiodeHost::now() + ms * 1000); }
+
+static void testCoalesce()
+{
+  FastDiode::setPersistDelay(DELAY);
+  FastDiode lamp(12, EPinPolarity::ACTIVE_HIGH, "coalesce");
+  lamp.init(5000, 8);
+  runFor(DELAY * 2);
+  uint32_t writes = FastDiode::getPersistWrites();
+
+  // 连续调光：每次间隔都短于稳定时间，最后一次稳定后才写入
+  for (int level = 10; level <= 100; level += 10)
+  {
+    lamp.setBrightness(level);
+    runFor(DELAY / 2);
+  }
+  CHECK_EQ(FastDiode::getPersistWrites(), writes);
+  runFor(DELAY);
+  CHECK_EQ(FastDiode::getPersistWrites(), writes + 1);
+  CHECK_EQ(lamp.getLastBrightness(), 100);
+
+  // 变化后又回到flash中的记录：不写
+  lamp.setBrightness(40);
+  runFor(DELAY / 2);
+  lamp.setBrightness(100);
+  runFor(DELAY * 3);
+  CHECK_EQ(FastDiode::getPersistWrites(), writes + 1);
+
+  // 有限次闪烁是临时的，不改变记录
+  lamp.flickering(20, 3);
+  runFor(DELAY * 3);
+  CHECK_EQ(FastDiode::getPersistWrites(), writes + 1);
+}
+
+// 重新构造同名实例：构造后的第一次写入就是记住的亮度
+static void testRestoreLevel()
+{
+  FastDiode::setPersistDelay(DELAY);
+  {
+    FastDiode lamp(12, EPinPolarity::ACTIVE_HIGH, "restore");
+    lamp.init(5000, 8);
+    lamp.setBrightness(77);
+    runFor(DELAY * 2);
+    lamp.close();
+    lamp.setBrightness(0);
+    lamp.setBrightness(77);
+  }
+
+  FastDiodeHost::flush();
+  FastDiodeHost::clear();
+  FastDiode lamp(12, EPinPolarity::ACTIVE_HIGH, "restore");
+  lamp.init(5000, 8);
+  runFor(10);
+  CHECK(!FastDiodeHost::writes().empty());
+  CHECK(FastDiodeHost::writes().front().channel >= 0);
+  CHECK_EQ(FastDiodeHost::writes().front().duty, 77);
+  for (const FastDiodeHostWrite &write : FastDiodeHost::writes())
+    CHECK(write.duty != 0);
+  CHECK_EQ(lamp.getBrightness(), 77);
+  CHECK_EQ(lamp.getEffect(), EEffectType::STATIC);
+}
+
+// 呼吸灯按保存的时间和亮度恢复；不保存的实例不受同名记录影响
+static void testRestoreBreathing()
+{
+  FastDiode::setPersistDelay(DELAY);
+  {
+    FastDiode lamp(13, EPinPolarity::ACTIVE_HIGH, "breath");
+    lamp.init(5000, 8);
+    lamp.breathing(400, 200);
+    runFor(DELAY * 2);
+  }
+
+  FastDiode lamp(13, EPinPolarity::ACTIVE_HIGH, "breath");
+  lamp.init(5000, 8);
+  runFor(10);
+  CHECK_EQ(lamp.getEffect(), EEffectType::BREATHING);
+  FastDiodeHost::clear();
+  runFor(800);
+  uint32_t peak = 0;
+  for (const FastDiodeHostWrite &write : FastDiodeHost::writes())
+    peak = write.duty > peak ? write.duty : peak;
+  CHECK_EQ(peak, 200);
+
+  FastDiode::usePersistence(false);
+  FastDiode other(14, EPinPolarity::ACTIVE_HIGH, "breath");
+  FastDiode::usePersistence(true);
+  other.init(5000, 8);
+  runFor(10);
+  CHECK_EQ(other.getEffect(), EEffectType::STATIC);
+  CHECK_EQ(other.getBrightness(), 0);
+}
+
+int main()
+{
+  RUN_TEST(testCoalesce);
+  RUN_TEST(testRestoreLevel);
+  RUN_TEST(testRestoreBreathing);
+  return TEST_RESULT();
+}
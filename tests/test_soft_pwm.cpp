@@ -0,0 +1,188 @@
+/**
+ * @file test_soft_pwm.cpp
+ * @brief 软件PWM边沿表的生成
+ * @details 直接驱动 FastDiodePwmSchedule，检查 build() 生成的一个周期的输出表：
+ *          - 边沿按时间从小到大排列，修改点亮时间后仍然有序
+ *          - 点亮时间相同或相差不到 minGap 的通道合并成一个边沿
+ *          - 点亮时间为 0 的引脚只在 off 中，点亮时间不小于周期的引脚只在 set 中，都没有边沿
+ */
+
+#include "FastDiodeSoftPwm.h"
+#include "FastDiodeTest.h"
+
+static const uint32_t PERIOD = 5000;
+
+static FastDiodePinMask pin(int n) { return FastDiodePinMask(1) << n; }
+
+static bool sorted(const FastDiodePwmFrame &frame)
+{
+  for (uint8_t i = 1; i < frame.count; i++)
+    if (frame.edges[i].time <= frame.edges[i - 1].time)
+      return false;
+  return true;
+}
+
+static void testEdgeOrder()
+{
+  FastDiodePwmSchedule schedule(PERIOD);
+  const uint32_t widths[] = {3000, 1000, 4000, 2000};
+  int channels[4];
+  for (int i = 0; i < 4; i++)
+  {
+    channels[i] = schedule.add(pin(i));
+    CHECK(schedule.setWidth(channels[i], widths[i]));
+  }
+
+  FastDiodePwmFrame frame;
+  schedule.build(frame);
+  CHECK_EQ(frame.count, 4);
+  CHECK(sorted(frame));
+  CHECK_EQ(frame.set, pin(0) | pin(1) | pin(2) | pin(3));
+  CHECK_EQ(frame.off, 0);
+  // 1000 2000 3000 4000 分别是 GPIO1 3 0 2
+  const int expected[] = {1, 3, 0, 2};
+  for (int i = 0; i < 4; i++)
+  {
+    CHECK_EQ(frame.edges[i].time, (i + 1) * 1000);
+    CHECK_EQ(frame.edges[i].clear, pin(expected[i]));
+  }
+
+  // 最短的移到最后、最长的移到最前，其余的顺序不变
+  schedule.setWidth(channels[1], 4500);
+  schedule.setWidth(channels[2], 500);
+  schedule.build(frame);
+  CHECK_EQ(frame.count, 4);
+  CHECK(sorted(frame));
+  CHECK_EQ(frame.edges[0].clear, pin(2));
+  CHECK_EQ(frame.edges[1].clear, pin(3));
+  CHECK_EQ(frame.edges[2].clear, pin(0));
+  CHECK_EQ(frame.edges[3].clear, pin(1));
+  CHECK_EQ(frame.edges[3].time, 4500);
+}
+
+static void testEqualWidthsMerged()
+{
+  FastDiodePwmSchedule schedule(PERIOD);
+  int a = schedule.add(pin(4)), b = schedule.add(pin(5)), c = schedule.add(pin(6));
+  schedule.setWidth(a, 2000);
+  schedule.setWidth(b, 1000);
+  schedule.setWidth(c, 2000);
+
+  FastDiodePwmFrame frame;
+  schedule.build(frame);
+  CHECK_EQ(frame.count, 2);
+  CHECK_EQ(frame.edges[0].time, 1000);
+  CHECK_EQ(frame.edges[0].clear, pin(5));
+  CHECK_EQ(frame.edges[1].time, 2000);
+  CHECK_EQ(frame.edges[1].clear, pin(4) | pin(6));
+  CHECK_EQ(frame.set, pin(4) | pin(5) | pin(6));
+}
+
+// 相差不到 minGap 的边沿合并到前一个，间隔从合并后的边沿算起
+static void testMinGap()
+{
+  FastDiodePwmSchedule schedule(PERIOD, 10);
+  int a = schedule.add(pin(0)), b = schedule.add(pin(1)), c = schedule.add(pin(2)), d = schedule.add(pin(3));
+  schedule.setWidth(a, 100);
+  schedule.setWidth(b, 108);
+  schedule.setWidth(c, 116);
+  schedule.setWidth(d, 125);
+
+  FastDiodePwmFrame frame;
+  schedule.build(frame);
+  CHECK_EQ(frame.count, 2);
+  CHECK_EQ(frame.edges[0].time, 100);
+  CHECK_EQ(frame.edges[0].clear, pin(0) | pin(1));
+  CHECK_EQ(frame.edges[1].time, 116);
+  CHECK_EQ(frame.edges[1].clear, pin(2) | pin(3));
+
+  // 正好相差 minGap 的不合并
+  schedule.setWidth(b, 110);
+  schedule.setWidth(c, 200);
+  schedule.setWidth(d, 300);
+  schedule.build(frame);
+  CHECK_EQ(frame.count, 4);
+  CHECK_EQ(frame.edges[1].time, 110);
+  CHECK_EQ(frame.edges[1].clear, pin(1));
+}
+
+static void testZeroAndFull()
+{
+  FastDiodePwmSchedule schedule(PERIOD);
+  int off = schedule.add(pin(7)), on = schedule.add(pin(8)), half = schedule.add(pin(9));
+  CHECK(!schedule.setWidth(off, 0)); // 新通道的点亮时间已经是 0
+  CHECK(schedule.setWidth(on, PERIOD));
+  CHECK(schedule.setWidth(half, PERIOD / 2));
+
+  FastDiodePwmFrame frame;
+  schedule.build(frame);
+  CHECK_EQ(frame.off, pin(7));
+  CHECK_EQ(frame.set, pin(8) | pin(9));
+  CHECK_EQ(frame.count, 1);
+  CHECK_EQ(frame.edges[0].time, PERIOD / 2);
+  CHECK_EQ(frame.edges[0].clear, pin(9));
+
+  // 超过周期按一直点亮，与周期相同时不需要重新生成
+  CHECK(schedule.setWidth(half, PERIOD * 2));
+  CHECK_EQ(schedule.getWidth(half), PERIOD);
+  CHECK(!schedule.setWidth(half, PERIOD));
+  // 一直点亮改为 0：从 set 移到 off
+  CHECK(schedule.setWidth(on, 0));
+  schedule.build(frame);
+  CHECK_EQ(frame.off, pin(7) | pin(8));
+  CHECK_EQ(frame.set, pin(9));
+  CHECK_EQ(frame.count, 0);
+}
+
+static void testToWidth()
+{
+  FastDiodePwmSchedule schedule(PERIOD);
+  CHECK_EQ(schedule.toWidth(0, 255), 0);
+  CHECK_EQ(schedule.toWidth(255, 255), PERIOD);
+  CHECK_EQ(schedule.toWidth(1, 255), 20);      // 19.6 四舍五入
+  CHECK_EQ(schedule.toWidth(128, 255), 2510);  // 2509.8
+  CHECK_EQ(schedule.toWidth(512, 1023), 2502); // 2502.4
+  CHECK_EQ(schedule.toWidth(10, 0), 0);
+}
+
+static void testAddRemove()
+{
+  FastDiodePwmSchedule schedule(PERIOD);
+  int channels[FAST_DIODE_SOFT_PWM_CHANNELS];
+  for (int i = 0; i < FAST_DIODE_SOFT_PWM_CHANNELS; i++)
+  {
+    channels[i] = schedule.add(pin(i));
+    CHECK(channels[i] >= 0);
+    schedule.setWidth(channels[i], 100 * (i + 1));
+  }
+  CHECK_EQ(schedule.add(pin(40)), -1);
+  CHECK_EQ(schedule.size(), FAST_DIODE_SOFT_PWM_CHANNELS);
+
+  // 删除中间的通道，其余的边沿保持有序
+  schedule.setWidth(channels[2], 0);
+  schedule.remove(channels[2]);
+  FastDiodePwmFrame frame;
+  schedule.build(frame);
+  CHECK_EQ(frame.count, FAST_DIODE_SOFT_PWM_CHANNELS - 1);
+  CHECK(sorted(frame));
+  CHECK(!(frame.set & pin(2)));
+  CHECK(!(frame.off & pin(2)));
+
+  // 空出的通道可以再用，点亮时间从 0 开始
+  int reused = schedule.add(pin(40));
+  CHECK_EQ(reused, channels[2]);
+  CHECK_EQ(schedule.getWidth(reused), 0);
+  schedule.build(frame);
+  CHECK_EQ(frame.off, pin(40));
+}
+
+int main()
+{
+  RUN_TEST(testEdgeOrder);
+  RUN_TEST(testEqualWidthsMerged);
+  RUN_TEST(testMinGap);
+  RUN_TEST(testZeroAndFull);
+  RUN_TEST(testToWidth);
+  RUN_TEST(testAddRemove);
+  return TEST_RESULT();
+}